@@ -0,0 +1,624 @@
+/*!
+* @file PWM_LED_Bench.cpp
+*
+* @section intro_sec_Introduction
+*
+* Host benchmark of the PWM_LED library.
+*
+* Builds the unchanged library against the host backend in `src/host` and
+* measures, for 1 to 256 LEDs and for pattern lengths up to 255:
+* - the CPU time per edge of the tasks driving the LEDs, with each LED on
+*   its own task (the `_flash()` loop) and on shared engines;
+* - the wakeups per second of those tasks and the worst edge lateness;
+* - the time and heap taken to bring up a block of three LEDs with
+*   `begin()`, `begin(storage)` and `PWM_LED_Engine::begin(leds, count)`;
+* - the latency of `flash()` and `off()` calls, and of their `FromISR()`
+*   variants;
+* - the latency from an `onFromISR()` or `offFromISR()` call to the write
+*   of the edge, against its worst case of one tick on the ESP32, which
+*   host threads can exceed when they are preempted; the benchmark exits
+*   with 1 if an edge is lost;
+* - the throughput of a PWM_LED_Stream fed through a pipe, in frames,
+*   records and bytes per second;
+* - the frames per second of a PWM_LED_FrameBuffer of 16, 64 and 256
+*   channels, at the default tick and with the tick as short as possible;
+* - the RAM per instance, as the size of the object plus the simulated
+*   heap taken by its task and timer.
+*
+* Every result is printed as one JSON object per line, so runs of two
+* versions can be compared with a script:
+*
+* ``` sh
+* pio run -e bench && .pio/build/bench/program > results.jsonl
+* ```
+*
+* or without PlatformIO:
+*
+* ``` sh
+* g++ -std=gnu++17 -O2 -Ilib/PWM_LED/src lib/PWM_LED/bench/PWM_LED_Bench.cpp \
+*     lib/PWM_LED/src/PWM_*.cpp lib/PWM_LED/src/host/PWM_*.cpp -pthread -o bench
+* ./bench --duration=1000
+* ```
+*
+* The LEDs write to a counting backend instead of the simulated LEDC, so
+* the trace recorder is not measured and any number of channels can be
+* used. Host timings are only comparable between runs on the same 
+* machine.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include <PWM_LED.h>
+#include <PWM_LED_Stream.h>
+#include <PWM_LED_FrameBuffer.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/// The number of LEDs of the scaling runs.
+static const uint16_t LED_COUNTS[] = {1, 4, 16, 64, 256};
+
+/// The pattern lengths of the pattern runs.
+static const uint8_t PATTERN_LENGTHS[] = {2, 16, 64, 255};
+
+/// The number of LEDs of the pattern runs.
+#define PATTERN_RUN_LEDS 16
+
+/// The time unit of the benchmark patterns in microseconds.
+#define STEP_UNIT_US 100
+
+/// The length of every step, in STEP_UNIT_US: 5 ms, so that each LED
+/// plays 200 edges per second whatever the pattern length.
+#define STEP_UNITS 50
+
+/// The number of calls timed per API call.
+#define CALL_SAMPLES 10000
+
+/// The numbers of LEDs of the stream runs.
+static const uint16_t STREAM_LED_COUNTS[] = {16, 64};
+
+/// The numbers of channels of the frame buffer runs.
+static const uint16_t FRAME_CHANNELS[] = {16, 64, 256};
+
+/// The capacity of the frame buffers of the frame buffer runs.
+#define FRAME_MAX_CHANNELS 256
+
+/// The number of LEDs brought up together by the begin runs: a status
+/// block of three.
+#define BEGIN_LEDS 3
+
+/// The number of blocks of BEGIN_LEDS LEDs timed per begin run.
+#define BEGIN_BLOCKS 20
+
+/// The number of commands from an "ISR" timed to their edge.
+#define ISR_SAMPLES 2000
+
+/// The documented worst case of the command-to-edge latency of commands
+/// from ISRs that do not yield: one FreeRTOS tick.
+#define ISR_LATENCY_BOUND_US (portTICK_PERIOD_MS * 1000)
+
+/// @brief The monotonic time in nanoseconds.
+static int64_t wallNs(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+};
+
+/// @brief An output backend that counts writes and times the writes to
+/// one channel.
+class PWM_LED_BenchOutput: public PWM_LED_Output{
+
+    public:
+
+    bool attach(uint8_t pin, uint8_t channel) override {
+        return true;
+    };
+
+    void write(uint8_t channel, uint32_t duty) override {
+        _writes.fetch_add(1, std::memory_order_relaxed);
+        if (channel == _watched){
+            _watchedNs.store(wallNs());
+        }
+    };
+
+    /// @brief The number of writes so far.
+    uint64_t writes(){
+        return _writes.load();
+    };
+
+    /// @brief Records the time of the writes to [channel].
+    void watch(uint16_t channel){
+        _watched = channel;
+        _watchedNs.store(0);
+    };
+
+    /// @brief The time of the last write to the watched channel.
+    int64_t watchedNs(){
+        return _watchedNs.load();
+    };
+
+    private:
+
+    std::atomic<uint64_t> _writes{0};
+
+    std::atomic<uint16_t> _watched{0xFFFF};
+
+    std::atomic<int64_t> _watchedNs{0};
+
+};
+
+/// @brief The settings of a run.
+typedef struct{
+
+    /// @brief How long each run plays, in milliseconds.
+    uint32_t durationMs;
+
+    /// @brief The largest LED count of the scaling runs.
+    uint16_t maxLeds;
+
+} bench_options_t;
+
+static PWM_LED_BenchOutput output;
+
+static int brightness = 0xFF;
+
+/// @brief The CPU time of the process in nanoseconds.
+static int64_t cpuNs(){
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+};
+
+/// @brief A pattern of [length] steps of STEP_UNITS. The steps are never
+/// freed, as the LEDs that play them outlive the run.
+static const PWM_LED_Pattern & pattern(uint8_t length){
+    uint16_t * steps = new uint16_t[length];
+    for (uint8_t i = 0; i < length; i++){
+        steps[i] = STEP_UNITS;
+    }
+    return * new PWM_LED_Pattern(steps, length, STEP_UNIT_US);
+};
+
+/// @brief Starts [count] LEDs, each with its own task if [engines] is 
+/// false or on engines of up to PWM_LED_ENGINE_MAX_LEDS LEDs otherwise.
+/// The LEDs and engines are never freed: their tasks cannot be stopped.
+/// @param heapBytes Set to the simulated heap taken by the tasks.
+static std::vector<PWM_LED*> start(uint16_t count, 
+        bool engines, 
+        std::vector<PWM_LED_Engine*> & engineList,
+        uint32_t & heapBytes){
+    std::vector<PWM_LED*> leds;
+    uint32_t heap = esp_get_free_heap_size();
+    PWM_LED_Engine * engine = NULL;
+    for (uint16_t i = 0; i < count; i++){
+        PWM_LED * led = new PWM_LED(output, 0, i, brightness, HIGH);
+        if (engines && (engine == NULL || 
+                engine->size() == PWM_LED_ENGINE_MAX_LEDS)){
+            engine = new PWM_LED_Engine();
+            engineList.push_back(engine);
+        }
+        bool started = engines? led->begin(*engine) : led->begin();
+        if (!started){
+            fprintf(stderr, "LED %u did not start\n", i);
+            exit(1);
+        }
+        leds.push_back(led);
+    }
+    heapBytes = heap - esp_get_free_heap_size();
+    return leds;
+};
+
+/// @brief The wakeups of the tasks driving [leds].
+static uint64_t wakeups(std::vector<PWM_LED*> & leds,
+        std::vector<PWM_LED_Engine*> & engines){
+    uint64_t total = 0;
+    if (engines.empty()){
+        for (PWM_LED * led : leds){
+            total += led->wakeups();
+        }
+    }
+    for (PWM_LED_Engine * engine : engines){
+        total += engine->wakeups();
+    }
+    return total;
+};
+
+/// @brief Flashes [count] LEDs with a pattern of [length] steps for the
+/// run duration and prints the CPU time per edge, the wakeup rate, the
+/// worst lateness and the RAM per LED.
+static void runEdges(const char * name,
+        uint16_t count, 
+        uint8_t length, 
+        bool engines,
+        const bench_options_t & options){
+    std::vector<PWM_LED_Engine*> engineList;
+    uint32_t heapBytes;
+    std::vector<PWM_LED*> leds = start(count, engines, engineList, heapBytes);
+    const PWM_LED_Pattern & steps = pattern(length);
+    for (PWM_LED * led : leds){
+        led->flash(steps);
+    }
+    // let every task play its first edge before measuring
+    usleep(20000);
+    uint64_t writes = output.writes();
+    uint64_t woken = wakeups(leds, engineList);
+    int64_t cpu = cpuNs();
+    int64_t wall = wallNs();
+    usleep(options.durationMs * 1000);
+    cpu = cpuNs() - cpu;
+    wall = wallNs() - wall;
+    writes = output.writes() - writes;
+    woken = wakeups(leds, engineList) - woken;
+    int32_t lateness = 0;
+    for (PWM_LED * led : leds){
+        lateness = std::max(lateness, led->maxLatenessUs());
+        led->off();
+    }
+    usleep(20000);
+    double seconds = wall / 1e9;
+    printf("{\"bench\":\"%s\",\"mode\":\"%s\",\"leds\":%u,"
+            "\"patternLength\":%u,\"seconds\":%.3f,\"edges\":%llu,"
+            "\"edgesPerSecond\":%.1f,\"cpuNsPerEdge\":%.1f,"
+            "\"cpuPercent\":%.2f,\"wakeupsPerSecond\":%.1f,"
+            "\"maxLatenessUs\":%d,\"ramBytesPerLed\":%.1f}\n",
+            name, engines? "engine" : "task", count, length, seconds,
+            (unsigned long long)writes, writes / seconds,
+            writes == 0? 0.0 : (double)cpu / writes,
+            100.0 * cpu / wall, woken / seconds, lateness,
+            sizeof(PWM_LED) + (double)heapBytes / count);
+    fflush(stdout);
+};
+
+/// @brief Times [samples] calls of [call] and prints the mean and the
+/// 50th, 99th and largest latency.
+template <typename Call>
+static void runCall(const char * op, const char * mode, Call call){
+    std::vector<int64_t> samples(CALL_SAMPLES);
+    for (int64_t & sample : samples){
+        int64_t start = wallNs();
+        call();
+        sample = wallNs() - start;
+    }
+    std::sort(samples.begin(), samples.end());
+    int64_t total = 0;
+    for (int64_t sample : samples){
+        total += sample;
+    }
+    printf("{\"bench\":\"call\",\"op\":\"%s\",\"mode\":\"%s\","
+            "\"samples\":%u,\"meanNs\":%.1f,\"p50Ns\":%lld,\"p99Ns\":%lld,"
+            "\"maxNs\":%lld}\n",
+            op, mode, CALL_SAMPLES, (double)total / CALL_SAMPLES,
+            (long long)samples[CALL_SAMPLES / 2],
+            (long long)samples[CALL_SAMPLES * 99 / 100],
+            (long long)samples.back());
+    fflush(stdout);
+};
+
+/// @brief Times `flash()` and `off()` on a running LED.
+static void runCalls(bool engines){
+    std::vector<PWM_LED_Engine*> engineList;
+    uint32_t heapBytes;
+    std::vector<PWM_LED*> leds = start(1, engines, engineList, heapBytes);
+    PWM_LED & led = *leds[0];
+    const PWM_LED_Pattern & steps = pattern(16);
+    uint16_t array[16];
+    for (uint16_t & step : array){
+        step = STEP_UNITS;
+    }
+    const char * mode = engines? "engine" : "task";
+    runCall("flash(pattern)", mode, [&](){ led.flash(steps); });
+    runCall("flash(array)", mode, [&](){ led.flash(array, 16, STEP_UNIT_US); });
+    runCall("off()", mode, [&](){ led.off(); });
+    // the LED task drains at most PWM_LED_ISR_QUEUE_SIZE commands per 
+    // wakeup, so most of these are dropped: only the push is timed
+    runCall("flashFromISR()", mode, [&](){ led.flashFromISR(steps); });
+    runCall("offFromISR()", mode, [&](){ led.offFromISR(); });
+    led.off();
+    usleep(20000);
+};
+
+/// @brief Alternates `onFromISR()` and `offFromISR()` on a running LED and
+/// prints the latency from each call to the write of its edge.
+/// @return false if an edge was lost.
+static bool runIsr(bool engines){
+    std::vector<PWM_LED_Engine*> engineList;
+    uint32_t heapBytes;
+    std::vector<PWM_LED*> leds = start(1, engines, engineList, heapBytes);
+    PWM_LED & led = *leds[0];
+    usleep(20000);
+    std::vector<int64_t> samples;
+    uint32_t lost = 0;
+    for (uint32_t i = 0; i < ISR_SAMPLES; i++){
+        output.watch(0);
+        int64_t start = wallNs();
+        BaseType_t woken = pdFALSE;
+        bool pushed = i % 2 == 0? led.onFromISR(&woken) : 
+                led.offFromISR(&woken);
+        // wait up to 100 ms for the edge
+        for (int wait = 0; pushed && output.watchedNs() == 0 && wait < 1000;
+                wait++){
+            usleep(100);
+        }
+        if (output.watchedNs() == 0){
+            lost++;
+            continue;
+        }
+        samples.push_back((output.watchedNs() - start) / 1000);
+    }
+    output.watch(0xFFFF);
+    std::sort(samples.begin(), samples.end());
+    int64_t total = 0;
+    uint32_t over = 0;
+    for (int64_t sample : samples){
+        total += sample;
+        over += sample > ISR_LATENCY_BOUND_US;
+    }
+    size_t count = std::max<size_t>(samples.size(), 1);
+    printf("{\"bench\":\"isr\",\"mode\":\"%s\",\"samples\":%u,"
+            "\"lost\":%u,\"meanUs\":%.1f,\"p50Us\":%lld,\"p99Us\":%lld,"
+            "\"maxUs\":%lld,\"boundUs\":%u,\"overBound\":%u}\n",
+            engines? "engine" : "task", (unsigned)samples.size(), lost,
+            (double)total / count,
+            (long long)(samples.empty()? 0 : samples[samples.size() / 2]),
+            (long long)(samples.empty()? 0 : 
+                samples[samples.size() * 99 / 100]),
+            (long long)(samples.empty()? 0 : samples.back()),
+            (unsigned)ISR_LATENCY_BOUND_US, over);
+    fflush(stdout);
+    led.off();
+    usleep(20000);
+    return lost == 0;
+};
+
+/// @brief Brings up [BEGIN_BLOCKS] blocks of BEGIN_LEDS LEDs, each with
+/// `begin()`, `begin(storage)` or one `PWM_LED_Engine::begin(leds, count)`
+/// as [mode] says, and prints the time per block (mean, p50 and maximum)
+/// and the simulated heap it takes.
+static void runBegin(const char * mode){
+    std::vector<int64_t> samples(BEGIN_BLOCKS);
+    uint32_t heap = esp_get_free_heap_size();
+    for (int64_t & sample : samples){
+        // nothing is freed, as the tasks cannot be stopped
+        PWM_LED * leds[BEGIN_LEDS];
+        for (uint8_t i = 0; i < BEGIN_LEDS; i++){
+            leds[i] = new PWM_LED(output, 0, i, brightness, HIGH);
+        }
+        bool started = true;
+        int64_t start = wallNs();
+        if (strcmp(mode, "engine") == 0){
+            started = (new PWM_LED_Engine())->begin(leds, BEGIN_LEDS);
+        } else {
+            for (PWM_LED * led : leds){
+                started = (strcmp(mode, "static") == 0?
+                        led->begin(*new PWM_LED_TaskStorage()) :
+                        led->begin()) && started;
+            }
+        }
+        sample = wallNs() - start;
+        if (!started){
+            fprintf(stderr, "LEDs did not start\n");
+            exit(1);
+        }
+    }
+    uint32_t heapBytes = heap - esp_get_free_heap_size();
+    std::sort(samples.begin(), samples.end());
+    int64_t total = 0;
+    for (int64_t sample : samples){
+        total += sample;
+    }
+    printf("{\"bench\":\"begin\",\"mode\":\"%s\",\"leds\":%u,"
+            "\"blocks\":%u,\"meanUs\":%.1f,\"p50Us\":%.1f,"
+            "\"maxUs\":%.1f,\"heapBytesPerBlock\":%.1f}\n",
+            mode, BEGIN_LEDS, BEGIN_BLOCKS, total / 1e3 / BEGIN_BLOCKS,
+            samples[BEGIN_BLOCKS / 2] / 1e3, samples.back() / 1e3,
+            (double)heapBytes / BEGIN_BLOCKS);
+    fflush(stdout);
+};
+
+/// @brief Feeds frames that command [count] LEDs each through a pipe for
+/// the run duration and prints the frames, records and bytes applied per
+/// second, the CPU time per record and the engine wakeups per frame.
+static void runStream(uint16_t count, 
+        bool engines, 
+        const bench_options_t & options){
+    std::vector<PWM_LED_Engine*> engineList;
+    uint32_t heapBytes;
+    std::vector<PWM_LED*> leds = start(count, engines, engineList, heapBytes);
+    static const PWM_LED_Pattern * patterns[1];
+    patterns[0] = &pattern(2);
+    PWM_LED_Stream * stream = new PWM_LED_Stream();
+    for (PWM_LED * led : leds){
+        stream->add(*led);
+    }
+    stream->setPatterns(patterns, 1);
+    // three frames: all on, all flashing and all off
+    uint8_t frames[3][PWM_LED_STREAM_FRAME_SIZE + PWM_LED_STREAM_OVERHEAD];
+    uint16_t lengths[3];
+    for (uint8_t i = 0; i < 3; i++){
+        PWM_LED_StreamFrame frame(frames[i], sizeof(frames[i]));
+        for (uint16_t id = 0; id < count; id++){
+            i == 0? frame.on(id) : i == 1? frame.flash(id, 0) : frame.off(id);
+        }
+        lengths[i] = frame.finish();
+    }
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0){
+        perror("pipe");
+        exit(1);
+    }
+    std::atomic<bool> stop{false};
+    std::thread writer([&](){
+        for (uint32_t i = 0; !stop.load(); i++){
+            if (write(pipeFds[1], frames[i % 3], lengths[i % 3]) < 0){
+                break;
+            }
+        }
+        close(pipeFds[1]);
+    });
+    uint64_t woken = wakeups(leds, engineList);
+    int64_t cpu = cpuNs();
+    int64_t wall = wallNs();
+    int64_t end = wall + (int64_t)options.durationMs * 1000000;
+    uint64_t bytes = 0;
+    uint8_t buffer[4096];
+    ssize_t read;
+    while (wallNs() < end && 
+            (read = ::read(pipeFds[0], buffer, sizeof(buffer))) > 0){
+        stream->feed(buffer, read);
+        bytes += read;
+    }
+    cpu = cpuNs() - cpu;
+    wall = wallNs() - wall;
+    woken = wakeups(leds, engineList) - woken;
+    uint32_t framesApplied = stream->frames();
+    uint32_t records = stream->records();
+    stop.store(true);
+    // drain the pipe so that the writer sees the flag
+    while (::read(pipeFds[0], buffer, sizeof(buffer)) > 0){}
+    writer.join();
+    close(pipeFds[0]);
+    for (PWM_LED * led : leds){
+        led->off();
+    }
+    usleep(20000);
+    double seconds = wall / 1e9;
+    printf("{\"bench\":\"stream\",\"mode\":\"%s\",\"leds\":%u,"
+            "\"seconds\":%.3f,\"framesPerSecond\":%.1f,"
+            "\"recordsPerSecond\":%.1f,\"bytesPerSecond\":%.1f,"
+            "\"cpuNsPerRecord\":%.1f,\"wakeupsPerFrame\":%.2f,"
+            "\"errors\":%u}\n",
+            engines? "engine" : "task", count, seconds,
+            framesApplied / seconds, records / seconds, bytes / seconds,
+            records == 0? 0.0 : (double)cpu / records,
+            framesApplied == 0? 0.0 : (double)woken / framesApplied,
+            stream->errors());
+    fflush(stdout);
+};
+
+/// @brief Renders a moving gradient into a frame buffer of [count] 
+/// channels for the run duration, presenting each frame and waiting for it
+/// to be shown, and prints the frames per second, the channel writes per
+/// frame and the CPU time per frame.
+/// @param intervalUs The tick of the frame buffer; 1 shows frames as fast
+/// as the task can.
+static void runFrames(uint16_t count,
+        uint32_t intervalUs,
+        const bench_options_t & options){
+    std::vector<PWM_LED_Engine*> engineList;
+    uint32_t heapBytes;
+    std::vector<PWM_LED*> leds = start(count, true, engineList, heapBytes);
+    PWM_LED_FrameBuffer<FRAME_MAX_CHANNELS> * panel = 
+            new PWM_LED_FrameBuffer<FRAME_MAX_CHANNELS>(intervalUs);
+    for (PWM_LED * led : leds){
+        panel->add(*led);
+    }
+    panel->begin();
+    usleep(20000);
+    uint32_t frames = panel->frames();
+    uint32_t writes = panel->writes();
+    uint32_t presented = 0;
+    int64_t cpu = cpuNs();
+    int64_t wall = wallNs();
+    int64_t end = wall + (int64_t)options.durationMs * 1000000;
+    while (wallNs() < end){
+        // every channel changes in every frame
+        for (uint16_t i = 0; i < count; i++){
+            panel->set(i, (uint8_t)(presented * 2 + i));
+        }
+        panel->present();
+        presented++;
+        panel->wait(100);
+    }
+    cpu = cpuNs() - cpu;
+    wall = wallNs() - wall;
+    frames = panel->frames() - frames;
+    writes = panel->writes() - writes;
+    // a frame buffer with a 1 us tick keeps a core busy, which would skew
+    // every bench after this one
+    panel->end();
+    for (PWM_LED * led : leds){
+        led->off();
+    }
+    usleep(20000);
+    double seconds = wall / 1e9;
+    printf("{\"bench\":\"frame\",\"channels\":%u,\"intervalUs\":%u,"
+            "\"seconds\":%.3f,\"framesPerSecond\":%.1f,"
+            "\"presentedPerSecond\":%.1f,\"writesPerFrame\":%.1f,"
+            "\"cpuNsPerFrame\":%.1f,\"ramBytes\":%u}\n",
+            count, intervalUs, seconds, frames / seconds, 
+            presented / seconds,
+            frames == 0? 0.0 : (double)writes / frames,
+            frames == 0? 0.0 : (double)cpu / frames,
+            (unsigned)(sizeof(PWM_LED_FrameEngine) + 
+                count * (5 * sizeof(uint16_t) + sizeof(PWM_LED*))));
+    fflush(stdout);
+};
+
+int main(int argc, char ** argv){
+    bench_options_t options = {1000, 256};
+    for (int i = 1; i < argc; i++){
+        if (strncmp(argv[i], "--duration=", 11) == 0){
+            options.durationMs = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--max-leds=", 11) == 0){
+            options.maxLeds = atoi(argv[i] + 11);
+        } else {
+            fprintf(stderr, 
+                    "usage: %s [--duration=ms] [--max-leds=n]\n", argv[0]);
+            return 2;
+        }
+    }
+    printf("{\"bench\":\"build\",\"version\":\"1.1.0\","
+            "\"sizeofPWM_LED\":%u,\"sizeofEngine\":%u,"
+            "\"engineMaxLeds\":%u,\"taskStackBytes\":%u}\n",
+            (unsigned)sizeof(PWM_LED), (unsigned)sizeof(PWM_LED_Engine),
+            PWM_LED_ENGINE_MAX_LEDS, PWM_LED_TASK_STACK_SIZE);
+    for (const char * mode : {"task", "static", "engine"}){
+        runBegin(mode);
+    }
+    runCalls(false);
+    runCalls(true);
+    bool delivered = runIsr(false);
+    delivered = runIsr(true) && delivered;
+    for (bool engines : {false, true}){
+        for (uint16_t count : STREAM_LED_COUNTS){
+            if (count <= options.maxLeds){
+                runStream(count, engines, options);
+            }
+        }
+    }
+    for (uint32_t intervalUs : {(uint32_t)PWM_LED_FRAME_INTERVAL_US, 
+            (uint32_t)1}){
+        for (uint16_t count : FRAME_CHANNELS){
+            if (count <= options.maxLeds){
+                runFrames(count, intervalUs, options);
+            }
+        }
+    }
+    for (bool engines : {false, true}){
+        for (uint16_t count : LED_COUNTS){
+            if (count <= options.maxLeds){
+                runEdges("scale", count, 2, engines, options);
+            }
+        }
+        for (uint8_t length : PATTERN_LENGTHS){
+            runEdges("pattern", PATTERN_RUN_LEDS, length, engines, options);
+        }
+    }
+    fflush(stdout);
+    // the LED tasks cannot be stopped, so skip the static destructors
+    _exit(delivered? 0 : 1);
+};
@@ -97,6 +97,7 @@ void setup() {
   delay (500);
   // set the brightness around 25%
   brightness = 64;
+  blue.refresh();
   Serial.println("setup() done!");
   delay(1000);            // wait one second  
   blue.off();             // turn BLUE off
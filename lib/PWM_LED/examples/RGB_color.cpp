@@ -0,0 +1,74 @@
+/*!
+* @file RGB_color.cpp
+*
+* @mainpage Sketch to demonstrate the PWM_RGB_LED class.
+*
+* @section intro_sec_Introduction
+*
+* This sketch requires an RGB LED connected to pins 14, 27 and 12,
+* driven by PWM channels 2, 3 and 4 as a single PWM_RGB_LED. The three
+* channels are written together at every edge, so the color does not
+* tear while the LED flashes.
+*
+* During the loop() task the LED cycles through the LED_Color values,
+* flashing each in a dot-dash-dot (. - .) pattern for 3 seconds, and 
+* then fades a 24-bit orange in and out.
+*
+* @section author Author
+* 
+* Gerhard Malan for GM Consult Pty Ltd
+* 
+ * @section license License
+ * 
+ * This library is open-source under the BSD 3-Clause license and 
+ * redistribution and use in source and binary forms, with or without 
+ * modification, are permitted, provided that the license conditions are met.
+ * 
+*/
+
+#include <PWM_RGB_LED.h>
+
+#define LED_RED_PIN 14U
+#define LED_GREEN_PIN 27U
+#define LED_BLUE_PIN 12U
+
+#define LED_RED_PWM 2
+#define LED_GREEN_PWM 3
+#define LED_BLUE_PWM 4
+
+/// @brief A dot - dash - dot flashing pattern.
+static const uint16_t DOT_DASH_DOT[] = {100, 100, 500, 100, 100, 1000};
+const PWM_LED_Pattern dotDashDot(DOT_DASH_DOT);
+
+/// @brief The colors to cycle through.
+const LED_Color colors[] = {COLOR_RED, COLOR_GREEN, COLOR_BLUE, 
+    COLOR_YELLOW, COLOR_MAGENTA, COLOR_CYAN};
+
+/// @brief The brightness, passed by reference to the PWM_RGB_LED instance.
+int brightness = 0xff;
+
+// instantiate the PWM_RGB_LED instance.
+PWM_RGB_LED rgb(LED_RED_PIN, LED_RED_PWM,
+    LED_GREEN_PIN, LED_GREEN_PWM,
+    LED_BLUE_PIN, LED_BLUE_PWM,
+    brightness, HIGH);
+
+// get everything ready
+void setup() {
+  Serial.begin(115200);
+  rgb.begin();
+  Serial.println("setup() done!");
+}
+
+void loop() {
+  for (LED_Color color : colors){
+    rgb.setColor(color);        // change color, keeping the pattern
+    rgb.flash(dotDashDot);      // flash all three channels together
+    delay(3000);
+  }
+  rgb.setColor24(0xFF8000);     // orange
+  rgb.fadeTo(0xff, 1000);       // fade in over one second
+  delay(1500);
+  rgb.fadeTo(0, 1000);          // fade out over one second
+  delay(1500);
+}
@@ -102,6 +102,7 @@ void setup() {
   LED.on();              // turn on the LED
   delay (2500);          // keep on for 2.5 seconds
   brightness = 64;       // dim to 25%
+  LED.refresh();         // apply the new brightness
   delay(2500);           // wait 2.5 seconds
   LED.off();             // turn LED off
   
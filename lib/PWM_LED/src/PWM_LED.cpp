@@ -38,113 +38,993 @@
 
 #include "PWM_LED.h"
 
-#define TASK_STACK_SIZE 0x1000
 #define TASK_PRIORITY 10
 
+#define PWM_LED_BUFFER_BUSY 0xFF
+#define MAILBOX_INDEX_MASK 0x03
+#define MAILBOX_FRESH 0x04
+#define MAILBOX_SEQUENCE_SHIFT 8
+#define MAILBOX_STATE_MASK 0xFF
+
 PWM_LED::PWM_LED(uint8_t pin, 
         uint8_t PwmChannel, 
         int & brightness, 
         int onState):
+            PWM_LED(PWM_LED_LEDC::shared(), pin, PwmChannel, &brightness, 
+                    NULL, onState){};
+
+PWM_LED::PWM_LED(PWM_LED_Output & output,
+        uint8_t pin, 
+        uint8_t channel, 
+        int & brightness, 
+        int onState):
+            PWM_LED(output, pin, channel, &brightness, NULL, onState){};
+
+PWM_LED::PWM_LED(uint8_t pin, 
+        uint8_t PwmChannel, 
+        PWM_LED_BrightnessGroup & group, 
+        int onState):
+            PWM_LED(PWM_LED_LEDC::shared(), pin, PwmChannel, NULL, &group, 
+                    onState){};
+
+PWM_LED::PWM_LED(PWM_LED_Output & output,
+        uint8_t pin, 
+        uint8_t channel, 
+        PWM_LED_BrightnessGroup & group, 
+        int onState):
+            PWM_LED(output, pin, channel, NULL, &group, onState){};
+
+PWM_LED::PWM_LED(PWM_LED_Output & output,
+        uint8_t pin, 
+        uint8_t channel, 
+        int * brightness, 
+        PWM_LED_BrightnessGroup * group,
+        int onState):
+            _backend(output),
             _GPIO(pin), 
-            _PwmChannel(PwmChannel),
+            _PwmChannel(channel),
             _brightness(brightness),
+            _group(group),
             _onState(bool(onState)){};
 
 bool PWM_LED::begin(){
-    ledcSetup(_PwmChannel, PWM_LED_PWM_FREQ, PWM_LED_PWM_RESOLUTION);
-    ledcAttachPin(_GPIO, _PwmChannel);
-    vTaskDelay(100/portTICK_PERIOD_MS);
-    if (_createTask()){
+    return _begin(PWM_LED_TaskStorage::acquire());
+};
+
+bool PWM_LED::begin(PWM_LED_TaskStorage & storage){
+    return _begin(&storage);
+};
+
+bool PWM_LED::_begin(PWM_LED_TaskStorage * storage){
+    if (!_attach()){
+        return false;
+    }
+    if (_createTask(storage)){
+        _joinGroup();
         off();        
-        _ledState = LED_OFF;
         return true;        
     }
     return false;
 };
 
-bool PWM_LED::_createTask(){
-    _flashSemaphore = xSemaphoreCreateBinary();
-    if (_flashSemaphore == NULL){
+bool PWM_LED::begin(PWM_LED_Engine & engine){
+    if (!_attach()){
         return false;
-    } 
-    if (!xTaskCreate(this->_flashTaskStatic,
+    }
+    if (engine.begin() && engine.attach(this)){
+        _joinGroup();
+        off();
+        return true;
+    }
+    return false;
+};
+
+bool PWM_LED::_attach(){
+    return _backend.attach(_GPIO, _PwmChannel);
+};
+
+bool PWM_LED::_createTask(PWM_LED_TaskStorage * storage){
+    if (!_timer.begin(&_flashTask)){
+        return false;
+    }
+    return PWM_LED_TaskStorage::createTask(storage,
+        this->_flashTaskStatic,
         "LED_TASK",
-        TASK_STACK_SIZE,
         this,
         TASK_PRIORITY, 
-        &_flashTask)){
-        return false;
-    } 
-    return true;
+        &_flashTask);
+};
+
+void PWM_LED::setGamma(bool enabled){
+    _gamma.store(enabled);
+    refresh();
+};
+
+void PWM_LED::setSlack(uint32_t slackUs){
+    _slackUs.store(slackUs);
+    // the engine may be sleeping towards a wake time set with the old slack
+    if (_engine != NULL){
+        _engine->notify(this);
+    }
+};
+
+uint32_t PWM_LED::slack(){
+    return _slackUs.load();
+};
+
+int PWM_LED::maxLevel(){
+    return _maxLevel;
+};
+
+void PWM_LED::_joinGroup(){
+    if (_group != NULL && !_inGroup){
+        _inGroup = true;
+        _group->_add(this);
+    }
+};
+
+int PWM_LED::_onLevel(){
+    return std::min(_group != NULL? _group->level() : *_brightness, 
+            _maxLevel);
 };
 
 LED_State PWM_LED::state(){
+    // the task has not received the newest command yet
+    uint32_t requested = _requested.load();
+    if ((int32_t)(((requested >> MAILBOX_SEQUENCE_SHIFT) - _applied.load())
+            << MAILBOX_SEQUENCE_SHIFT) > 0){
+        return (led_state_t)(requested & MAILBOX_STATE_MASK);
+    }
     return _ledState;
 };
 
+uint32_t PWM_LED::wakeups(){
+    return _engine == NULL? _timer.wakeups() : _engine->wakeups();
+};
+
+uint32_t PWM_LED::wakeupsPerSecond(){
+    return _engine == NULL? _timer.wakeupsPerSecond() : _engine->wakeupsPerSecond();
+};
+
+int32_t PWM_LED::latenessUs(){
+    return _latenessUs;
+};
+
+int32_t PWM_LED::maxLatenessUs(){
+    return _maxLatenessUs;
+};
+
+PWM_LED_metrics_t PWM_LED::metrics(){
+    #ifdef PWM_LED_METRICS
+    return _metrics.snapshot();
+    #else
+    return {};
+    #endif // PWM_LED_METRICS
+};
+
+void PWM_LED::resetMetrics(){
+    PWM_LED_METRIC(_metrics.reset());
+};
+
+uint32_t PWM_LED::sequence(){
+    return _applied.load();
+};
+
 void PWM_LED::on(){ 
-    xSemaphoreTake(_flashSemaphore,  ( TickType_t ) 1);      
-    _flashPatternLength = 0;      
-    flash(_onPattern,1);
-    _ledState = LED_ON;
+    _publish(LED_ON, NULL);
 };
 
 void PWM_LED::off(){  
-    xSemaphoreTake(_flashSemaphore,  ( TickType_t ) 1);    
-    _flashPatternLength = 0; 
+    _publish(LED_OFF, NULL);
+}
+
+bool IRAM_ATTR PWM_LED::onFromISR(BaseType_t * woken){
+    return _publishFromISR(LED_ON, NULL, woken);
+};
+
+bool IRAM_ATTR PWM_LED::offFromISR(BaseType_t * woken){
+    return _publishFromISR(LED_OFF, NULL, woken);
+};
+
+bool IRAM_ATTR PWM_LED::flashFromISR(const PWM_LED_Pattern & pattern, 
+        BaseType_t * woken){
+    if (pattern.cycleUs() == 0){
+        return _publishFromISR(LED_OFF, NULL, woken);
+    }
+    return _publishFromISR(LED_FLASHING, &pattern, woken);
+};
+
+uint32_t PWM_LED::droppedFromISR(){
+    return _isrQueue.dropped();
+};
+
+bool PWM_LED::flash(uint16_t * pattern, uint8_t length, uint16_t unitUs){   
+    const PWM_LED_Pattern * interned = 
+        PWM_LED_Patterns::intern(pattern, length, unitUs);
+    if (interned == NULL){
+        return false;
+    }
+    if (interned->cycleUs() == 0){
+        PWM_LED_Patterns::release(interned);
+        off();
+        return true;
+    }
+    _publish(LED_FLASHING, interned);
+    return true;
+}
+
+void PWM_LED::flash(const PWM_LED_Pattern & pattern){
+    if (pattern.cycleUs() == 0){
+        off();
+        return;
+    }
+    PWM_LED_Patterns::acquire(&pattern);
+    _publish(LED_FLASHING, &pattern);
+}
+
+void PWM_LED::flash(const PWM_LED_CompactPattern & pattern){
+    if (!pattern.playable()){
+        off();
+        return;
+    }
+    _publish(LED_FLASHING, NULL, 0, 0, &pattern);
+}
+
+void PWM_LED::flash(PWM_LED_Generator & generator){
+    _publish(LED_FLASHING, NULL, 0, 0, NULL, &generator);
+}
+
+PWM_LED_Handle PWM_LED::flash(const PWM_LED_Pattern & pattern,
+        uint16_t repeats,
+        PWM_LED_Callback callback,
+        void * context){
+    led_command_t command = {};
+    if (pattern.cycleUs() != 0){
+        PWM_LED_Patterns::acquire(&pattern);
+        command.state = LED_FLASHING;
+        command.pattern = &pattern;
+    }
+    return _publishSequence(command, repeats, callback, context);
+}
+
+PWM_LED_Handle PWM_LED::flash(const PWM_LED_CompactPattern & pattern,
+        uint16_t repeats,
+        PWM_LED_Callback callback,
+        void * context){
+    led_command_t command = {};
+    if (pattern.playable()){
+        command.state = LED_FLASHING;
+        command.flash.compact = &pattern;
+    }
+    return _publishSequence(command, repeats, callback, context);
+}
+
+PWM_LED_Handle PWM_LED::flash(PWM_LED_Generator & generator,
+        uint16_t repeats,
+        PWM_LED_Callback callback,
+        void * context){
+    led_command_t command = {};
+    command.state = LED_FLASHING;
+    command.flash.generator = &generator;
+    return _publishSequence(command, repeats, callback, context);
+}
+
+PWM_LED_Handle PWM_LED::flash(uint16_t * pattern, 
+        uint8_t length, 
+        uint16_t unitUs,
+        uint16_t repeats,
+        PWM_LED_Callback callback,
+        void * context){
+    led_command_t command = {};
+    const PWM_LED_Pattern * interned = 
+        PWM_LED_Patterns::intern(pattern, length, unitUs);
+    if (interned == NULL){
+        if (callback != NULL){
+            PWM_LED_Dispatcher::begin();
+            PWM_LED_Dispatcher::post(callback, context, false);
+        }
+        return PWM_LED_Handle();
+    }
+    if (interned->cycleUs() == 0){
+        PWM_LED_Patterns::release(interned);
+    } else {
+        command.state = LED_FLASHING;
+        command.pattern = interned;
+    }
+    return _publishSequence(command, repeats, callback, context);
+}
+
+PWM_LED_Handle PWM_LED::_publishSequence(led_command_t & command,
+        uint16_t repeats,
+        PWM_LED_Callback callback,
+        void * context){
+    if (callback != NULL){
+        PWM_LED_Dispatcher::begin();
+    }
+    // a sequence that cannot play turns the LED off and counts as played
+    // once the task applies it
+    command.repeats = command.state == LED_FLASHING? repeats : 0;
+    command.flash.callback = callback;
+    command.flash.context = context;
+    uint32_t sequence = _publish(command);
+    return sequence == 0? PWM_LED_Handle() : PWM_LED_Handle(this, sequence);
+}
+
+bool PWM_LED::_done(uint32_t sequence){
+    // the sequences wrap at 24 bits, so compare their signed difference
+    return (int32_t)((_finished.load() - sequence) << 
+            MAILBOX_SEQUENCE_SHIFT) >= 0 ||
+            (int32_t)((_applied.load() - sequence) << 
+            MAILBOX_SEQUENCE_SHIFT) > 0;
+};
+
+bool PWM_LED::_wait(uint32_t sequence, uint32_t timeoutMs){
+    if (_done(sequence)){
+        return true;
+    }
+    // the task can only notify one waiter, so a second one is refused
+    // rather than left to sleep through the end of its sequence
+    TaskHandle_t none = NULL;
+    if (!_waiter.compare_exchange_strong(none, xTaskGetCurrentTaskHandle())){
+        return false;
+    }
+    uint32_t start = millis();
+    bool done;
+    // the task notifies the waiter whenever a command ends, so check the
+    // sequence again after every wake
+    while (!(done = _done(sequence))){
+        uint32_t elapsed = millis() - start;
+        if (timeoutMs != portMAX_DELAY && elapsed >= timeoutMs){
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, timeoutMs == portMAX_DELAY? portMAX_DELAY :
+                pdMS_TO_TICKS(timeoutMs - elapsed) + 1);
+    }
+    _waiter.store(NULL);
+    return done;
+};
+
+void PWM_LED::wave(const PWM_LED_Waveform & waveform,
+        uint32_t periodMs,
+        uint16_t phase,
+        uint16_t amplitude,
+        uint32_t intervalUs){
+    if (periodMs == 0){
+        off();
+        return;
+    }
+    led_command_t command = {};
+    command.state = LED_WAVE;
+    command.wave.waveform = &waveform;
+    command.wave.periodMs = periodMs;
+    command.wave.intervalUs = std::max(intervalUs, (uint32_t)1);
+    command.wave.amplitude = amplitude;
+    command.phase = phase;
+    _publish(command);
+}
+
+uint16_t PWM_LED::enqueue(const PWM_LED_Pattern & pattern,
+        uint8_t priority,
+        uint16_t repeats,
+        uint32_t durationMs){
+    if (pattern.cycleUs() == 0){
+        return 0;
+    }
+    PWM_LED_Patterns::acquire(&pattern);
+    led_command_t command = {};
+    command.state = LED_FLASHING;
+    command.pattern = &pattern;
+    return _enqueue(command, priority, repeats, durationMs);
+}
+
+uint16_t PWM_LED::enqueue(const PWM_LED_CompactPattern & pattern,
+        uint8_t priority,
+        uint16_t repeats,
+        uint32_t durationMs){
+    if (!pattern.playable()){
+        return 0;
+    }
+    led_command_t command = {};
+    command.state = LED_FLASHING;
+    command.flash.compact = &pattern;
+    return _enqueue(command, priority, repeats, durationMs);
+}
+
+uint16_t PWM_LED::enqueue(PWM_LED_Generator & generator,
+        uint8_t priority,
+        uint16_t repeats,
+        uint32_t durationMs){
+    led_command_t command = {};
+    command.state = LED_FLASHING;
+    command.flash.generator = &generator;
+    return _enqueue(command, priority, repeats, durationMs);
+}
+
+bool PWM_LED::cancel(uint16_t id){
+    if (!_queue.cancel(id)){
+        return false;
+    }
+    _queueChanged.store(true);
+    _notify();
+    return true;
+}
+
+void PWM_LED::clearQueue(){
+    _queue.clear();
+    _queueChanged.store(true);
+    _notify();
+}
+
+uint8_t PWM_LED::queued(){
+    return _queue.size();
 }
 
-void PWM_LED::flash(uint16_t * pattern, uint8_t length){   
-    _flashPatternLength = 0; 
-    if(length>0){    
-        std::copy(pattern, pattern + length, _flashPattern);
-        _flashPatternLength = length;
-        xSemaphoreGive(_flashSemaphore);
-        _ledState = LED_FLASHING;        
+uint16_t PWM_LED::_enqueue(const led_command_t & command,
+        uint8_t priority,
+        uint16_t repeats,
+        uint32_t durationMs){
+    uint16_t id = _queue.add(command, priority, repeats, 
+            (int64_t)durationMs * 1000);
+    if (id != 0){
+        _queueChanged.store(true);
+        _notify();
     }
+    return id;
+}
+
+void PWM_LED::fadeTo(int level, uint16_t durationMs){
+    level = std::max(0, std::min(level, _maxLevel));
+    _publish(LED_FADING, NULL, level, durationMs);
+}
+
+void PWM_LED::refresh(){
+    _refresh.store(true);
+    _notify();
 }
 
+void PWM_LED::_publish(led_state_t state, 
+        const PWM_LED_Pattern * pattern,
+        uint16_t level,
+        uint16_t durationMs,
+        const PWM_LED_CompactPattern * compact,
+        PWM_LED_Generator * generator){
+    led_command_t command = {};
+    command.state = state;
+    command.pattern = pattern;
+    if (state == LED_FADING){
+        command.fade.level = level;
+        command.fade.durationMs = durationMs;
+    } else {
+        command.flash.compact = compact;
+        command.flash.generator = generator;
+    }
+    _publish(command);
+};
+
+uint32_t PWM_LED::_publish(const led_command_t & request){
+    uint32_t back = _backIndex.exchange(PWM_LED_BUFFER_BUSY);
+    if (back == PWM_LED_BUFFER_BUSY){
+        PWM_LED_Patterns::release(request.pattern);
+        if (PWM_LED_callbackOf(request) != NULL){
+            PWM_LED_Dispatcher::post(request.flash.callback, 
+                    request.flash.context, false);
+        }
+        return 0;
+    }
+    led_command_t & command = _commands[back];
+    PWM_LED_Patterns::release(command.pattern);
+    command = request;
+    PWM_LED_METRIC(command.publishedUs = esp_timer_get_time());
+    uint32_t sequence = _published.fetch_add(1) + 1;
+    _requested.store((sequence << MAILBOX_SEQUENCE_SHIFT) | request.state);
+    uint32_t parked = _mailbox.exchange(
+            (sequence << MAILBOX_SEQUENCE_SHIFT) | MAILBOX_FRESH | back);
+    if (parked & MAILBOX_FRESH){
+        // the parked command was superseded before the task received it
+        const led_command_t & dropped = _commands[parked & MAILBOX_INDEX_MASK];
+        if (PWM_LED_callbackOf(dropped) != NULL){
+            PWM_LED_Dispatcher::post(dropped.flash.callback, 
+                    dropped.flash.context, false);
+        }
+    }
+    _backIndex.store(parked & MAILBOX_INDEX_MASK);
+    _notify();
+    // as the task reads it back from the mailbox
+    return (sequence << MAILBOX_SEQUENCE_SHIFT) >> MAILBOX_SEQUENCE_SHIFT;
+};
+
+bool IRAM_ATTR PWM_LED::_publishFromISR(led_state_t state, 
+        const PWM_LED_Pattern * pattern,
+        BaseType_t * woken){
+    PWM_LED_IsrCommand command;
+    command.state = state;
+    command.pattern = pattern;
+    // the same sequence as `_publish()`, so the newest command wins
+    command.sequence = ((_published.fetch_add(1) + 1) << 
+            MAILBOX_SEQUENCE_SHIFT) >> MAILBOX_SEQUENCE_SHIFT;
+    PWM_LED_METRIC(command.publishedUs = esp_timer_get_time());
+    if (!_isrQueue.push(command)){
+        return false;
+    }
+    _requested.store((command.sequence << MAILBOX_SEQUENCE_SHIFT) | state);
+    if (_engine != NULL){
+        _engine->notifyFromISR(woken, this);
+    } else if (_flashTask != NULL){
+        vTaskNotifyGiveFromISR(_flashTask, woken);
+    }
+    return true;
+};
+
+bool PWM_LED::_receive(){
+    bool received = false;
+    uint32_t mailbox = _mailbox.load();
+    while ((mailbox & MAILBOX_FRESH) != 0 && (int32_t)(((mailbox >> 
+            MAILBOX_SEQUENCE_SHIFT) - _applied.load()) << 
+            MAILBOX_SEQUENCE_SHIFT) <= 0){
+        // an ISR command took a later sequence but was applied before this
+        // command was published: leave the stale command parked for a
+        // publisher to reuse, which releases its pattern, unless a newer
+        // one has just replaced it. The buffer is free for publishers once
+        // it is no longer fresh, so its callback is read first.
+        const led_command_t & stale = _commands[mailbox & MAILBOX_INDEX_MASK];
+        PWM_LED_Callback callback = PWM_LED_callbackOf(stale);
+        void * context = stale.flash.context;
+        if (_mailbox.compare_exchange_strong(mailbox, 
+                mailbox & ~MAILBOX_FRESH)){
+            if (callback != NULL){
+                PWM_LED_Dispatcher::post(callback, context, false);
+            }
+            mailbox &= ~MAILBOX_FRESH;
+        }
+    }
+    if ((mailbox & MAILBOX_FRESH) != 0){
+        // the old front buffer is parked for a publisher to reuse; release
+        // its pattern now, so that an LED pins one registry entry at a
+        // time rather than one per buffer
+        led_command_t & front = _commands[_frontIndex];
+        PWM_LED_Patterns::release(front.pattern);
+        front.pattern = NULL;
+        uint32_t parked = _mailbox.exchange(_frontIndex);
+        _frontIndex = parked & MAILBOX_INDEX_MASK;
+        _applied.store(parked >> MAILBOX_SEQUENCE_SHIFT);
+        received = true;
+    }
+    PWM_LED_IsrCommand command;
+    while (_isrQueue.pop(command)){
+        // skip a command that a later `on()`, `off()` or `flash()` has
+        // already superseded
+        if ((int32_t)((command.sequence - _applied.load()) << 
+                MAILBOX_SEQUENCE_SHIFT) > 0){
+            _receiveFromISR(command);
+            received = true;
+        }
+    }
+    return received;
+};
+
+void PWM_LED::_receiveFromISR(const PWM_LED_IsrCommand & command){
+    // the front buffer is the task's own, so it is rewritten in place;
+    // whoever reuses it next releases the pattern, as for any command
+    led_command_t & front = _commands[_frontIndex];
+    PWM_LED_Patterns::release(front.pattern);
+    front = {};
+    front.state = command.state;
+    front.pattern = command.pattern;
+    PWM_LED_Patterns::acquire(front.pattern);
+    PWM_LED_METRIC(front.publishedUs = command.publishedUs);
+    _applied.store(command.sequence);
+};
+
+void PWM_LED::_applyRefresh(){
+    bool refresh = _refresh.load() && _refresh.exchange(false);
+    if (_group != NULL && _group->generation() != _groupGeneration){
+        _groupGeneration = _group->generation();
+        refresh = true;
+    }
+    if (!refresh){
+        return;
+    }
+    if (_ledState == LED_ON){
+        _write(_onLevel());
+    } else if (_ledState == LED_FLASHING && _fading && _fadeTarget != 0){
+        // ramping up to an `on` step: end the ramp at the new level
+        _fadeTarget = _onLevel();
+    } else if (_ledState == LED_FLASHING && !_fading && _level != 0){
+        // in an `on` step: change now rather than at the next edge
+        _write(_onLevel());
+    } else if (!_fading){
+        _write(_level);
+    }
+};
+
+void PWM_LED::_notify(){
+    if (_engine != NULL){
+        _engine->notify(this);
+    } else if (_flashTask != NULL){
+        xTaskNotifyGive(_flashTask);
+    }
+};
+
+bool PWM_LED::_start(int64_t now){
+    const led_command_t & command = _commands[_frontIndex];
+    // the previous base command has been replaced
+    _complete(false);
+    _activeSequence = _applied.load();
+    _doneCallback = PWM_LED_callbackOf(command);
+    _doneContext = command.flash.context;
+    _cycles = 0;
+    _baseEnded = false;
+    if (_entry == NULL){
+        _apply(now, command);
+    }
+    if (command.state == LED_OFF){
+        // nothing to play, e.g. a sequence without a step longer than 0
+        _baseEnded = true;
+        _complete(true);
+    }
+    bool pending = _advance(now);
+    PWM_LED_METRIC(_metrics.command(esp_timer_get_time() - command.publishedUs));
+    PWM_LED_METRIC(_metrics.sampleStack());
+    return pending;
+};
+
+void PWM_LED::_apply(int64_t now, const led_command_t & command){
+    _source = &command;
+    _ledState = command.state;
+    _step = 0;
+    _fading = false;
+    switch (command.state){
+        case LED_FLASHING:
+            // a sync group member starts at the group epoch, part-way
+            // into the cycle by its phase
+            _edgeDeadline = command.epochUs != 0? command.epochUs : now;
+            _skipUs = 0;
+            if (command.pattern != NULL){
+                _skipUs = (int64_t)command.pattern->cycleUs() * 
+                        command.phase >> 16;
+            } else if (command.flash.compact != NULL && command.phase != 0){
+                _skipUs = (int64_t)command.flash.compact->cycleUnits() *
+                        command.flash.compact->unitUs() * command.phase >> 16;
+            }
+            _cursor.restart();
+            _stepOn = true;
+            if (command.flash.generator != NULL){
+                command.flash.generator->restart();
+            }
+            _maxLatenessUs = 0;
+            PWM_LED_METRIC(_metrics.restart());
+            break;
+        case LED_FADING:
+            _startFade(now, command.fade.level, 
+                    (int64_t)command.fade.durationMs * 1000);
+            break;
+        case LED_WAVE:
+            _waveStart = command.epochUs != 0? command.epochUs : now;
+            _edgeDeadline = std::max(_waveStart, now);
+            break;
+        case LED_ON:
+            _write(_onLevel());
+            break;
+        default:
+            _write(0);
+            break;
+    }
+};
+
+bool PWM_LED::_applyQueue(int64_t now){
+    if (!_queueChanged.load() || !_queueChanged.exchange(false)){
+        return false;
+    }
+    PWM_LED_QueueEntry * top = _queue.top();
+    if (top == _entry && (top == NULL || top->order == _entryOrder)){
+        return false;
+    }
+    // a preempted entry stays queued and restarts its cycle when it
+    // plays again
+    _play(now, top);
+    return true;
+};
+
+void PWM_LED::_play(int64_t now, PWM_LED_QueueEntry * entry){
+    _entry = entry;
+    if (entry == NULL && _baseEnded){
+        _source = &_commands[_frontIndex];
+        _end();
+        return;
+    }
+    if (entry == NULL){
+        _apply(now, _commands[_frontIndex]);
+        return;
+    }
+    _entryOrder = entry->order;
+    if (entry->endUs == 0 && entry->durationUs > 0){
+        entry->endUs = now + entry->durationUs;
+    }
+    _apply(now, entry->command);
+};
+
+void PWM_LED::_finish(int64_t now){
+    _queue.remove(_entry);
+    _play(now, _queue.top());
+};
+
+bool PWM_LED::_cycleEnded(){
+    if (_entry == NULL){
+        return _source->repeats != 0 && ++_cycles >= _source->repeats;
+    }
+    _entry->cycles++;
+    return _entry->repeats != 0 && _entry->cycles >= _entry->repeats;
+};
+
+void PWM_LED::_complete(bool completed){
+    if (completed){
+        _finished.store(_activeSequence);
+    }
+    if (_doneCallback != NULL){
+        PWM_LED_Dispatcher::post(_doneCallback, _doneContext, completed);
+        _doneCallback = NULL;
+    }
+    TaskHandle_t waiter = _waiter.load();
+    if (waiter != NULL){
+        xTaskNotifyGive(waiter);
+    }
+};
+
+void PWM_LED::_end(){
+    _ledState = LED_OFF;
+    _fading = false;
+    _write(0);
+};
+
+bool PWM_LED::_advance(int64_t now){
+    if (_entry != NULL && _entry->endUs != 0 && _entry->endUs <= now){
+        _finish(now);
+    }
+    if (_ledState == LED_FLASHING && _edgeDeadline <= now){
+        _playEdge(now);
+    } else if (_ledState == LED_WAVE && _edgeDeadline <= now){
+        _updateWave(now);
+    }
+    if (_fading && _fadeDeadline <= now){
+        _updateFade(now);
+    }
+    if (_ledState == LED_FADING && !_fading){
+        _ledState = _level > 0? LED_ON : LED_OFF;
+    }
+    _deadline = _ledState == LED_FLASHING || _ledState == LED_WAVE? 
+            _edgeDeadline : INT64_MAX;
+    if (_fading && _fadeDeadline < _deadline){
+        _deadline = _fadeDeadline;
+    }
+    if (_entry != NULL && _entry->endUs != 0 && _entry->endUs < _deadline){
+        _deadline = _entry->endUs;
+    }
+    return _deadline != INT64_MAX;
+};
+
+void PWM_LED::_playEdge(int64_t now){
+    int64_t durationUs;
+    bool on;
+    int64_t rampUs;
+    int64_t resyncUs;
+    if (!_nextStep(durationUs, on, rampUs, resyncUs)){
+        if (_entry != NULL){
+            // the entry has played its repeats; the next entry or the
+            // base command starts from now
+            _finish(now);
+            return;
+        }
+        // the generated sequence has ended, or the base command has
+        // played its repeats
+        _baseEnded = true;
+        _end();
+        _complete(true);
+        return;
+    }
+    while (_skipUs > 0){
+        // fast-forward a sync group member to its phase
+        if (_skipUs < durationUs){
+            durationUs -= _skipUs;
+            rampUs = 0;
+            _skipUs = 0;
+        } else {
+            _skipUs -= durationUs;
+            _nextStep(durationUs, on, rampUs, resyncUs);
+        }
+    }
+    int64_t lateness = now - _edgeDeadline;
+    if (lateness >= durationUs && durationUs > 0 && _source->epochUs != 0){
+        // a sync group member that has missed this step, or rejoins the
+        // group from its queue, steps straight to the step that plays now
+        // rather than catching up edge by edge, so that it stays in phase
+        // without a burst of writes
+        if (_source->pattern != NULL){
+            // whole cycles are skipped at once; a compact pattern has no
+            // cycle length at hand, so it steps through them
+            _edgeDeadline += lateness / resyncUs * resyncUs;
+        }
+        while (now - _edgeDeadline >= durationUs){
+            _edgeDeadline += durationUs;
+            if (!_nextStep(durationUs, on, rampUs, resyncUs)){
+                break;
+            }
+        }
+        rampUs = 0;
+        lateness = now - _edgeDeadline;
+        PWM_LED_METRIC(_metrics.resync());
+    } else if (lateness > resyncUs && durationUs > 0){
+        // too late to catch up, so start the cycle again from now; a step
+        // of no length leaves its lateness to the step after it
+        _edgeDeadline = now;
+        PWM_LED_METRIC(_metrics.resync());
+    }
+    PWM_LED_METRIC(_metrics.edge(lateness));
+    _latenessUs = lateness;
+    if (lateness > _maxLatenessUs){
+        _maxLatenessUs = lateness;
+    }
+    if (durationUs > 0){
+        // a step of no length is not shown, so that it joins its
+        // neighbours without a glitch
+        _startFade(now, on? _onLevel() : 0, std::min(durationUs, rampUs));
+    }
+    _edgeDeadline += durationUs;
+};
+
+bool PWM_LED::_nextStep(int64_t & durationUs, 
+        bool & on, 
+        int64_t & rampUs, 
+        int64_t & resyncUs){
+    const led_command_t & command = *_source;
+    rampUs = 0;
+    if (command.flash.generator != NULL){
+        durationUs = command.flash.generator->nextUs();
+        if (durationUs == 0 && (_entry != NULL || command.repeats != 0) && 
+                !_cycleEnded()){
+            // play the next cycle of the generator
+            command.flash.generator->restart();
+            _stepOn = true;
+            durationUs = command.flash.generator->nextUs();
+        }
+        on = _stepOn;
+        _stepOn = !_stepOn;
+        resyncUs = durationUs;
+        return durationUs != 0;
+    }
+    if (command.flash.compact != NULL){
+        bool wrapped;
+        uint8_t units = _cursor.next(*command.flash.compact, wrapped);
+        if (wrapped){
+            if (_cycleEnded()){
+                return false;
+            }
+            _stepOn = true;
+        }
+        durationUs = (int64_t)units * command.flash.compact->unitUs();
+        on = _stepOn;
+        _stepOn = !_stepOn;
+        resyncUs = durationUs;
+        return true;
+    }
+    const PWM_LED_Pattern & pattern = *command.pattern;
+    if (_step >= pattern.length()){
+        _step = 0;
+        if (_cycleEnded()){
+            return false;
+        }
+    }
+    durationUs = (int64_t)pattern.steps()[_step] * pattern.unitUs();
+    on = _step % 2 == 0;
+    rampUs = on? pattern.rampOnUs() : pattern.rampOffUs();
+    resyncUs = pattern.cycleUs();
+    _step++;
+    return true;
+};
+
+void PWM_LED::_updateWave(int64_t now){
+    const led_wave_t & wave = _source->wave;
+    // the position in the period as a 16-bit fraction, from the start
+    // time so that late updates do not shift the waveform; 64 bits, since
+    // a period in milliseconds overflows 32 bits of microseconds
+    int64_t periodUs = (int64_t)wave.periodMs * 1000;
+    uint16_t position = (uint16_t)(((now - _waveStart) % periodUs) *
+            65536 / periodUs) + _source->phase;
+    uint32_t envelope = (uint32_t)wave.waveform->sample(position) * 
+            wave.amplitude / 0xFFFF;
+    int level = (int)(((int64_t)_onLevel() * envelope + 0x7FFF) / 0xFFFF);
+    if (level != _level){
+        _write(level);
+    }
+    _edgeDeadline += wave.intervalUs;
+    if (_edgeDeadline <= now){
+        // skip the updates that were missed
+        _edgeDeadline = now + wave.intervalUs;
+    }
+};
+
+void PWM_LED::_startFade(int64_t now, int level, int64_t durationUs){
+    _fading = false;
+    if (durationUs <= 0 || level == _level){
+        _write(level);
+        return;
+    }
+    _fadeFrom = _level;
+    _fadeTarget = level;
+    _fadeStart = now;
+    _fadeDurationUs = durationUs;
+    _fading = true;
+    if (!_framed.load() && _fadeHardware(_fadeFrom, level, durationUs)){
+        // the hardware ramps the duty, so only wake to write the target;
+        // the written duty is only exact again at the end of the fade
+        _level = level;
+        _fadeIntervalUs = durationUs;
+    } else {
+        // never update faster than the duty can change by one step
+        _fadeIntervalUs = std::max((int64_t)PWM_LED_FADE_INTERVAL_US, 
+                durationUs / std::abs(level - _fadeFrom));
+    }
+    _fadeDeadline = std::min(now + _fadeIntervalUs, now + durationUs);
+};
+
+void PWM_LED::_updateFade(int64_t now){
+    int64_t elapsed = now - _fadeStart;
+    if (elapsed >= _fadeDurationUs){
+        _fading = false;
+        _write(_fadeTarget);
+        return;
+    }
+    int level = _fadeFrom + (int)((int64_t)(_fadeTarget - _fadeFrom) 
+            * elapsed / _fadeDurationUs);
+    if (level != _level){
+        _write(level);
+    }
+    _fadeDeadline = std::min(_fadeDeadline + _fadeIntervalUs, 
+            _fadeStart + _fadeDurationUs);
+};
+
+bool PWM_LED::_fadeHardware(int from, int to, int64_t durationUs){
+    return _backend.fade(_PwmChannel, _dutyCycle(_corrected(from)), 
+            _dutyCycle(_corrected(to)), durationUs);
+};
+
+int PWM_LED::_corrected(int level){
+    return _gamma.load()? 
+            PWM_LED_Gamma<PWM_LED_PWM_RESOLUTION>::duty(level) : level;
+};
+
+void PWM_LED::_write(int level){
+    _level = level;
+    if (!_framed.load(std::memory_order_relaxed)){
+        _output(level);
+    }
+};
+
+void PWM_LED::_output(int level){
+    _backend.write(_PwmChannel, _dutyCycle(_corrected(level)));
+};
+
 void PWM_LED::_flash(void){
-    #ifdef PWM_LED_DEBUG
-    UBaseType_t uxHighWaterMark;
-    #endif // PWM_LED_DEBUG    
-    ledcWrite(_PwmChannel,_dutyCycle(0));
-    uint8_t len;
-    uint8_t i;   
-    uint32_t timer = millis();
+    _write(0);
+    bool pending = false;
     for (;;){   
-        #ifdef PWM_LED_DEBUG
-        /* Inspect our own high water mark on entering the task. */
-        uxHighWaterMark = uxTaskGetStackHighWaterMark( NULL );
-        Serial.printf("The highwatermark is at 0X%X\n", uxHighWaterMark);
-        #endif // PWM_LED_DEBUG    
-        if (xSemaphoreTake(_flashSemaphore, portMAX_DELAY)){
-            while(_flashPatternLength > 0){  
-                i = 0;
-                len = _flashPatternLength;              
-                timer = millis();
-                while (i < len && _flashPatternLength > 0){
-                    ledcWrite(_PwmChannel,
-                            i % 2 == 0? _dutyCycle(_brightness) :  _dutyCycle(0)); 
-                    while (millis()-timer < _flashPattern[i]  && _flashPatternLength > 0){                                                            
-                        vTaskDelay(1/portTICK_PERIOD_MS);
-                    }
-                    timer = millis();
-                    i++;
-                    #ifdef PWM_LED_DEBUG
-                    /* Calling the function will have used some stack space, we would 
-                    therefore now expect uxTaskGetStackHighWaterMark() to return a 
-                    value lower than when it was called on entering the task. */
-                    uxHighWaterMark = uxTaskGetStackHighWaterMark( NULL );
-                    // Serial.printf("The highwatermark is at 0X%X\n", uxHighWaterMark);
-                    #endif // PWM_LED_DEBUG    
-                }
-            }            
-            ledcWrite(_PwmChannel,_dutyCycle(0));                
-            _ledState = LED_OFF;
-            i = 0;
-        }
-        vTaskDelay(1/portTICK_PERIOD_MS);
+        int64_t now = esp_timer_get_time();
+        PWM_LED_METRIC(_metrics.wakeup());
+        if (_receive()){
+            pending = _start(now);
+        }
+        if (_applyQueue(now)){
+            pending = _advance(now);
+        }
+        _applyRefresh();
+        while (pending && _deadline <= now){
+            pending = _advance(now);
+        }
+        // sleep until the next edge is due or a command arrives
+        if (pending){
+            _timer.waitUntil(_deadline);
+        } else {
+            _timer.wait();
+        }
     }
 };
 
@@ -22,7 +22,13 @@
 *
 * The PWM output is managed by a FreeRTOS task with a fairly low priority 
 * (task priority 10), which means the flashing of the LED runs asynchronously 
-* (non-blocking).
+* (non-blocking). The task blocks on a task notification until the next 
+* edge of the pattern is due or a new command arrives, so an LED that is 
+* steady on or off does not wake the task at all.
+*
+* Each PWM_LED creates its own task unless it is started with 
+* `begin(engine)`, in which case a shared PWM_LED_Engine task drives 
+* all of its registered LEDs.
 * 
 * @section author Author
 * 
@@ -39,17 +45,39 @@
 #ifndef __PWM_LED_H__
 #define __PWM_LED_H__
 
-/// Uncomment to see debugging out put on [Serial].
-#define PWM_LED_DEBUG
-
-#include <Arduino.h>
+#include "PWM_LED_HAL.h"
 #include <iostream>
 #include <algorithm>
-
-#define PWM_LED_PWM_RESOLUTION 8     
-#define PWM_LED_PWM_FREQ 100     
-
-const uint16_t PWM_LED_PWM_MAX_DUTY_CYCLE = pow(2, PWM_LED_PWM_RESOLUTION) - 1;
+#include <atomic>
+#include "PWM_LED_Engine.h"
+#include "PWM_LED_Pattern.h"
+#include "PWM_LED_Generator.h"
+#include "PWM_LED_Metrics.h"
+#include "PWM_LED_Output.h"
+#include "PWM_LED_Queue.h"
+#include "PWM_LED_IsrQueue.h"
+#include "PWM_LED_BrightnessGroup.h"
+#include "PWM_LED_Color.h"
+
+/// The duty resolution in bits and the PWM frequency of PWM_LED, which
+/// all runtime LEDs share. PWM_LED_Fixed sets them per LED instead. 
+/// Define before including this header to change them.
+#ifndef PWM_LED_PWM_RESOLUTION
+#define PWM_LED_PWM_RESOLUTION 8
+#endif // PWM_LED_PWM_RESOLUTION
+
+#ifndef PWM_LED_PWM_FREQ
+#define PWM_LED_PWM_FREQ 100
+#endif // PWM_LED_PWM_FREQ
+
+/// The shortest interval between two duty updates of a software fade, in
+/// microseconds. Bounds the CPU cost of a fade. Define before including
+/// this header to change it.
+#ifndef PWM_LED_FADE_INTERVAL_US
+#define PWM_LED_FADE_INTERVAL_US 20000
+#endif // PWM_LED_FADE_INTERVAL_US
+
+constexpr uint16_t PWM_LED_PWM_MAX_DUTY_CYCLE = (1 << PWM_LED_PWM_RESOLUTION) - 1;
 
 /// @brief Enumeration of LED color as combinations of red, green and blue
 /// expressed as 16-bit color values.
@@ -62,20 +90,6 @@ typedef enum LED_Color{
     COLOR_CYAN = 0x0ff,
 } PWM_LED_color_t;
 
-/// @brief Enumeration of LED state.
-typedef enum LED_State{
-
-    /// @brief The LED is ON.
-    LED_OFF = 0x00,
-
-    /// @brief The LED is OFF.
-    LED_ON = 0X01,
-
-    /// @brief The LED is FLASHING.
-    LED_FLASHING = 0x10,
-
-}led_state_t;
-
 /// @brief Defines the properties of a status LED and exposes 
 /// methods to turn the LED on or off.
 class PWM_LED{
@@ -87,12 +101,56 @@ class PWM_LED{
              int & brightness, 
              int onState = LOW);
 
-    /// @brief Initializes the LED and then turns it OFF.
-    /// @param brightness The brightness of the LED when it is turned on. 
-    /// Defaults to 0xFF (100%).
+    /// @brief Constructs an LED that is driven through [output] instead
+    /// of an LEDC channel, e.g. a PWM_LED_BAM engine.
+    /// @param output The output backend.
+    /// @param pin The GPIO pin, if the backend drives pins directly.
+    /// @param channel The channel of the LED in the backend.
+    /// @param brightness The brightness of the LED when it is on.
+    /// @param onState The state of the pin when the LED is on.
+    PWM_LED(PWM_LED_Output & output,
+             uint8_t pin,
+             uint8_t channel,
+             int & brightness, 
+             int onState = LOW);
+
+    /// @brief Constructs an LED whose brightness is the level of [group].
+    /// @param pin The GPIO pin.
+    /// @param PwmChannel The LEDC channel.
+    /// @param group The brightness group, which must outlive the LED.
+    /// @param onState The state of the pin when the LED is on.
+    PWM_LED(uint8_t pin,
+             uint8_t PwmChannel,
+             PWM_LED_BrightnessGroup & group, 
+             int onState = LOW);
+
+    /// @brief Constructs an LED that is driven through [output] and whose
+    /// brightness is the level of [group].
+    PWM_LED(PWM_LED_Output & output,
+             uint8_t pin,
+             uint8_t channel,
+             PWM_LED_BrightnessGroup & group, 
+             int onState = LOW);
+
+    /// @brief Initializes the LED and then turns it OFF. The task of the
+    /// LED is taken from the static pool if PWM_LED_TASK_POOL_SIZE is set
+    /// and a block is free, and is allocated on the heap otherwise.
     /// @return true if initialization completed without errors.
     bool begin();
 
+    /// @brief Initializes the LED and creates its task in [storage] 
+    /// instead of on the heap, and then turns it OFF.
+    /// @param storage The stack and control block of the task.
+    /// @return true if initialization completed without errors.
+    bool begin(PWM_LED_TaskStorage & storage);
+
+    /// @brief Initializes the LED, registers it with [engine] and then 
+    /// turns it OFF. No task is created for the LED; the engine task
+    /// drives the flashing pattern instead.
+    /// @param engine The shared engine that drives the LED.
+    /// @return true if initialization completed without errors.
+    bool begin(PWM_LED_Engine & engine);
+
     /// @brief Writes _onState to the GPIO pin and cancels any 
     /// flashing if previously enabled.
     ///
@@ -105,6 +163,34 @@ class PWM_LED{
     /// flashing if previously enabled.
     void off();
 
+    /// @brief `on()` for interrupt handlers. Pushes the command into a 
+    /// lock-free ring and wakes the task driving the LED; takes no lock,
+    /// allocates nothing and never blocks.
+    /// @param woken Set to pdTRUE if the woken task should run before the
+    /// interrupted one; pass it on to `portYIELD_FROM_ISR()`. May be NULL.
+    /// @return false if the ring is full and the command was dropped. The
+    /// ring is always full if PWM_LED_ISR_QUEUE_SIZE is defined as 0.
+    bool onFromISR(BaseType_t * woken = NULL);
+
+    /// @brief `off()` for interrupt handlers. See `onFromISR()`.
+    bool offFromISR(BaseType_t * woken = NULL);
+
+    /// @brief `flash(pattern)` for interrupt handlers. See `onFromISR()`.
+    /// @param pattern The pattern, which must be constant and outlive the
+    /// flashing, e.g. a `constexpr` pattern. The ISR takes no registry
+    /// reference, so a registry handle is only safe while the caller holds
+    /// its own reference.
+    bool flashFromISR(const PWM_LED_Pattern & pattern, 
+            BaseType_t * woken = NULL);
+
+    /// @brief Deleted: the LED would keep a pointer to the temporary.
+    bool flashFromISR(const PWM_LED_Pattern && pattern, 
+            BaseType_t * woken = NULL) = delete;
+
+    /// @brief The number of commands from ISRs dropped because the ring
+    /// was full.
+    uint32_t droppedFromISR();
+
     /// @brief Flashes the LED at a periodic interval of [periodMS] for a duration
     /// of [durationMs]. If [durationMs] is 0 it will be set to  `periodMs / 2`.
     /// If [durationMs] is greater than or equal to [periodMs] then the LED will 
@@ -114,67 +200,700 @@ class PWM_LED{
     /// brightness level will be used.
     ///
     /// To stop the flashing of the LED call `off()`.
+    ///
+    /// Each edge is scheduled at the pattern start time plus the sum of
+    /// the preceding steps, so late edges do not accumulate drift.
     /// @param pattern The cycle period for the flashing of the LED in milliseconds.
     /// @param length the length of the [pattern] array.
-    /// @param brightness The brightness of the LED when it is on. 
-    void flash(uint16_t * pattern, uint8_t length);
+    /// @param unitUs The time unit of the [pattern] elements in microseconds.
+    /// Defaults to PWM_LED_UNIT_MS.
+    ///
+    /// The copy may allocate the steps on the heap; see
+    /// `PWM_LED_Patterns::intern()`.
+    /// @return false if the pattern registry is full; the LED is left
+    /// unchanged.
+    bool flash(uint16_t * pattern, uint8_t length, 
+            uint16_t unitUs = PWM_LED_UNIT_MS);
+
+    /// @brief Flashes the LED with an immutable [pattern] without copying
+    /// it. The LED keeps only a pointer to the pattern, so it must outlive
+    /// the flashing (a `constexpr` pattern or a registry handle).
+    ///
+    /// To stop the flashing of the LED call `off()`.
+    /// @param pattern The pattern to play.
+    void flash(const PWM_LED_Pattern & pattern);
 
-    /// @brief The current state of the LED.
+    /// @brief Deleted: the LED would keep a pointer to the temporary.
+    void flash(const PWM_LED_Pattern && pattern) = delete;
+
+    /// @brief Flashes the LED with a compactly encoded sequence without
+    /// copying it. The LED keeps a pointer to [pattern] and a cursor, so
+    /// the sequence plays in constant RAM whatever its length.
+    ///
+    /// To stop the flashing of the LED call `off()`.
+    /// @param pattern The sequence to play, which must outlive the
+    /// flashing. Sequences without a step longer than 0 turn the LED off.
+    void flash(const PWM_LED_CompactPattern & pattern);
+
+    /// @brief Deleted: the LED would keep a pointer to the temporary.
+    void flash(const PWM_LED_CompactPattern && pattern) = delete;
+
+    /// @brief Flashes the LED with steps pulled from [generator] by the
+    /// task driving the LED, one step at a time. The generator is 
+    /// restarted first. When it returns 0 the LED turns off.
+    ///
+    /// To stop the flashing of the LED call `off()`.
+    /// @param generator The generator, which must outlive the flashing 
+    /// and must not be shared with another LED.
+    void flash(PWM_LED_Generator & generator);
+
+    /// @brief Flashes the LED with [pattern] for [repeats] cycles and then
+    /// turns it off. See `flash(pattern)`.
+    ///
+    /// The returned handle tells when the sequence is done: a task can
+    /// block on it with `wait()`, or [callback] is called by the 
+    /// PWM_LED_Dispatcher task, never by the task driving the LED, with 
+    /// true once the repeats have played, or false if another command 
+    /// replaced the sequence first.
+    /// @param pattern The pattern to play.
+    /// @param repeats The number of cycles, or 0 for no limit.
+    /// @param callback Called when the sequence is done, or NULL.
+    /// @param context Passed to [callback].
+    /// @return The handle of the sequence.
+    PWM_LED_Handle flash(const PWM_LED_Pattern & pattern,
+            uint16_t repeats,
+            PWM_LED_Callback callback = NULL,
+            void * context = NULL);
+
+    /// @brief Deleted: the LED would keep a pointer to the temporary.
+    PWM_LED_Handle flash(const PWM_LED_Pattern && pattern,
+            uint16_t repeats,
+            PWM_LED_Callback callback = NULL,
+            void * context = NULL) = delete;
+
+    /// @brief Flashes the LED with a compact sequence for [repeats] 
+    /// cycles. See `flash(pattern, repeats, ...)`.
+    PWM_LED_Handle flash(const PWM_LED_CompactPattern & pattern,
+            uint16_t repeats,
+            PWM_LED_Callback callback = NULL,
+            void * context = NULL);
+
+    /// @brief Deleted: the LED would keep a pointer to the temporary.
+    PWM_LED_Handle flash(const PWM_LED_CompactPattern && pattern,
+            uint16_t repeats,
+            PWM_LED_Callback callback = NULL,
+            void * context = NULL) = delete;
+
+    /// @brief Flashes the LED with a generated sequence for [repeats] 
+    /// cycles; a cycle ends when the generator returns 0. With [repeats]
+    /// 0 the sequence is done when the generator first returns 0. See
+    /// `flash(pattern, repeats, ...)`.
+    PWM_LED_Handle flash(PWM_LED_Generator & generator,
+            uint16_t repeats,
+            PWM_LED_Callback callback = NULL,
+            void * context = NULL);
+
+    /// @brief Flashes the LED with a copy of [pattern] for [repeats] 
+    /// cycles. See `flash(pattern, length, unitUs)` and 
+    /// `flash(pattern, repeats, ...)`. If the pattern registry is full the
+    /// LED is left unchanged, [callback] is called with false and the 
+    /// handle is empty, so it is done at once.
+    PWM_LED_Handle flash(uint16_t * pattern, 
+            uint8_t length, 
+            uint16_t unitUs,
+            uint16_t repeats,
+            PWM_LED_Callback callback = NULL,
+            void * context = NULL);
+
+    /// @brief Plays [waveform] as a periodic brightness envelope, scaled
+    /// by the brightness of the LED, until the next command.
+    ///
+    /// The task driving the LED wakes every [intervalUs] and writes the
+    /// envelope at the current time, interpolated between the samples of
+    /// the table, so the CPU cost is fixed by the update rate. Updates are
+    /// scheduled at absolute times, so the period does not drift.
+    /// @param waveform The envelope, which must outlive the playback, e.g.
+    /// `PWM_LED_Waveform::breathing()`.
+    /// @param periodMs The period in milliseconds.
+    /// @param phase The position in the period to start at, in 1/65536ths
+    /// of the period.
+    /// @param amplitude The peak brightness as a fraction of the 
+    /// brightness of the LED, in 1/65535ths.
+    /// @param intervalUs The interval between updates in microseconds.
+    void wave(const PWM_LED_Waveform & waveform,
+            uint32_t periodMs,
+            uint16_t phase = 0,
+            uint16_t amplitude = 0xFFFF,
+            uint32_t intervalUs = PWM_LED_WAVE_INTERVAL_US);
+
+    /// @brief Deleted: the LED would keep a pointer to the temporary.
+    void wave(const PWM_LED_Waveform && waveform,
+            uint32_t periodMs,
+            uint16_t phase = 0,
+            uint16_t amplitude = 0xFFFF,
+            uint32_t intervalUs = PWM_LED_WAVE_INTERVAL_US) = delete;
+
+    /// @brief Queues [pattern] to play on top of the base state set by
+    /// `on()`, `off()` or `flash()`. The highest priority entry plays; the
+    /// LED returns to its base state when the queue is empty.
+    /// @param pattern The pattern, which must outlive the entry.
+    /// @param priority The priority; higher values preempt lower ones, and
+    /// the newest entry wins among equal priorities.
+    /// @param repeats The number of cycles to play, or 0 for no limit.
+    /// @param durationMs How long to play after the entry first starts, or
+    /// 0 for no limit.
+    /// @return The id of the entry for `cancel()`, or 0 if the queue is 
+    /// full or the pattern has no step longer than 0. The queue is opt-in:
+    /// it is always full unless PWM_LED_QUEUE_SIZE is defined above 0.
+    uint16_t enqueue(const PWM_LED_Pattern & pattern,
+            uint8_t priority,
+            uint16_t repeats = 0,
+            uint32_t durationMs = 0);
+
+    /// @brief Deleted: the queue would keep a pointer to the temporary.
+    uint16_t enqueue(const PWM_LED_Pattern && pattern,
+            uint8_t priority,
+            uint16_t repeats = 0,
+            uint32_t durationMs = 0) = delete;
+
+    /// @brief Queues a compact sequence. See `enqueue(pattern, ...)`.
+    uint16_t enqueue(const PWM_LED_CompactPattern & pattern,
+            uint8_t priority,
+            uint16_t repeats = 0,
+            uint32_t durationMs = 0);
+
+    /// @brief Deleted: the queue would keep a pointer to the temporary.
+    uint16_t enqueue(const PWM_LED_CompactPattern && pattern,
+            uint8_t priority,
+            uint16_t repeats = 0,
+            uint32_t durationMs = 0) = delete;
+
+    /// @brief Queues a generated sequence. A cycle ends when the generator
+    /// returns 0; it is restarted for the next cycle. See 
+    /// `enqueue(pattern, ...)`.
+    /// @param generator The generator, which must not be shared with
+    /// another LED or entry.
+    uint16_t enqueue(PWM_LED_Generator & generator,
+            uint8_t priority,
+            uint16_t repeats = 0,
+            uint32_t durationMs = 0);
+
+    /// @brief Removes the queued entry [id], whether it is playing or 
+    /// waiting.
+    /// @return false if the entry has already ended.
+    bool cancel(uint16_t id);
+
+    /// @brief Removes every queued entry; the LED returns to its base 
+    /// state.
+    void clearQueue();
+
+    /// @brief The number of queued entries, including the playing one.
+    uint8_t queued();
+
+    /// @brief Fades the LED from its current brightness to [level] over
+    /// [durationMs] and then leaves it on at [level] (or off if [level]
+    /// is 0), cancelling any flashing.
+    ///
+    /// On the ESP32 the LEDC hardware fade engine ramps the duty cycle and
+    /// the task only wakes at the end of the fade. Otherwise the duty is
+    /// interpolated in software, at most once every 
+    /// PWM_LED_FADE_INTERVAL_US.
+    /// @param level The target brightness.
+    /// @param durationMs The duration of the fade in milliseconds.
+    void fadeTo(int level, uint16_t durationMs);
+
+    /// @brief Re-applies the current brightness to an LED that is on, or
+    /// in the `on` step of a flashing pattern.
+    ///
+    /// An LED that is on is not revisited by its task, so call this after
+    /// changing the brightness value. A flashing LED also picks up the new
+    /// brightness at its next `on` edge without a refresh. LEDs in a
+    /// PWM_LED_BrightnessGroup are refreshed by `set()`.
+    void refresh();
+
+    /// @brief Turns the perceptual brightness correction on or off. When
+    /// on, brightness and fade levels are mapped through 
+    /// PWM_LED_Gamma, so that equal steps of the brightness look equally
+    /// large. Off by default, which writes the brightness as the duty.
+    /// @param enabled true to correct the brightness.
+    void setGamma(bool enabled);
+
+    /// @brief Allows the engine driving the LED to play its edges and 
+    /// updates up to [slackUs] late, so that they share a wakeup with the
+    /// edges of other LEDs. Has no effect on an LED with its own task.
+    /// @param slackUs The slack in microseconds; 0 plays every edge on 
+    /// time.
+    void setSlack(uint32_t slackUs);
+
+    /// @brief The timer slack in microseconds. Defaults to 
+    /// PWM_LED_TIMER_SLACK_US.
+    uint32_t slack();
+
+    /// @brief The current state of the LED. Until the task driving the LED
+    /// has received the newest command, this is the state that command
+    /// requested, so `state()` follows `on()`, `off()` and `flash()` at
+    /// once.
     /// @return Returns the current LED state.
     LED_State state();
 
+    /// @brief The brightness that drives the LED fully on: 
+    /// PWM_LED_PWM_MAX_DUTY_CYCLE, or 2^Resolution - 1 for a 
+    /// PWM_LED_Fixed. Brightness values and fade levels are clamped to it.
+    int maxLevel();
+
+    /// @brief The sequence number of the last command applied by the task
+    /// driving the LED. Every call to `on()`, `off()` or `flash()` that 
+    /// is not superseded by a concurrent call gets the next number.
+    /// @return The applied sequence number.
+    uint32_t sequence();
+
+    /// @brief The number of times the task driving the LED has woken up.
+    /// If the LED is driven by an engine, this is the engine's count.
+    /// @return The total wakeup count.
+    uint32_t wakeups();
+
+    /// @brief The wakeup rate of the task driving the LED since the 
+    /// previous call.
+    /// @return Wakeups per second.
+    uint32_t wakeupsPerSecond();
+
+    /// @brief How late the most recent edge of the flashing pattern was
+    /// written, relative to its scheduled time.
+    /// @return The lateness in microseconds.
+    int32_t latenessUs();
+
+    /// @brief The largest edge lateness since the pattern was started
+    /// with `flash()`.
+    /// @return The lateness in microseconds.
+    int32_t maxLatenessUs();
+
+    /// @brief Drains the samples recorded by the task driving the LED and
+    /// returns the aggregated metrics. Never prints and never blocks the
+    /// task. Requires `PWM_LED_METRICS`; otherwise all values are 0.
+    /// @return The metrics since the last `resetMetrics()`.
+    PWM_LED_metrics_t metrics();
+
+    /// @brief Zeroes the metrics returned by `metrics()`.
+    void resetMetrics();
+
     protected:
 
+    /// @brief Called by the public constructors; exactly one of 
+    /// [brightness] and [group] is set.
+    PWM_LED(PWM_LED_Output & output,
+             uint8_t pin,
+             uint8_t channel,
+             int * brightness,
+             PWM_LED_BrightnessGroup * group,
+             int onState);
+
     /// @brief Task handle for LED flashing task.
     TaskHandle_t _flashTask = NULL;
 
-    /// @brief Semaphore handle for starting flasher
-    SemaphoreHandle_t _flashSemaphore = NULL;
-
     /// @brief The LED flashing task.
     /// @param  void.
     void _flash(void);
 
-    private:
+    /// @brief The backend that produces the PWM signal.
+    PWM_LED_Output & _backend;
 
-    /// @brief Private variable holding the on PWM duty cycle of the
-    /// LED PWM channel.
-    int & _brightness;
-    
-    /// @brief The static delegate of [_readSensor]
-    /// @param _this NULL
-    static void _flashTaskStatic(void* _this);
+    /// @brief Attaches the channels of the LED to the backend. Called by
+    /// every `begin()`.
+    /// @return true if the channels were set up.
+    virtual bool _attach();
 
-    /// @brief Private function to create the FreeRTOS semaphore 
-    /// and task.
-    /// @return true if initialization completed without errors.
-    bool _createTask();
+    /// @brief Writes [level] to the PWM channel.
+    /// @param level The brightness.
+    virtual void _output(int level);
 
-    /// @brief The period of the LED flashing cycle.
-    uint16_t _flashPattern[255];
+    /// @brief Asks the backend to ramp the duty cycle from brightness 
+    /// [from] to [to] over [durationUs].
+    /// @return false if hardware fading is not available.
+    virtual bool _fadeHardware(int from, int to, int64_t durationUs);
 
-    /// @brief The duration of each flash.
-    uint8_t _flashPatternLength = 0;
-    
     /// @brief The GPIO pin that the LED is attached to.
     uint8_t _GPIO;
 
     uint8_t _PwmChannel;
 
-    /// @brief The state of the GPIO pin when the LED is on. If the pin is 
-    /// attached to the LED cathode then this is LOW (the default).
-    int _onState; 
+    /// @brief The brightness that drives the LED fully on.
+    int _maxLevel = PWM_LED_PWM_MAX_DUTY_CYCLE;
 
-    /// @brief The current state of the LED
-    led_state_t _ledState = LED_OFF;
+    /// @brief Whether brightness levels are mapped through PWM_LED_Gamma.
+    std::atomic<bool> _gamma{false};
+
+    /// @brief The duty-cycle brightness of [level]: [level] itself, or its
+    /// perceptual correction.
+    int _corrected(int level);
 
     /// @brief Calculates the dutycycle to be used for the LED PWM channel, with
     /// consideration of the [brightness] and [onState] values.
     /// @return A dutycycle as 8-bit unsigned integer.
     int _dutyCycle(int brightness);
 
-    /// @brief The pattern to use if the LED is on.
-    uint16_t _onPattern[2] = {250, 0};
+    private:
+
+    friend class PWM_LED_Engine;
+
+    friend class PWM_LED_BrightnessGroup;
+
+    friend class PWM_LED_Handle;
+
+    friend class PWM_LED_SyncGroup;
+
+    friend class PWM_LED_Stream;
+
+    friend class PWM_LED_FrameEngine;
+
+    /// @brief The engine driving the LED, or NULL if the LED has its 
+    /// own task.
+    PWM_LED_Engine * _engine = NULL;
+
+    /// @brief The index of the next pattern step.
+    uint8_t _step = 0;
+
+    /// @brief The position in a compact sequence.
+    PWM_LED_CompactCursor _cursor = {};
+
+    /// @brief Whether the next step of a compact or generated sequence is
+    /// an `on` step.
+    bool _stepOn = true;
+
+    /// @brief The `esp_timer_get_time()` time in microseconds at which 
+    /// the task next has to service the LED: the next edge or fade update.
+    int64_t _deadline = 0;
+
+    /// @brief The time at which the next step of the pattern is played,
+    /// or the waveform is next updated.
+    int64_t _edgeDeadline = 0;
+
+    /// @brief The time at which the waveform started.
+    int64_t _waveStart = 0;
+
+    /// @brief How far into its first cycle a sync group member starts
+    /// the pattern, in microseconds.
+    int64_t _skipUs = 0;
+
+    /// @brief The brightness currently written to the PWM channel.
+    int _level = 0;
+
+    /// @brief true while a fade is in progress.
+    bool _fading = false;
+
+    /// @brief The brightness at the start of the fade.
+    int _fadeFrom = 0;
+
+    /// @brief The brightness at the end of the fade.
+    int _fadeTarget = 0;
+
+    /// @brief The start time of the fade.
+    int64_t _fadeStart = 0;
+
+    /// @brief The duration of the fade in microseconds.
+    int64_t _fadeDurationUs = 0;
+
+    /// @brief The interval between fade updates in microseconds.
+    int64_t _fadeIntervalUs = 0;
+
+    /// @brief The time of the next fade update.
+    int64_t _fadeDeadline = 0;
+
+    /// @brief The lateness of the most recent edge in microseconds.
+    volatile int32_t _latenessUs = 0;
+
+    /// @brief The largest edge lateness since the pattern started.
+    volatile int32_t _maxLatenessUs = 0;
+
+    #ifdef PWM_LED_METRICS
+    /// @brief The instrumentation of the task driving the LED.
+    PWM_LED_Metrics _metrics;
+    #endif // PWM_LED_METRICS
+
+    /// @brief The position of the LED in the engine heap.
+    uint8_t _heapIndex = PWM_LED_NOT_QUEUED;
+
+    /// @brief The position of the LED in the engine's LEDs and pending
+    /// mask.
+    uint8_t _engineIndex = 0;
+
+    /// @brief The entries played on top of the base command.
+    PWM_LED_Queue _queue;
+
+    /// @brief The playing queue entry, or NULL if the base command plays.
+    PWM_LED_QueueEntry * _entry = NULL;
+
+    /// @brief The `order` of [_entry], which tells a reused slot apart.
+    uint32_t _entryOrder = 0;
+
+    /// @brief Set when an entry is added or cancelled.
+    std::atomic<bool> _queueChanged{false};
+
+    /// @brief The command being played: the front command or the command
+    /// of [_entry].
+    const led_command_t * _source = _commands;
+
+    /// @brief Triple buffer of commands. At any time one buffer is owned
+    /// by the API callers (the back buffer), one by the task (the front
+    /// buffer) and one is parked in [_mailbox].
+    led_command_t _commands[3] = {};
+
+    /// @brief The index of the parked command buffer, a fresh flag and 
+    /// the sequence number of the parked command. Exchanged atomically 
+    /// by the publisher and the task.
+    std::atomic<uint32_t> _mailbox{1};
+
+    /// @brief The index of the back buffer, or PWM_LED_BUFFER_BUSY while
+    /// a caller is writing to it.
+    std::atomic<uint32_t> _backIndex{2};
+
+    /// @brief The index of the front buffer. Owned by the task.
+    uint8_t _frontIndex = 0;
+
+    /// @brief The last sequence number handed out to a publisher.
+    std::atomic<uint32_t> _published{0};
+
+    /// @brief The sequence number of the command in the front buffer.
+    std::atomic<uint32_t> _applied{0};
+
+    /// @brief The sequence number of the newest published command, 
+    /// shifted left by 8, and the state it requested.
+    std::atomic<uint32_t> _requested{LED_OFF};
+
+    /// @brief The timer slack in microseconds.
+    std::atomic<uint32_t> _slackUs{PWM_LED_TIMER_SLACK_US};
+
+    /// @brief Set by `refresh()` to re-apply the brightness.
+    std::atomic<bool> _refresh{false};
+
+    /// @brief Set while a PWM_LED_FrameEngine owns the output, so that
+    /// `_write()` only records the level.
+    std::atomic<bool> _framed{false};
+
+    /// @brief Writes a command into the back buffer and publishes it to 
+    /// the task without blocking. If another caller is publishing at the
+    /// same moment, the command is superseded by the concurrent one and
+    /// dropped.
+    /// @param state The requested state.
+    /// @param pattern The pattern, whose registry reference (if any) is
+    /// handed over to the command.
+    /// @param level The target brightness of a fade.
+    /// @param durationMs The duration of a fade in milliseconds.
+    /// @param compact The compact sequence to play instead of [pattern].
+    /// @param generator The generator to play instead of [pattern].
+    void _publish(led_state_t state, 
+            const PWM_LED_Pattern * pattern,
+            uint16_t level = 0,
+            uint16_t durationMs = 0,
+            const PWM_LED_CompactPattern * compact = NULL,
+            PWM_LED_Generator * generator = NULL);
+
+    /// @brief Writes [request] into the back buffer and publishes it. See
+    /// `_publish(state, ...)`.
+    /// @return The sequence number of the command, or 0 if it was 
+    /// dropped.
+    uint32_t _publish(const led_command_t & request);
+
+    /// @brief Publishes a flashing command with a repeat count and returns
+    /// its handle. Called by the `flash()` overloads with [repeats].
+    PWM_LED_Handle _publishSequence(led_command_t & command,
+            uint16_t repeats,
+            PWM_LED_Callback callback,
+            void * context);
+
+    /// @brief The number of cycles of the base command played so far.
+    uint16_t _cycles = 0;
+
+    /// @brief Set when the base command has played its repeats, so that
+    /// the LED stays off when the queue empties.
+    bool _baseEnded = false;
+
+    /// @brief The sequence number of the base command.
+    uint32_t _activeSequence = 0;
+
+    /// @brief The callback of the base command, or NULL once it has been
+    /// posted.
+    PWM_LED_Callback _doneCallback = NULL;
+
+    /// @brief The context of [_doneCallback].
+    void * _doneContext = NULL;
+
+    /// @brief The sequence number of the last command that played all of
+    /// its repeats.
+    std::atomic<uint32_t> _finished{0};
+
+    /// @brief The task blocked in `PWM_LED_Handle::wait()`, or NULL.
+    std::atomic<TaskHandle_t> _waiter{NULL};
+
+    /// @brief Ends the base command: posts its callback with [completed]
+    /// and wakes the waiting task. Called by the task only.
+    void _complete(bool completed);
+
+    /// @brief Turns the LED off at the end of the base command. Called by
+    /// the task only.
+    void _end();
+
+    /// @brief Whether the command [sequence] has played all of its 
+    /// repeats or has been replaced.
+    bool _done(uint32_t sequence);
+
+    /// @brief Blocks the calling task until `_done(sequence)`.
+    /// @return false on a timeout or if another task is waiting.
+    bool _wait(uint32_t sequence, uint32_t timeoutMs);
+
+    /// @brief Commands pushed by `onFromISR()`, `offFromISR()` and
+    /// `flashFromISR()`.
+    PWM_LED_IsrQueue _isrQueue;
+
+    /// @brief Pushes a command from an ISR and wakes the task.
+    bool _publishFromISR(led_state_t state, 
+            const PWM_LED_Pattern * pattern,
+            BaseType_t * woken);
+
+    /// @brief Swaps a freshly published command into the front buffer,
+    /// then takes the commands pushed by ISRs, keeping whichever is 
+    /// newest. Called by the task only.
+    /// @return true if a new command was received.
+    bool _receive();
+
+    /// @brief Writes a command pushed by an ISR into the front buffer.
+    /// Called by the task only.
+    void _receiveFromISR(const PWM_LED_IsrCommand & command);
+
+    /// @brief Re-writes the on duty cycle if `refresh()` was called or the
+    /// level of the brightness group has changed. Called by the task only.
+    void _applyRefresh();
+
+    /// @brief Sleeps the LED's own task until the next deadline.
+    PWM_LED_Timer _timer;
+
+    /// @brief Wakes the task driving the LED.
+    void _notify();
+
+    /// @brief Applies the front command, restarting the pattern if 
+    /// flashing. While a queue entry plays, the new command only takes 
+    /// effect when the queue is empty.
+    /// @param now The current time in microseconds.
+    /// @return true if the LED has another step pending.
+    bool _start(int64_t now);
+
+    /// @brief Makes [command] the played command.
+    /// @param now The current time in microseconds.
+    /// @param command The front command or the command of a queue entry.
+    void _apply(int64_t now, const led_command_t & command);
+
+    /// @brief Queues a flashing command. Called by the `enqueue()` 
+    /// overloads.
+    uint16_t _enqueue(const led_command_t & command,
+            uint8_t priority,
+            uint16_t repeats,
+            uint32_t durationMs);
+
+    /// @brief Switches to the top queue entry if entries were added or
+    /// cancelled. Called by the task only.
+    /// @param now The current time in microseconds.
+    /// @return true if the played command changed, in which case the
+    /// caller calls `_advance()`.
+    bool _applyQueue(int64_t now);
+
+    /// @brief Plays [entry], or the base command if [entry] is NULL.
+    /// @param now The current time in microseconds.
+    void _play(int64_t now, PWM_LED_QueueEntry * entry);
+
+    /// @brief Removes the playing entry and plays the next one.
+    /// @param now The current time in microseconds.
+    void _finish(int64_t now);
+
+    /// @brief Counts a completed cycle of the playing entry, or of the
+    /// base command if it has a repeat count.
+    /// @return true if the entry or command has played all of its 
+    /// repeats.
+    bool _cycleEnded();
+
+    /// @brief Plays the next step of the pattern and updates the fade 
+    /// if they are due, then schedules the next [_deadline]. Called by 
+    /// the task when [_deadline] has passed.
+    /// @param now The current time in microseconds.
+    /// @return true if the LED has another step or fade update pending.
+    bool _advance(int64_t now);
+
+    /// @brief Plays the next step of the pattern.
+    /// @param now The current time in microseconds.
+    void _playEdge(int64_t now);
+
+    /// @brief Fetches the next step of the flashing sequence.
+    /// @param durationUs Set to the duration of the step.
+    /// @param on Set to true for an `on` step.
+    /// @param rampUs Set to the fade time of the step.
+    /// @param resyncUs Set to the lateness beyond which the sequence is
+    /// restarted from the current time instead of catching up.
+    /// @return false if a generated sequence or the repeats of a queue
+    /// entry have ended.
+    bool _nextStep(int64_t & durationUs, 
+            bool & on, 
+            int64_t & rampUs, 
+            int64_t & resyncUs);
+
+    /// @brief Starts fading from the current brightness to [level].
+    /// @param now The current time in microseconds.
+    /// @param level The target brightness.
+    /// @param durationUs The duration of the fade in microseconds.
+    void _startFade(int64_t now, int level, int64_t durationUs);
+
+    /// @brief Writes the waveform at the current time and schedules the
+    /// next update.
+    /// @param now The current time in microseconds.
+    void _updateWave(int64_t now);
+
+    /// @brief Writes the interpolated brightness of the fade.
+    /// @param now The current time in microseconds.
+    void _updateFade(int64_t now);
+
+    /// @brief Records [level] as the current brightness and writes it
+    /// with [_output], unless a frame buffer owns the output.
+    /// @param level The brightness.
+    void _write(int level);
+
+    /// @brief The caller's brightness value, or NULL if the LED is in a
+    /// brightness group.
+    int * _brightness;
+
+    /// @brief The brightness group, or NULL.
+    PWM_LED_BrightnessGroup * _group;
+
+    /// @brief The next member of [_group].
+    PWM_LED * _nextInGroup = NULL;
+
+    /// @brief Whether the LED has been added to [_group].
+    bool _inGroup = false;
+
+    /// @brief The group generation last applied by the task.
+    uint32_t _groupGeneration = 0;
+
+    /// @brief Adds the LED to its brightness group once it can be woken.
+    void _joinGroup();
+
+    /// @brief The brightness of the LED when it is on.
+    int _onLevel();
+    
+    /// @brief The static delegate of [_readSensor]
+    /// @param _this NULL
+    static void _flashTaskStatic(void* _this);
+
+    /// @brief Private function to create the FreeRTOS task.
+    /// @param storage The storage of the task, or NULL to allocate it on
+    /// the heap.
+    /// @return true if initialization completed without errors.
+    bool _createTask(PWM_LED_TaskStorage * storage);
+
+    /// @brief Initializes the LED with its own task.
+    bool _begin(PWM_LED_TaskStorage * storage);
+
+    /// @brief The state of the GPIO pin when the LED is on. If the pin is 
+    /// attached to the LED cathode then this is LOW (the default).
+    int _onState; 
+
+    /// @brief The current state of the LED
+    std::atomic<led_state_t> _ledState{LED_OFF};
 
 };
 
@@ -0,0 +1,195 @@
+/*!
+* @file PWM_LED_BAM.cpp
+*
+* @section intro_sec_Introduction
+*
+* A bit-angle modulation (BAM) output backend for PWM_LED.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_BAM.h"
+#include "PWM_LED.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <soc/gpio_struct.h>
+#endif // ARDUINO_ARCH_ESP32
+
+int16_t PWM_LED_BAM_GPIO::attach(uint8_t pin, uint8_t /* channel */){
+    if (pin >= 32 * PWM_LED_BAM_WORDS){
+        return -1;
+    }
+    pinMode(pin, OUTPUT);
+    _mask[pin / 32] |= (uint32_t)1 << (pin % 32);
+    return pin;
+};
+
+void PWM_LED_BAM_GPIO::write(const uint32_t * plane){
+    #ifdef ARDUINO_ARCH_ESP32
+    GPIO.out_w1ts = plane[0] & _mask[0];
+    GPIO.out_w1tc = ~plane[0] & _mask[0];
+    #if PWM_LED_BAM_WORDS > 1
+    GPIO.out1_w1ts.val = plane[1] & _mask[1];
+    GPIO.out1_w1tc.val = ~plane[1] & _mask[1];
+    #endif // PWM_LED_BAM_WORDS
+    #else
+    for (uint8_t pin = 0; pin < 32 * PWM_LED_BAM_WORDS; pin++){
+        uint32_t bit = (uint32_t)1 << (pin % 32);
+        if (_mask[pin / 32] & bit){
+            digitalWrite(pin, plane[pin / 32] & bit? HIGH : LOW);
+        }
+    }
+    #endif // ARDUINO_ARCH_ESP32
+};
+
+#ifdef ARDUINO
+
+PWM_LED_BAM_ShiftRegisters::PWM_LED_BAM_ShiftRegisters(SPIClass & spi,
+        uint8_t latchPin,
+        uint8_t registers,
+        uint32_t frequency):
+            _spi(spi),
+            _latchPin(latchPin),
+            _registers(std::min(registers, (uint8_t)(4 * PWM_LED_BAM_WORDS))),
+            _frequency(frequency){};
+
+int16_t PWM_LED_BAM_ShiftRegisters::attach(uint8_t pin, uint8_t channel){
+    if (channel >= 8 * _registers){
+        return -1;
+    }
+    pinMode(_latchPin, OUTPUT);
+    return channel;
+};
+
+void PWM_LED_BAM_ShiftRegisters::write(const uint32_t * plane){
+    // the first byte shifted in ends up in the register furthest away
+    uint8_t bytes[4 * PWM_LED_BAM_WORDS];
+    for (uint8_t i = 0; i < _registers; i++){
+        uint8_t r = _registers - 1 - i;
+        bytes[i] = plane[r / 4] >> (8 * (r % 4));
+    }
+    _spi.beginTransaction(SPISettings(_frequency, MSBFIRST, SPI_MODE0));
+    _spi.writeBytes(bytes, _registers);
+    _spi.endTransaction();
+    digitalWrite(_latchPin, HIGH);
+    digitalWrite(_latchPin, LOW);
+};
+
+#endif // ARDUINO
+
+PWM_LED_BAM::PWM_LED_BAM(PWM_LED_BAM_Sink & sink,
+        uint8_t bits,
+        uint16_t frameHz):
+            _sink(sink),
+            _bits(std::max((uint8_t)1, std::min(bits,
+                    (uint8_t)PWM_LED_BAM_MAX_BITS))){
+    _slotUs = std::max((int64_t)1,
+            (int64_t)1000000 / ((int64_t)std::max(frameHz, (uint16_t)1) *
+                    ((1 << _bits) - 1)));
+    for (uint8_t i = 0; i < PWM_LED_BAM_MAX_CHANNELS; i++){
+        _bitOf[i] = -1;
+    }
+    for (uint8_t b = 0; b < PWM_LED_BAM_MAX_BITS; b++){
+        for (uint8_t w = 0; w < PWM_LED_BAM_WORDS; w++){
+            _planes[b][w].store(0);
+        }
+    }
+};
+
+bool PWM_LED_BAM::begin(){
+    if (_timer != NULL){
+        return true;
+    }
+    esp_timer_create_args_t args = {};
+    args.callback = _slotStatic;
+    args.arg = this;
+    args.name = "LED_BAM";
+    if (esp_timer_create(&args, &_timer) != ESP_OK){
+        _timer = NULL;
+        return false;
+    }
+    _slotDeadline = esp_timer_get_time();
+    _slot();
+    return true;
+};
+
+bool PWM_LED_BAM::attach(uint8_t pin, uint8_t channel){
+    return attach(pin, channel, PWM_LED_PWM_RESOLUTION, PWM_LED_PWM_FREQ);
+};
+
+bool PWM_LED_BAM::attach(uint8_t pin, 
+        uint8_t channel, 
+        uint8_t resolution, 
+        uint32_t /* frequency */){
+    if (channel >= PWM_LED_BAM_MAX_CHANNELS || 
+            resolution < 1 || resolution > 16){
+        return false;
+    }
+    _maxDuty[channel] = (1 << resolution) - 1;
+    int16_t bit = _sink.attach(pin, channel);
+    if (bit < 0 || bit >= 32 * PWM_LED_BAM_WORDS){
+        return false;
+    }
+    _bitOf[channel] = bit;
+    return begin();
+};
+
+void PWM_LED_BAM::write(uint8_t channel, uint32_t duty){
+    if (channel >= PWM_LED_BAM_MAX_CHANNELS || _bitOf[channel] < 0){
+        return;
+    }
+    // round the duty to the bit depth
+    uint32_t levels = (1 << _bits) - 1;
+    uint32_t maxDuty = _maxDuty[channel];
+    uint32_t value = (std::min(duty, maxDuty) * levels + maxDuty / 2) / 
+            maxDuty;
+    uint8_t word = _bitOf[channel] / 32;
+    uint32_t mask = (uint32_t)1 << (_bitOf[channel] % 32);
+    for (uint8_t b = 0; b < _bits; b++){
+        if (value & (1 << b)){
+            _planes[b][word].fetch_or(mask);
+        } else {
+            _planes[b][word].fetch_and(~mask);
+        }
+    }
+};
+
+uint32_t PWM_LED_BAM::frames(){
+    return _frames.load();
+};
+
+void PWM_LED_BAM::_slot(){
+    uint32_t plane[PWM_LED_BAM_WORDS];
+    for (uint8_t w = 0; w < PWM_LED_BAM_WORDS; w++){
+        plane[w] = _planes[_plane][w].load(std::memory_order_relaxed);
+    }
+    _sink.write(plane);
+    // plane n is shown for 2^n slots; deadlines are absolute so that the
+    // weights of the planes do not drift with the callback latency
+    _slotDeadline += _slotUs << _plane;
+    _plane++;
+    if (_plane >= _bits){
+        _plane = 0;
+        _frames.store(_frames.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    }
+    int64_t now = esp_timer_get_time();
+    if (_slotDeadline < now - (_slotUs << _bits)){
+        // more than a frame behind, so start again from now
+        _slotDeadline = now;
+    }
+    esp_timer_start_once(_timer, std::max(_slotDeadline - now, (int64_t)0));
+};
+
+void PWM_LED_BAM::_slotStatic(void * _this){
+    static_cast<PWM_LED_BAM*>(_this)->_slot();
+};
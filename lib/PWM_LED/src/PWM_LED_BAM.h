@@ -0,0 +1,215 @@
+/*!
+* @file PWM_LED_BAM.h
+*
+* @section intro_sec_Introduction
+*
+* A bit-angle modulation (BAM) output backend for PWM_LED.
+*
+* The ESP32 has 16 LEDC channels. PWM_LED_BAM drives up to
+* PWM_LED_BAM_MAX_CHANNELS LEDs from one `esp_timer` instead. The duty
+* cycle of every LED is kept in bitplanes: plane n holds bit n of every
+* duty, one bit per LED. A frame shows plane n for 2^n time slots, so the
+* light of each LED is proportional to its duty. A plane is pushed to the
+* hardware with a single write: GPIO set/clear registers for LEDs on GPIO
+* pins (PWM_LED_BAM_GPIO) or one SPI transfer for LEDs behind 74HC595
+* shift registers (PWM_LED_BAM_ShiftRegisters). The cost of a frame is
+* one write per bit of depth, whatever the number of LEDs, and a duty
+* update costs one atomic operation per bit of depth.
+*
+* ``` C++
+* PWM_LED_BAM_GPIO pins;
+* PWM_LED_BAM bam(pins);
+* PWM_LED status(bam, 25, 0, brightness, HIGH);  // GPIO 25, BAM channel 0
+* ```
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_BAM_H__
+#define __PWM_LED_BAM_H__
+
+#include "PWM_LED_Output.h"
+#include <atomic>
+
+#ifdef ARDUINO
+#include <SPI.h>
+#endif // ARDUINO
+
+/// The number of LEDs a BAM engine can drive (a multiple of 32).
+#ifndef PWM_LED_BAM_MAX_CHANNELS
+#define PWM_LED_BAM_MAX_CHANNELS 64
+#endif // PWM_LED_BAM_MAX_CHANNELS
+
+/// The number of 32-bit words in a bitplane.
+#define PWM_LED_BAM_WORDS (PWM_LED_BAM_MAX_CHANNELS / 32)
+
+/// The largest bit depth of a BAM engine.
+#define PWM_LED_BAM_MAX_BITS 8
+
+/// The default bit depth. Each extra bit doubles the number of levels and
+/// halves the shortest time slot.
+#ifndef PWM_LED_BAM_BITS
+#define PWM_LED_BAM_BITS 6
+#endif // PWM_LED_BAM_BITS
+
+/// The default frame rate in Hz. With the default depth the shortest slot
+/// is 1 / (150 * 63) s, about 106 us.
+#ifndef PWM_LED_BAM_FRAME_HZ
+#define PWM_LED_BAM_FRAME_HZ 150
+#endif // PWM_LED_BAM_FRAME_HZ
+
+/// @brief Pushes bitplanes to the hardware. A sink decides which bit of
+/// the plane drives each LED.
+class PWM_LED_BAM_Sink{
+
+    public:
+
+    /// @brief Prepares the output of [channel] on GPIO [pin].
+    /// @return The bit of the plane that drives the LED, or -1 if the LED
+    /// cannot be driven.
+    virtual int16_t attach(uint8_t pin, uint8_t channel) = 0;
+
+    /// @brief Writes a plane to the outputs in one go.
+    /// @param plane PWM_LED_BAM_WORDS words, bit n of word w driving bit
+    /// 32 * w + n.
+    virtual void write(const uint32_t * plane) = 0;
+
+};
+
+/// @brief Drives LEDs on GPIO pins. Bit n of the plane is GPIO n, and a
+/// plane is written through the GPIO set and clear registers of the
+/// ESP32 (elsewhere with `digitalWrite()` per pin).
+class PWM_LED_BAM_GPIO: public PWM_LED_BAM_Sink{
+
+    public:
+
+    int16_t attach(uint8_t pin, uint8_t channel) override;
+
+    void write(const uint32_t * plane) override;
+
+    private:
+
+    /// @brief The pins driven by the sink.
+    uint32_t _mask[PWM_LED_BAM_WORDS] = {};
+
+};
+
+#ifdef ARDUINO
+
+/// @brief Drives LEDs on a chain of 74HC595 shift registers. Bit n of the
+/// plane is output n of the chain, output 0 being QA of the register
+/// nearest to the ESP32. A plane is written with one SPI transfer and a
+/// pulse on the latch (RCLK) pin.
+class PWM_LED_BAM_ShiftRegisters: public PWM_LED_BAM_Sink{
+
+    public:
+
+    /// @param spi The SPI bus, already started with `begin()`.
+    /// @param latchPin The GPIO pin connected to RCLK.
+    /// @param registers The number of registers in the chain.
+    /// @param frequency The SPI clock frequency.
+    PWM_LED_BAM_ShiftRegisters(SPIClass & spi,
+            uint8_t latchPin,
+            uint8_t registers,
+            uint32_t frequency = 10000000);
+
+    int16_t attach(uint8_t pin, uint8_t channel) override;
+
+    void write(const uint32_t * plane) override;
+
+    private:
+
+    SPIClass & _spi;
+
+    uint8_t _latchPin;
+
+    uint8_t _registers;
+
+    uint32_t _frequency;
+
+};
+
+#endif // ARDUINO
+
+/// @brief The bit-angle modulation backend.
+class PWM_LED_BAM: public PWM_LED_Output{
+
+    public:
+
+    /// @param sink The hardware the planes are written to.
+    /// @param bits The bit depth, 1 to PWM_LED_BAM_MAX_BITS.
+    /// @param frameHz The number of frames per second.
+    PWM_LED_BAM(PWM_LED_BAM_Sink & sink,
+            uint8_t bits = PWM_LED_BAM_BITS,
+            uint16_t frameHz = PWM_LED_BAM_FRAME_HZ);
+
+    /// @brief Starts refreshing the outputs. Called by the first
+    /// `attach()`; safe to call more than once.
+    /// @return true if the refresh timer is running.
+    bool begin();
+
+    /// @brief Attaches the LED on [pin] to [channel] of the sink.
+    bool attach(uint8_t pin, uint8_t channel) override;
+
+    /// @brief Attaches the LED on [pin] to [channel] of the sink, taking
+    /// duties at [resolution] bits. [frequency] is ignored: all channels
+    /// are refreshed at the frame rate.
+    bool attach(uint8_t pin, 
+            uint8_t channel, 
+            uint8_t resolution, 
+            uint32_t frequency) override;
+
+    /// @brief Stores the duty of [channel] in the bitplanes, rounded to
+    /// the bit depth. Takes effect from the next frame.
+    void write(uint8_t channel, uint32_t duty) override;
+
+    /// @brief The number of frames output since `begin()`.
+    uint32_t frames();
+
+    private:
+
+    PWM_LED_BAM_Sink & _sink;
+
+    uint8_t _bits;
+
+    /// @brief The length of the shortest time slot in microseconds.
+    int64_t _slotUs;
+
+    /// @brief The plane bit of each channel, or -1 if not attached.
+    int16_t _bitOf[PWM_LED_BAM_MAX_CHANNELS];
+
+    /// @brief The largest duty each channel is written with.
+    uint16_t _maxDuty[PWM_LED_BAM_MAX_CHANNELS];
+
+    /// @brief The bitplanes. Updated by the LED tasks, read by the timer.
+    std::atomic<uint32_t> _planes[PWM_LED_BAM_MAX_BITS][PWM_LED_BAM_WORDS];
+
+    esp_timer_handle_t _timer = NULL;
+
+    /// @brief The plane shown in the current slot.
+    uint8_t _plane = 0;
+
+    /// @brief The end of the current slot.
+    int64_t _slotDeadline = 0;
+
+    std::atomic<uint32_t> _frames{0};
+
+    /// @brief Shows the next plane and arms the timer for the end of its
+    /// slot.
+    void _slot();
+
+    /// @brief The static delegate of [_slot].
+    static void _slotStatic(void * _this);
+
+};
+
+#endif // __PWM_LED_BAM_H__
@@ -0,0 +1,48 @@
+/*!
+* @file PWM_LED_BrightnessGroup.cpp
+*
+* @section intro_sec_Introduction
+*
+* A brightness level shared by any number of LEDs.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_BrightnessGroup.h"
+#include "PWM_LED.h"
+
+void PWM_LED_BrightnessGroup::set(int level){
+    level = std::max(0, std::min(level, 0xFFFF));
+    _level.store(level, std::memory_order_release);
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    // members of one engine are usually added together, so skipping
+    // repeats of the last engine woken saves most redundant notifications
+    PWM_LED_Engine * woken = NULL;
+    for (PWM_LED * led = _members.load(std::memory_order_acquire);
+            led != NULL;
+            led = led->_nextInGroup){
+        if (led->_engine == NULL){
+            led->_notify();
+        } else if (led->_engine != woken){
+            woken = led->_engine;
+            woken->notify();
+        }
+    }
+};
+
+void PWM_LED_BrightnessGroup::_add(PWM_LED * led){
+    PWM_LED * head = _members.load();
+    do {
+        led->_nextInGroup = head;
+    } while (!_members.compare_exchange_weak(head, led));
+    _size.fetch_add(1);
+};
@@ -0,0 +1,96 @@
+/*!
+* @file PWM_LED_BrightnessGroup.h
+*
+* @section intro_sec_Introduction
+*
+* A brightness level shared by any number of LEDs.
+*
+* LEDs constructed with a PWM_LED_BrightnessGroup read its level whenever
+* they turn on. Setting the level stores it atomically and wakes the task
+* driving each member once; a PWM_LED_Engine is woken once for all of its
+* members and re-writes every one of them in the same pass. Steady `on`
+* LEDs and the `on` steps of flashing LEDs change right away instead of at
+* their next edge, and no member ever mixes two levels, as all reads of a
+* level go through one atomic.
+*
+* ``` C++
+* PWM_LED_BrightnessGroup panel(0xFF);
+* PWM_LED power(16, 0, panel, HIGH);
+* PWM_LED status(17, 1, panel, HIGH);
+*
+* panel.set(ambient < NIGHT? 0x10 : 0xFF);   // dims every member
+* ```
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_BRIGHTNESS_GROUP_H__
+#define __PWM_LED_BRIGHTNESS_GROUP_H__
+
+#include "PWM_LED_HAL.h"
+#include <atomic>
+
+class PWM_LED;
+
+/// @brief A shared, atomically updated brightness level.
+class PWM_LED_BrightnessGroup{
+
+    public:
+
+    /// @param level The initial brightness of the members.
+    constexpr PWM_LED_BrightnessGroup(int level = 0xFF):
+        _level(level){};
+
+    /// @brief Sets the brightness of all members and wakes the tasks
+    /// driving them to apply it. Does not block.
+    /// @param level The brightness, 0 to 65535. Each member clamps it to
+    /// its `maxLevel()`.
+    void set(int level);
+
+    /// @brief The brightness of the members.
+    int level() const {
+        return _level.load(std::memory_order_acquire);
+    };
+
+    /// @brief Incremented by every `set()`; members compare it with the
+    /// generation they last applied.
+    uint32_t generation() const {
+        return _generation.load(std::memory_order_acquire);
+    };
+
+    /// @brief The number of LEDs that have joined the group.
+    uint16_t size() const {
+        return _size.load();
+    };
+
+    private:
+
+    friend class PWM_LED;
+
+    /// @brief Adds [led] to the member list. Called by `PWM_LED::begin()`.
+    /// Lock-free; members are never removed, so `set()` walks the list
+    /// without a lock.
+    void _add(PWM_LED * led);
+
+    std::atomic<int> _level;
+
+    std::atomic<uint32_t> _generation{0};
+
+    /// @brief The most recently added member, linked through
+    /// `PWM_LED::_nextInGroup`.
+    std::atomic<PWM_LED*> _members{nullptr};
+
+    std::atomic<uint16_t> _size{0};
+
+};
+
+#endif // __PWM_LED_BRIGHTNESS_GROUP_H__
@@ -0,0 +1,180 @@
+/*!
+* @file PWM_LED_Color.h
+*
+* @section intro_sec_Introduction
+*
+* Fixed-point color maths: perceptual brightness correction and HSV
+* colors.
+*
+* The eye sees brightness roughly as the cube root of the light, so a duty
+* that rises linearly looks like it jumps at the bottom and flattens at
+* the top. PWM_LED_Gamma<Resolution> maps a perceptual level to the duty
+* that produces it, following the CIE 1976 lightness curve (a cube with a
+* linear foot), which needs no `pow()`. Its table is built by the
+* compiler, sized to the resolution:
+* - up to 8 bits it has one entry per level and a lookup is one read;
+* - above 8 bits it has 257 entries, one every 2^(Resolution - 8) levels,
+*   and a lookup interpolates between two of them with a shift.
+*
+* `PWM_LED_hsv()` converts hue, saturation and value to a 24-bit color in
+* integer maths, so colors can be computed at compile time or thousands
+* of times per second at run time.
+*
+* ``` C++
+* constexpr uint32_t TEAL = PWM_LED_hsv(0x8000, 0xFF, 0x80);
+* uint32_t duty = PWM_LED_Gamma<12>::duty(level);
+* ```
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_COLOR_H__
+#define __PWM_LED_COLOR_H__
+
+#include "PWM_LED_HAL.h"
+
+/// @brief The indices [I] of a table built by the compiler: C++11 allows
+/// no loop in a `constexpr` function, so the entries are expanded from a
+/// pack instead.
+template <uint32_t... I>
+struct PWM_LED_Indices{};
+
+/// @brief The indices 0 to [N] - 1, as `type`.
+template <uint32_t N, uint32_t... I>
+struct PWM_LED_MakeIndices: PWM_LED_MakeIndices<N - 1, N - 1, I...>{};
+
+template <uint32_t... I>
+struct PWM_LED_MakeIndices<0, I...>{
+
+    typedef PWM_LED_Indices<I...> type;
+
+};
+
+/// @brief The perceptual brightness correction of a resolution.
+/// @tparam Resolution The duty resolution in bits, 1 to 16.
+template <uint8_t Resolution>
+class PWM_LED_Gamma{
+
+    static_assert(Resolution >= 1 && Resolution <= 16,
+            "The resolution is 1 to 16 bits.");
+
+    public:
+
+    /// @brief The largest level and duty.
+    static constexpr uint32_t maxDuty = ((uint32_t)1 << Resolution) - 1;
+
+    /// @brief The duty that looks [level] bright.
+    /// @param level The perceptual level, 0 to [maxDuty].
+    /// @return The duty, 0 to [maxDuty].
+    static constexpr uint32_t duty(uint32_t level){
+        return level >= maxDuty? maxDuty :
+            _table.entries[level >> _shift] +
+            (((uint32_t)(_table.entries[(level >> _shift) + 1] -
+                _table.entries[level >> _shift]) *
+                (level & _mask)) >> _shift);
+    };
+
+    /// @brief The CIE 1976 lightness curve, in integer maths.
+    /// @param level The perceptual level, 0 to [maxDuty].
+    /// @return The duty, 0 to [maxDuty].
+    static constexpr uint32_t curve(uint32_t level){
+        // L* = 100 * level / maxDuty; the linear foot ends at L* = 8
+        return (uint64_t)level * 100 <= (uint64_t)maxDuty * 8?
+            (uint32_t)(((uint64_t)level * 1000 + 4516) / 9033) :
+            _cube(((((uint64_t)level * 100 + (uint64_t)maxDuty * 16)) << 16) /
+                ((uint64_t)maxDuty * 116));
+    };
+
+    private:
+
+    /// @brief The number of levels between two entries, as a shift.
+    static constexpr uint8_t _shift = Resolution > 8? Resolution - 8 : 0;
+
+    static constexpr uint32_t _mask = ((uint32_t)1 << _shift) - 1;
+
+    /// @brief The number of entries: one past [maxDuty], so that every
+    /// level has an entry above it to interpolate towards.
+    static constexpr uint32_t _length = (maxDuty >> _shift) + 2;
+
+    /// @brief [maxDuty] times [t] cubed, where [t] is a 16-bit fraction.
+    static constexpr uint32_t _cube(uint64_t t){
+        return (uint32_t)((maxDuty * ((((t * t) >> 16) * t) >> 16) + 0x8000)
+                >> 16);
+    };
+
+    /// @brief The table, built by the compiler.
+    struct Table{
+
+        uint16_t entries[_length];
+
+    };
+
+    /// @brief The entry [i] of the table.
+    static constexpr uint16_t _entry(uint32_t i){
+        return (i << _shift) >= maxDuty? maxDuty : curve(i << _shift);
+    };
+
+    template <uint32_t... I>
+    static constexpr Table _build(PWM_LED_Indices<I...>){
+        return Table{{_entry(I)...}};
+    };
+
+    static constexpr Table _table = 
+            _build(typename PWM_LED_MakeIndices<_length>::type());
+
+};
+
+template <uint8_t Resolution>
+constexpr typename PWM_LED_Gamma<Resolution>::Table 
+        PWM_LED_Gamma<Resolution>::_table;
+
+/// @brief [value] scaled down by [part] 65025ths, rounded. Used by
+/// `PWM_LED_hsv()`.
+constexpr uint32_t PWM_LED_hsvScale(uint32_t value, uint32_t part){
+    return (value * (65025 - part) + 32512) / 65025;
+};
+
+/// @brief The color of the hue [sector] of the circle, given the levels 
+/// of its constant, falling and rising channels. Used by `PWM_LED_hsv()`.
+constexpr uint32_t PWM_LED_hsvSector(uint32_t sector,
+        uint32_t v,
+        uint32_t low,
+        uint32_t fall,
+        uint32_t up){
+    return sector == 0? v << 16 | up << 8 | low :
+        sector == 1? fall << 16 | v << 8 | low :
+        sector == 2? low << 16 | v << 8 | up :
+        sector == 3? low << 16 | fall << 8 | v :
+        sector == 4? up << 16 | low << 8 | v :
+        v << 16 | low << 8 | fall;
+};
+
+/// @brief Converts a color from HSV to a 24-bit 0xRRGGBB value.
+/// @param hue The hue in 1/65536ths of the color circle, from red (0)
+/// through green (0x5555) and blue (0xAAAA) back to red.
+/// @param saturation 0 (grey) to 255 (pure color).
+/// @param value The brightness, 0 to 255.
+constexpr uint32_t PWM_LED_hsv(uint16_t hue,
+        uint8_t saturation,
+        uint8_t value){
+    // the circle has six sectors, and the hue rises through each of them
+    // in 256 steps
+    return PWM_LED_hsvSector(((uint32_t)hue * 6) >> 16,
+            value,
+            ((uint32_t)value * (255 - saturation) + 127) / 255,
+            PWM_LED_hsvScale(value, 
+                saturation * ((((uint32_t)hue * 6) >> 8) & 0xFF)),
+            PWM_LED_hsvScale(value, 
+                saturation * (255 - ((((uint32_t)hue * 6) >> 8) & 0xFF))));
+};
+
+#endif // __PWM_LED_COLOR_H__
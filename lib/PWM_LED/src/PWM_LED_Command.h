@@ -0,0 +1,150 @@
+/*!
+* @file PWM_LED_Command.h
+*
+* @section intro_sec_Introduction
+*
+* The commands that the PWM_LED API hands to the task driving the LED.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_COMMAND_H__
+#define __PWM_LED_COMMAND_H__
+
+#include "PWM_LED_HAL.h"
+#include "PWM_LED_Pattern.h"
+#include "PWM_LED_Generator.h"
+#include "PWM_LED_Waveform.h"
+#include "PWM_LED_Metrics.h"
+#include "PWM_LED_Completion.h"
+
+/// @brief Enumeration of LED state.
+typedef enum LED_State{
+
+    /// @brief The LED is ON.
+    LED_OFF = 0x00,
+
+    /// @brief The LED is OFF.
+    LED_ON = 0X01,
+
+    /// @brief The LED is FLASHING.
+    LED_FLASHING = 0x10,
+
+    /// @brief The LED is FADING to a new brightness.
+    LED_FADING = 0x20,
+
+    /// @brief The LED is playing a waveform.
+    LED_WAVE = 0x40,
+
+}led_state_t;
+
+/// @brief The parameters of an LED_FLASHING command, or of the LED_OFF
+/// command of a sequence that cannot play.
+typedef struct LED_Flash{
+
+    /// @brief The compact sequence to play instead of the pattern, or 
+    /// NULL.
+    const PWM_LED_CompactPattern * compact;
+
+    /// @brief The generator of the sequence, or NULL.
+    PWM_LED_Generator * generator;
+
+    /// @brief Called by the dispatcher task when the sequence is done, or
+    /// NULL.
+    PWM_LED_Callback callback;
+
+    /// @brief The context passed to [callback].
+    void * context;
+
+}led_flash_t;
+
+/// @brief The parameters of an LED_FADING command.
+typedef struct LED_Fade{
+
+    /// @brief The target brightness.
+    uint16_t level;
+
+    /// @brief The duration in milliseconds.
+    uint16_t durationMs;
+
+}led_fade_t;
+
+/// @brief The parameters of an LED_WAVE command.
+typedef struct LED_Wave{
+
+    /// @brief The waveform.
+    const PWM_LED_Waveform * waveform;
+
+    /// @brief The period in milliseconds.
+    uint32_t periodMs;
+
+    /// @brief The interval between updates in microseconds.
+    uint32_t intervalUs;
+
+    /// @brief The peak as a fraction of the brightness, in 1/65535ths.
+    uint16_t amplitude;
+
+}led_wave_t;
+
+/// @brief A command published by `on()`, `off()` or `flash()` and picked
+/// up by the task driving the LED. It is copied into each of the three
+/// buffers of an LED and into every queue entry, so the parameters of the
+/// states share one union: a command carries only those of its [state].
+typedef struct LED_Command{
+
+    /// @brief The requested state.
+    led_state_t state;
+
+    /// @brief The position in the period at which the waveform or the
+    /// pattern of a sync group starts, in 1/65536ths.
+    uint16_t phase;
+
+    /// @brief The number of cycles of a flashing sequence to play before
+    /// the LED turns off, or 0 for no limit.
+    uint16_t repeats;
+
+    /// @brief The `esp_timer_get_time()` time at which a sync group 
+    /// starts the command, or 0 to start it when it is received.
+    int64_t epochUs;
+
+    /// @brief The flashing pattern, or NULL if not flashing one. A 
+    /// registry pattern is referenced for as long as the command holds 
+    /// it.
+    const PWM_LED_Pattern * pattern;
+
+    union{
+
+        /// @brief Set if [state] is LED_FLASHING or LED_OFF.
+        led_flash_t flash;
+
+        /// @brief Set if [state] is LED_FADING.
+        led_fade_t fade;
+
+        /// @brief Set if [state] is LED_WAVE.
+        led_wave_t wave;
+
+    };
+
+    #ifdef PWM_LED_METRICS
+    /// @brief The `esp_timer_get_time()` time of the command call.
+    int64_t publishedUs;
+    #endif // PWM_LED_METRICS
+
+}led_command_t;
+
+/// @brief The callback of [command], or NULL: only sequences have one.
+inline PWM_LED_Callback PWM_LED_callbackOf(const led_command_t & command){
+    return command.state == LED_FLASHING || command.state == LED_OFF?
+            command.flash.callback : NULL;
+};
+
+#endif // __PWM_LED_COMMAND_H__
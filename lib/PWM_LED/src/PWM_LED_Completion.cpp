@@ -0,0 +1,99 @@
+/*!
+* @file PWM_LED_Completion.cpp
+*
+* @section intro_sec_Introduction
+*
+* Completion signals of PWM_LED sequences.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Completion.h"
+#include "PWM_LED.h"
+
+#define DISPATCHER_TASK_STACK_SIZE 0x1000
+#define DISPATCHER_TASK_PRIORITY 5
+
+PWM_LED_Dispatcher::_entry_t PWM_LED_Dispatcher::_ring[PWM_LED_CALLBACK_QUEUE_SIZE];
+uint16_t PWM_LED_Dispatcher::_head = 0;
+uint16_t PWM_LED_Dispatcher::_count = 0;
+std::atomic<uint32_t> PWM_LED_Dispatcher::_dropped{0};
+std::atomic<bool> PWM_LED_Dispatcher::_started{false};
+TaskHandle_t PWM_LED_Dispatcher::_task = NULL;
+portMUX_TYPE PWM_LED_Dispatcher::_lock = portMUX_INITIALIZER_UNLOCKED;
+
+bool PWM_LED_Handle::done() const {
+    return _led == NULL || _led->_done(_sequence);
+};
+
+bool PWM_LED_Handle::wait(uint32_t timeoutMs) const {
+    return _led == NULL || _led->_wait(_sequence, timeoutMs);
+};
+
+bool PWM_LED_Dispatcher::begin(){
+    if (_started.exchange(true)){
+        return true;
+    }
+    TaskHandle_t task = NULL;
+    if (xTaskCreate(_run, "LED_CALLBACKS", DISPATCHER_TASK_STACK_SIZE, NULL,
+            DISPATCHER_TASK_PRIORITY, &task) != pdPASS){
+        _started.store(false);
+        return false;
+    }
+    return true;
+};
+
+bool PWM_LED_Dispatcher::post(PWM_LED_Callback callback,
+        void * context,
+        bool completed){
+    portENTER_CRITICAL(&_lock);
+    if (_count == PWM_LED_CALLBACK_QUEUE_SIZE){
+        portEXIT_CRITICAL(&_lock);
+        _dropped.fetch_add(1);
+        return false;
+    }
+    _ring[(_head + _count) % PWM_LED_CALLBACK_QUEUE_SIZE] = 
+            {callback, context, completed};
+    _count++;
+    TaskHandle_t task = _task;
+    portEXIT_CRITICAL(&_lock);
+    if (task != NULL){
+        xTaskNotifyGive(task);
+    }
+    return true;
+};
+
+uint32_t PWM_LED_Dispatcher::dropped(){
+    return _dropped.load();
+};
+
+void PWM_LED_Dispatcher::_run(void * /* unused */){
+    portENTER_CRITICAL(&_lock);
+    _task = xTaskGetCurrentTaskHandle();
+    portEXIT_CRITICAL(&_lock);
+    for (;;){
+        // callbacks posted before the task started are run straight away
+        for (;;){
+            portENTER_CRITICAL(&_lock);
+            if (_count == 0){
+                portEXIT_CRITICAL(&_lock);
+                break;
+            }
+            _entry_t entry = _ring[_head];
+            _head = (_head + 1) % PWM_LED_CALLBACK_QUEUE_SIZE;
+            _count--;
+            portEXIT_CRITICAL(&_lock);
+            entry.callback(entry.context, entry.completed);
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+};
@@ -0,0 +1,134 @@
+/*!
+* @file PWM_LED_Completion.h
+*
+* @section intro_sec_Introduction
+*
+* Completion signals of PWM_LED sequences.
+*
+* `flash()` with a repeat count returns a PWM_LED_Handle. The sequence is
+* done when it has played its repeats and the LED has turned off, or when
+* a later command has replaced it. A task can block on the handle with
+* `wait()`, which sleeps on a task notification, or the caller can pass a
+* PWM_LED_Callback that is called with the outcome.
+*
+* Callbacks never run in the task driving the LED. That task only posts
+* them to a small ring and wakes the PWM_LED_Dispatcher task, which calls
+* them one after the other, so a slow callback delays other callbacks but
+* never an LED.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_COMPLETION_H__
+#define __PWM_LED_COMPLETION_H__
+
+#include "PWM_LED_HAL.h"
+#include <atomic>
+
+/// The number of callbacks that can wait for the dispatcher task. Define
+/// before including this header to change it.
+#ifndef PWM_LED_CALLBACK_QUEUE_SIZE
+#define PWM_LED_CALLBACK_QUEUE_SIZE 16
+#endif // PWM_LED_CALLBACK_QUEUE_SIZE
+
+class PWM_LED;
+
+/// @brief Called by the dispatcher task when a sequence is done.
+/// @param context The context passed with the callback.
+/// @param completed true if the sequence played all of its repeats, false
+/// if a later command replaced it.
+typedef void (*PWM_LED_Callback)(void * context, bool completed);
+
+/// @brief Identifies a sequence started by `flash()` with a repeat count.
+class PWM_LED_Handle{
+
+    public:
+
+    PWM_LED_Handle(PWM_LED * led = NULL, uint32_t sequence = 0):
+        _led(led),
+        _sequence(sequence){};
+
+    /// @brief Whether the sequence has played all of its repeats or has 
+    /// been replaced by a later command.
+    bool done() const;
+
+    /// @brief Blocks the calling task until the sequence is done. The 
+    /// task sleeps on its task notification, which it must not use for
+    /// anything else while it waits. Only one task can wait on an LED at
+    /// a time; while one does, `wait()` in another task returns false at
+    /// once unless the sequence is already done.
+    /// @param timeoutMs The longest time to wait.
+    /// @return true if the sequence is done, false on a timeout or if
+    /// another task is waiting on the LED.
+    bool wait(uint32_t timeoutMs = portMAX_DELAY) const;
+
+    /// @brief The sequence number of the command, as in 
+    /// `PWM_LED::sequence()`.
+    uint32_t sequence() const {
+        return _sequence;
+    };
+
+    private:
+
+    PWM_LED * _led;
+
+    uint32_t _sequence;
+
+};
+
+/// @brief The task that runs completion callbacks.
+class PWM_LED_Dispatcher{
+
+    public:
+
+    /// @brief Creates the dispatcher task. Called by `flash()` when a
+    /// callback is passed; safe to call more than once.
+    /// @return true if the task is running or being created.
+    static bool begin();
+
+    /// @brief Queues [callback] for the dispatcher task. Never blocks.
+    /// @return false if the ring is full and the callback was dropped.
+    static bool post(PWM_LED_Callback callback, 
+            void * context, 
+            bool completed);
+
+    /// @brief The number of callbacks dropped because the ring was full.
+    static uint32_t dropped();
+
+    private:
+
+    typedef struct{
+        PWM_LED_Callback callback;
+        void * context;
+        bool completed;
+    } _entry_t;
+
+    static _entry_t _ring[PWM_LED_CALLBACK_QUEUE_SIZE];
+
+    static uint16_t _head;
+
+    static uint16_t _count;
+
+    static std::atomic<uint32_t> _dropped;
+
+    static std::atomic<bool> _started;
+
+    static TaskHandle_t _task;
+
+    static portMUX_TYPE _lock;
+
+    /// @brief Runs the queued callbacks, then sleeps until notified.
+    static void _run(void * unused);
+
+};
+
+#endif // __PWM_LED_COMPLETION_H__
@@ -0,0 +1,385 @@
+/*!
+* @file PWM_LED_Engine.cpp
+*
+* @section intro_sec_Introduction
+*
+* A single FreeRTOS task that drives any number of PWM_LED instances.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Engine.h"
+#include "PWM_LED.h"
+
+#define ENGINE_TASK_PRIORITY 10
+
+#if PWM_LED_TASK_POOL_SIZE > 0
+/// @brief The static task pool.
+static PWM_LED_TaskStorage _taskPool[PWM_LED_TASK_POOL_SIZE];
+
+/// @brief The number of pool blocks taken.
+static std::atomic<uint16_t> _taskPoolUsed{0};
+#endif // PWM_LED_TASK_POOL_SIZE
+
+PWM_LED_TaskStorage * PWM_LED_TaskStorage::acquire(){
+    #if PWM_LED_TASK_POOL_SIZE > 0
+    uint16_t used = _taskPoolUsed.load();
+    while (used < PWM_LED_TASK_POOL_SIZE){
+        if (_taskPoolUsed.compare_exchange_weak(used, used + 1)){
+            return &_taskPool[used];
+        }
+    }
+    #endif // PWM_LED_TASK_POOL_SIZE
+    return NULL;
+};
+
+bool PWM_LED_TaskStorage::createTask(PWM_LED_TaskStorage * storage,
+        TaskFunction_t function,
+        const char * name,
+        void * parameters,
+        UBaseType_t priority,
+        TaskHandle_t * handle){
+    if (storage == NULL){
+        return xTaskCreate(function, name, PWM_LED_TASK_STACK_SIZE, 
+                parameters, priority, handle) == pdPASS;
+    }
+    *handle = xTaskCreateStatic(function, name, PWM_LED_TASK_STACK_SIZE,
+            parameters, priority, storage->stack, &storage->task);
+    return *handle != NULL;
+};
+
+bool PWM_LED_Timer::begin(TaskHandle_t * task){
+    if (_timer != NULL){
+        return true;
+    }
+    _task = task;
+    esp_timer_create_args_t args = {};
+    args.callback = _expired;
+    args.arg = this;
+    args.name = "LED_TIMER";
+    return esp_timer_create(&args, &_timer) == ESP_OK;
+};
+
+void PWM_LED_Timer::waitUntil(int64_t deadline){
+    int64_t remaining = deadline - esp_timer_get_time();
+    if (remaining <= 0){
+        return;
+    }
+    // a timer left running by a racing expiry cannot be re-armed
+    esp_timer_stop(_timer);
+    _armed.store(true);
+    esp_timer_start_once(_timer, remaining);
+    wait();
+    _armed.store(false);
+    esp_timer_stop(_timer);
+};
+
+void PWM_LED_Timer::wait(){
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    _count = _count + 1;
+};
+
+uint32_t PWM_LED_Timer::wakeups(){
+    return _count;
+};
+
+uint32_t PWM_LED_Timer::wakeupsPerSecond(){
+    uint32_t now = millis();
+    uint32_t count = _count;
+    uint32_t elapsed = now - _lastMillis;
+    uint32_t rate = elapsed == 0? 0 : 
+        (uint32_t)((uint64_t)(count - _lastCount) * 1000 / elapsed);
+    _lastCount = count;
+    _lastMillis = now;
+    return rate;
+};
+
+void PWM_LED_Timer::_expired(void* _this){
+    PWM_LED_Timer * timer = static_cast<PWM_LED_Timer*>(_this);
+    // the task was notified first and has stopped waiting for this expiry
+    if (!timer->_armed.exchange(false)){
+        return;
+    }
+    xTaskNotifyGive(*timer->_task);
+};
+
+bool PWM_LED_Engine::begin(){
+    if (_task != NULL){
+        return true;
+    }
+    return _begin(PWM_LED_TaskStorage::acquire());
+};
+
+bool PWM_LED_Engine::begin(PWM_LED_TaskStorage & storage){
+    if (_task != NULL){
+        return true;
+    }
+    return _begin(&storage);
+};
+
+bool PWM_LED_Engine::begin(PWM_LED * const * leds, uint8_t count){
+    if (!begin()){
+        return false;
+    }
+    bool started = true;
+    _holdNotify.store(true);
+    for (uint8_t i = 0; i < count && started; i++){
+        started = leds[i]->begin(*this);
+    }
+    _holdNotify.store(false);
+    _wake();
+    return started;
+};
+
+bool PWM_LED_Engine::_begin(PWM_LED_TaskStorage * storage){
+    if (!_timer.begin(&_task)){
+        return false;
+    }
+    return PWM_LED_TaskStorage::createTask(storage,
+        this->_runTaskStatic,
+        "LED_ENGINE",
+        this,
+        ENGINE_TASK_PRIORITY,
+        &_task);
+};
+
+bool PWM_LED_Engine::attach(PWM_LED * led){
+    bool attached = false;
+    portENTER_CRITICAL(&_lock);
+    uint8_t count = _ledCount.load(std::memory_order_relaxed);
+    if (led->_engine == NULL && count < PWM_LED_ENGINE_MAX_LEDS){
+        led->_engine = this;
+        led->_engineIndex = count;
+        led->_heapIndex = PWM_LED_NOT_QUEUED;
+        _leds[count] = led;
+        // the engine task only reads the LEDs below the count it sees
+        _ledCount.store(count + 1, std::memory_order_release);
+        attached = true;
+    }
+    portEXIT_CRITICAL(&_lock);
+    return attached;
+};
+
+void PWM_LED_Engine::notify(PWM_LED * led){
+    _mark(led);
+    _wake();
+};
+
+void IRAM_ATTR PWM_LED_Engine::notifyFromISR(BaseType_t * woken,
+        PWM_LED * led){
+    _mark(led);
+    if (_task != NULL && !_holdNotify.load()){
+        vTaskNotifyGiveFromISR(_task, woken);
+    }
+};
+
+uint8_t PWM_LED_Engine::size(){
+    return _ledCount.load();
+};
+
+uint32_t PWM_LED_Engine::wakeups(){
+    return _timer.wakeups();
+};
+
+uint32_t PWM_LED_Engine::wakeupsPerSecond(){
+    return _timer.wakeupsPerSecond();
+};
+
+uint32_t PWM_LED_Engine::wakeupsSaved(){
+    return _saved;
+};
+
+void PWM_LED_Engine::_run(void){
+    for (;;){
+        int64_t now = esp_timer_get_time();
+        _receive(now);
+        // advance every LED whose edge or fade update is due; another LED
+        // served at a deadline of its own would have woken the engine 
+        // again, so it is a wakeup saved, but the catch-up edges of one
+        // LED are not
+        int64_t first = INT64_MIN;
+        uint32_t served[PWM_LED_ENGINE_PENDING_WORDS] = {};
+        while (_heapSize > 0 && _heap[0]->_deadline <= now){
+            PWM_LED * led = _heap[0];
+            uint32_t & word = served[led->_engineIndex / 32];
+            uint32_t bit = 1u << (led->_engineIndex % 32);
+            if (first == INT64_MIN){
+                first = led->_deadline;
+            } else if ((word & bit) == 0 && led->_deadline != first){
+                _saved = _saved + 1;
+            }
+            word |= bit;
+            PWM_LED_METRIC(led->_metrics.wakeup());
+            if (led->_advance(now)){
+                _siftDown(0);
+            } else {
+                _remove(led);
+            }
+        }
+        // sleep until the next deadline or until notified
+        if (_heapSize > 0){
+            _timer.waitUntil(_wakeTime());
+        } else {
+            _timer.wait();
+        }
+    }
+};
+
+void PWM_LED_Engine::_receive(int64_t now){
+    for (uint8_t word = 0; word < PWM_LED_ENGINE_PENDING_WORDS; word++){
+        if (_pending[word].load() == 0){
+            continue;
+        }
+        uint32_t pending = _pending[word].exchange(0);
+        // an LED is counted before it is marked, so the count read after
+        // the exchange covers every LED whose bit was taken
+        uint8_t count = _ledCount.load(std::memory_order_acquire);
+        while (pending != 0){
+            uint16_t i = word * 32 + __builtin_ctz(pending);
+            if (i >= count){
+                // bits are taken in index order, so the rest are unused
+                // too; keep them for the LEDs still to be attached
+                _pending[word].fetch_or(pending);
+                break;
+            }
+            pending &= pending - 1;
+            // start, restart or stop the LED if its command or queue has
+            // changed
+            PWM_LED * led = _leds[i];
+            if (led->_receive()){
+                PWM_LED_METRIC(led->_metrics.wakeup());
+                _remove(led);
+                if (led->_start(now)){
+                    _push(led);
+                }
+            }
+            if (led->_applyQueue(now)){
+                PWM_LED_METRIC(led->_metrics.wakeup());
+                _remove(led);
+                if (led->_advance(now)){
+                    _push(led);
+                }
+            }
+            led->_applyRefresh();
+        }
+    }
+};
+
+void PWM_LED_Engine::_wake(){
+    if (_task != NULL && !_holdNotify.load()){
+        xTaskNotifyGive(_task);
+    }
+};
+
+void IRAM_ATTR PWM_LED_Engine::_mark(PWM_LED * led){
+    if (led == NULL){
+        for (uint8_t word = 0; word < PWM_LED_ENGINE_PENDING_WORDS; word++){
+            _pending[word].store(UINT32_MAX);
+        }
+    } else {
+        uint8_t i = led->_engineIndex;
+        _pending[i / 32].fetch_or(1UL << (i % 32));
+    }
+};
+
+int64_t PWM_LED_Engine::_wakeTime(){
+    // a deadline is never earlier than its parent's in the heap, so only
+    // the subtrees whose root is due before the wake time found so far
+    // can bring it forward
+    int64_t wake = INT64_MAX;
+    uint8_t stack[PWM_LED_ENGINE_MAX_LEDS];
+    uint8_t depth = 0;
+    if (_heapSize > 0){
+        stack[depth++] = 0;
+    }
+    while (depth > 0){
+        uint8_t i = stack[--depth];
+        PWM_LED * led = _heap[i];
+        if (led->_deadline >= wake){
+            continue;
+        }
+        wake = std::min(wake, led->_deadline + led->slack());
+        uint16_t left = 2 * i + 1;
+        if (left < _heapSize){
+            stack[depth++] = left;
+        }
+        if (left + 1 < _heapSize){
+            stack[depth++] = left + 1;
+        }
+    }
+    return wake;
+};
+
+void PWM_LED_Engine::_runTaskStatic(void* _this){
+    static_cast<PWM_LED_Engine*>(_this)->_run();
+};
+
+void PWM_LED_Engine::_push(PWM_LED * led){
+    led->_heapIndex = _heapSize;
+    _heap[_heapSize] = led;
+    _heapSize++;
+    _siftUp(led->_heapIndex);
+};
+
+void PWM_LED_Engine::_remove(PWM_LED * led){
+    uint8_t i = led->_heapIndex;
+    if (i == PWM_LED_NOT_QUEUED){
+        return;
+    }
+    _heapSize--;
+    if (i != _heapSize){
+        _swap(i, _heapSize);
+        _siftDown(i);
+        _siftUp(i);
+    }
+    led->_heapIndex = PWM_LED_NOT_QUEUED;
+};
+
+void PWM_LED_Engine::_siftUp(uint8_t i){
+    while (i > 0){
+        uint8_t parent = (i - 1) / 2;
+        if (_heap[i]->_deadline >= _heap[parent]->_deadline){
+            return;
+        }
+        _swap(i, parent);
+        i = parent;
+    }
+};
+
+void PWM_LED_Engine::_siftDown(uint8_t i){
+    for (;;){
+        uint8_t smallest = i;
+        uint16_t left = 2 * i + 1;
+        uint16_t right = left + 1;
+        if (left < _heapSize &&
+            _heap[left]->_deadline < _heap[smallest]->_deadline){
+            smallest = left;
+        }
+        if (right < _heapSize &&
+            _heap[right]->_deadline < _heap[smallest]->_deadline){
+            smallest = right;
+        }
+        if (smallest == i){
+            return;
+        }
+        _swap(i, smallest);
+        i = smallest;
+    }
+};
+
+void PWM_LED_Engine::_swap(uint8_t a, uint8_t b){
+    PWM_LED * led = _heap[a];
+    _heap[a] = _heap[b];
+    _heap[b] = led;
+    _heap[a]->_heapIndex = a;
+    _heap[b]->_heapIndex = b;
+};
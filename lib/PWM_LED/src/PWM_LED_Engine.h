@@ -0,0 +1,304 @@
+/*!
+* @file PWM_LED_Engine.h
+*
+* @section intro_sec_Introduction
+*
+* A single FreeRTOS task that drives any number of PWM_LED instances.
+*
+* By default every PWM_LED creates its own task when `begin()` is called.
+* When a PWM_LED_Engine is passed to `PWM_LED::begin(engine)` instead, the
+* LED registers with the engine and no task of its own is created. The
+* engine keeps the registered LEDs in a min-heap ordered by the time of
+* their next edge and sleeps until the earliest one is due, so the stack and context-switch cost stays flat as the 
+* number of LEDs grows.
+*
+* An LED can allow the engine a timer slack with `PWM_LED::setSlack()`.
+* The engine then sleeps until the latest time that is within the slack
+* of every pending LED, and serves all LEDs that are due at once, so 
+* nearby edges of different LEDs share one wakeup. Edges are delayed by 
+* at most the slack and never played early; the pattern timing stays 
+* anchored to the scheduled edges, so the delay does not accumulate.
+*
+* A command marks only the LED it changes as pending, and the wake time is
+* found from the top of the heap, so the work of a wakeup grows with the
+* number of LEDs that changed or are due, not with the number registered.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_ENGINE_H__
+#define __PWM_LED_ENGINE_H__
+
+#include "PWM_LED_HAL.h"
+#include <atomic>
+
+/// The maximum number of PWM_LED instances that can be registered with
+/// one engine (at most 254). Define before including this header to 
+/// change it.
+#ifndef PWM_LED_ENGINE_MAX_LEDS
+#define PWM_LED_ENGINE_MAX_LEDS 32
+#endif // PWM_LED_ENGINE_MAX_LEDS
+
+/// The timer slack of every LED in microseconds until `setSlack()` is 
+/// called. 0 (the default) plays every edge as close to its time as the
+/// engine can. Define before including this header to change it.
+#ifndef PWM_LED_TIMER_SLACK_US
+#define PWM_LED_TIMER_SLACK_US 0
+#endif // PWM_LED_TIMER_SLACK_US
+
+/// The number of 32-bit words of the engine's pending-LED mask.
+#define PWM_LED_ENGINE_PENDING_WORDS ((PWM_LED_ENGINE_MAX_LEDS + 31) / 32)
+
+/// Heap index of a PWM_LED that has no edge pending in the engine.
+#define PWM_LED_NOT_QUEUED 0xFF
+
+/// The stack size of an LED or engine task in bytes. Define before 
+/// including this header to change it.
+#ifndef PWM_LED_TASK_STACK_SIZE
+#define PWM_LED_TASK_STACK_SIZE 0x1000
+#endif // PWM_LED_TASK_STACK_SIZE
+
+/// The number of blocks of task storage in the static pool that `begin()`
+/// takes its task from before it falls back to the heap. 0 (the default)
+/// disables the pool. The pool is defined in PWM_LED_Engine.cpp, so set
+/// it as a build flag.
+#ifndef PWM_LED_TASK_POOL_SIZE
+#define PWM_LED_TASK_POOL_SIZE 0
+#endif // PWM_LED_TASK_POOL_SIZE
+
+class PWM_LED;
+
+/// @brief The stack and control block of a statically allocated LED or 
+/// engine task, for `begin(storage)`. Must outlive the task, so it is 
+/// normally a global or `static` variable.
+typedef struct PWM_LED_TaskStorage{
+
+    StackType_t stack[PWM_LED_TASK_STACK_SIZE];
+
+    StaticTask_t task;
+
+    /// @brief Takes a block from the static pool.
+    /// @return The block, or NULL if the pool is empty or disabled.
+    static PWM_LED_TaskStorage * acquire();
+
+    /// @brief Creates a task in [storage] with `xTaskCreateStatic()`, or
+    /// on the heap with `xTaskCreate()` if [storage] is NULL.
+    /// @return true if the task was created.
+    static bool createTask(PWM_LED_TaskStorage * storage,
+            TaskFunction_t function,
+            const char * name,
+            void * parameters,
+            UBaseType_t priority,
+            TaskHandle_t * handle);
+
+}PWM_LED_task_storage_t;
+
+/// @brief Puts an LED task to sleep until an absolute deadline on the 
+/// 64-bit microsecond `esp_timer` clock, or until the task is notified,
+/// and counts the wakeups.
+///
+/// The deadline is armed as a one-shot `esp_timer` that notifies the task
+/// when it expires, so edges are not rounded to the FreeRTOS tick and 
+/// sub-millisecond steps are possible.
+class PWM_LED_Timer{
+
+    public:
+
+    /// @brief Creates the one-shot timer.
+    /// @param task The handle of the task to notify when the timer expires.
+    /// @return true if the timer was created.
+    bool begin(TaskHandle_t * task);
+
+    /// @brief Blocks the calling task until [deadline] or until notified.
+    /// Returns immediately if [deadline] has passed.
+    /// @param deadline An `esp_timer_get_time()` time in microseconds.
+    void waitUntil(int64_t deadline);
+
+    /// @brief Blocks the calling task until notified.
+    void wait();
+
+    /// @brief The total number of wakeups.
+    uint32_t wakeups();
+
+    /// @brief The wakeup rate since the previous call.
+    /// @return Wakeups per second.
+    uint32_t wakeupsPerSecond();
+
+    private:
+
+    /// @brief The `esp_timer` callback that notifies the task.
+    /// @param _this The PWM_LED_Timer instance.
+    static void _expired(void* _this);
+
+    /// @brief The one-shot timer.
+    esp_timer_handle_t _timer = NULL;
+
+    /// @brief The handle of the task to notify.
+    TaskHandle_t * _task = NULL;
+
+    /// @brief Set while [waitUntil] waits for the timer, so that an expiry
+    /// that races with a notification is not left pending for the next
+    /// wait.
+    std::atomic<bool> _armed{false};
+
+    /// @brief The number of wakeups.
+    volatile uint32_t _count = 0;
+
+    /// @brief [_count] at the previous call to [wakeupsPerSecond].
+    uint32_t _lastCount = 0;
+
+    /// @brief The [millis] time of the previous call to [wakeupsPerSecond].
+    uint32_t _lastMillis = 0;
+
+};
+
+/// @brief Drives the flashing patterns of many PWM_LED instances from one
+/// FreeRTOS task, scheduling the next edge of each LED from a min-heap.
+class PWM_LED_Engine{
+
+    public:
+
+    /// @brief Creates the engine task. Safe to call more than once.
+    /// @return true if the engine task is running.
+    bool begin();
+
+    /// @brief Creates the engine task in [storage] instead of on the heap.
+    /// Safe to call more than once.
+    /// @return true if the engine task is running.
+    bool begin(PWM_LED_TaskStorage & storage);
+
+    /// @brief Starts the engine and initializes [count] LEDs with 
+    /// `begin(engine)` in one pass. The engine is woken once at the end
+    /// instead of once per LED.
+    /// @param leds The LEDs.
+    /// @param count The number of LEDs.
+    /// @return false if an LED could not be initialized; the LEDs before
+    /// it are running.
+    bool begin(PWM_LED * const * leds, uint8_t count);
+
+    /// @brief Registers [led] with the engine. Called by
+    /// `PWM_LED::begin(engine)`; safe to call from any task.
+    /// @param led The LED to register.
+    /// @return false if the engine is full or [led] is already registered
+    /// with an engine.
+    bool attach(PWM_LED * led);
+
+    /// @brief Wakes the engine task so that it picks up a changed LED
+    /// command.
+    /// @param led The LED whose command changed, or NULL to have the
+    /// engine check every LED.
+    void notify(PWM_LED * led = NULL);
+
+    /// @brief `notify()` for interrupt handlers.
+    /// @param woken Set to pdTRUE if the engine task should run before the
+    /// interrupted one. May be NULL.
+    /// @param led The LED whose command changed, or NULL for every LED.
+    void notifyFromISR(BaseType_t * woken, PWM_LED * led = NULL);
+
+    /// @brief The number of LEDs registered with the engine.
+    uint8_t size();
+
+    /// @brief The number of times the engine task has woken up.
+    uint32_t wakeups();
+
+    /// @brief The engine task wakeup rate since the previous call.
+    /// @return Wakeups per second.
+    uint32_t wakeupsPerSecond();
+
+    /// @brief The number of wakeups saved by serving edges and updates
+    /// that were due at different times in one wakeup: every LED that a
+    /// wakeup serves at a deadline other than the one it woke for counts
+    /// once. The catch-up edges of a late LED are not counted.
+    uint32_t wakeupsSaved();
+
+    protected:
+
+    /// @brief Task handle for the engine task.
+    TaskHandle_t _task = NULL;
+
+    /// @brief The engine task.
+    void _run(void);
+
+    private:
+
+    friend class PWM_LED_Stream;
+
+    /// @brief The static delegate of [_run]
+    /// @param _this The engine instance.
+    static void _runTaskStatic(void* _this);
+
+    /// @brief Creates the engine task in [storage], or on the heap if 
+    /// [storage] is NULL.
+    bool _begin(PWM_LED_TaskStorage * storage);
+
+    /// @brief Set while `begin(leds, count)` runs, or a PWM_LED_Stream
+    /// applies a frame, to hold back the notifications of the LEDs.
+    std::atomic<bool> _holdNotify{false};
+
+    /// @brief Serializes `attach()`.
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    /// @brief All LEDs registered with the engine.
+    PWM_LED * _leds[PWM_LED_ENGINE_MAX_LEDS];
+
+    /// @brief The number of registered LEDs, published after the LED is
+    /// stored in [_leds].
+    std::atomic<uint8_t> _ledCount{0};
+
+    /// @brief One bit per registered LED whose command, queue or level
+    /// has changed since the engine task last checked it.
+    std::atomic<uint32_t> _pending[PWM_LED_ENGINE_PENDING_WORDS] = {};
+
+    /// @brief Min-heap of the LEDs that have an edge pending, ordered by
+    /// their next deadline.
+    PWM_LED * _heap[PWM_LED_ENGINE_MAX_LEDS];
+
+    /// @brief The number of LEDs in [_heap].
+    uint8_t _heapSize = 0;
+
+    /// @brief Sleeps the engine task until the next deadline.
+    PWM_LED_Timer _timer;
+
+    /// @brief The number of wakeups saved.
+    volatile uint32_t _saved = 0;
+
+    /// @brief Wakes the engine task unless notifications are held.
+    void _wake();
+
+    /// @brief Marks [led], or every LED if NULL, as pending.
+    void _mark(PWM_LED * led);
+
+    /// @brief Starts, restarts or stops the pending LEDs.
+    void _receive(int64_t now);
+
+    /// @brief The latest time at which no pending LED is later than its
+    /// deadline plus its slack.
+    int64_t _wakeTime();
+
+    /// @brief Adds [led] to the heap.
+    void _push(PWM_LED * led);
+
+    /// @brief Removes [led] from the heap if it is queued.
+    void _remove(PWM_LED * led);
+
+    /// @brief Moves the heap entry at [i] towards the root.
+    void _siftUp(uint8_t i);
+
+    /// @brief Moves the heap entry at [i] towards the leaves.
+    void _siftDown(uint8_t i);
+
+    /// @brief Swaps two heap entries and updates their heap indices.
+    void _swap(uint8_t a, uint8_t b);
+
+};
+
+#endif // __PWM_LED_ENGINE_H__
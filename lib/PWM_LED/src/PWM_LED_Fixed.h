@@ -0,0 +1,152 @@
+/*!
+* @file PWM_LED_Fixed.h
+*
+* @section intro_sec_Introduction
+*
+* A PWM_LED whose resolution, frequency and polarity are fixed at compile
+* time.
+*
+* PWM_LED takes its resolution and frequency from the global
+* PWM_LED_PWM_RESOLUTION and PWM_LED_PWM_FREQ and decides the polarity of
+* the pin at run time. PWM_LED_Fixed<Resolution, FreqHz, ActiveHigh> sets
+* all three per LED. Its duty cycle is a `constexpr` function of the
+* brightness with the polarity folded in, and its brightness runs from 0
+* to 2^Resolution - 1, so 12- to 16-bit LEDs can be dimmed in steps that
+* an 8-bit LED cannot resolve. Settings the LEDC timer cannot produce are
+* rejected by the compiler.
+*
+* ``` C++
+* // 14 bits at 1 kHz, anode on the pin
+* PWM_LED_Fixed<14, 1000, true> lamp(LAMP_PIN, LAMP_PWM, lampBrightness);
+* ```
+*
+* PWM_LED stays the runtime-configurable class; both share the same API,
+* task and engine, and can be mixed freely.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_FIXED_H__
+#define __PWM_LED_FIXED_H__
+
+#include "PWM_LED.h"
+
+/// The clock of the LEDC timers. The PWM frequency times 2^resolution
+/// cannot exceed it.
+#define PWM_LED_LEDC_CLOCK_HZ 80000000ULL
+
+/// @brief The compile-time duty cycle maths of a PWM_LED_Fixed.
+template <uint8_t Resolution, uint32_t FreqHz, bool ActiveHigh>
+class PWM_LED_PwmPolicy{
+
+    static_assert(Resolution >= 1 && Resolution <= 16,
+            "The resolution is 1 to 16 bits.");
+
+    static_assert(FreqHz > 0 &&
+            ((unsigned long long)FreqHz << Resolution) <= PWM_LED_LEDC_CLOCK_HZ,
+            "The LEDC cannot produce this frequency at this resolution.");
+
+    public:
+
+    static constexpr uint8_t resolution = Resolution;
+
+    static constexpr uint32_t frequency = FreqHz;
+
+    /// @brief The duty cycle, and brightness, that drives the LED fully on.
+    static constexpr uint32_t maxDuty = ((uint32_t)1 << Resolution) - 1;
+
+    /// @brief The duty cycle that produces [level].
+    /// @param level The brightness, 0 to [maxDuty].
+    static constexpr uint32_t duty(int level){
+        return ActiveHigh? (uint32_t)level : maxDuty - (uint32_t)level;
+    };
+
+};
+
+/// @brief A PWM_LED with a compile-time resolution, PWM frequency and
+/// polarity.
+/// @tparam Resolution The duty resolution in bits, 1 to 16.
+/// @tparam FreqHz The PWM frequency.
+/// @tparam ActiveHigh true if the LED is on when the pin is HIGH.
+template <uint8_t Resolution, uint32_t FreqHz, bool ActiveHigh = false>
+class PWM_LED_Fixed: public PWM_LED{
+
+    public:
+
+    typedef PWM_LED_PwmPolicy<Resolution, FreqHz, ActiveHigh> Policy;
+
+    /// @param pin The GPIO pin.
+    /// @param PwmChannel The LEDC channel.
+    /// @param brightness The brightness of the LED when it is on, 0 to
+    /// Policy::maxDuty.
+    PWM_LED_Fixed(uint8_t pin,
+            uint8_t PwmChannel,
+            int & brightness):
+        PWM_LED(pin, PwmChannel, brightness, ActiveHigh? HIGH : LOW){
+        _maxLevel = Policy::maxDuty;
+    };
+
+    /// @brief Constructs an LED that is driven through [output].
+    PWM_LED_Fixed(PWM_LED_Output & output,
+            uint8_t pin,
+            uint8_t channel,
+            int & brightness):
+        PWM_LED(output, pin, channel, brightness, ActiveHigh? HIGH : LOW){
+        _maxLevel = Policy::maxDuty;
+    };
+
+    /// @brief Constructs an LED whose brightness is the level of [group].
+    PWM_LED_Fixed(uint8_t pin,
+            uint8_t PwmChannel,
+            PWM_LED_BrightnessGroup & group):
+        PWM_LED(pin, PwmChannel, group, ActiveHigh? HIGH : LOW){
+        _maxLevel = Policy::maxDuty;
+    };
+
+    /// @brief Constructs an LED that is driven through [output] and whose
+    /// brightness is the level of [group].
+    PWM_LED_Fixed(PWM_LED_Output & output,
+            uint8_t pin,
+            uint8_t channel,
+            PWM_LED_BrightnessGroup & group):
+        PWM_LED(output, pin, channel, group, ActiveHigh? HIGH : LOW){
+        _maxLevel = Policy::maxDuty;
+    };
+
+    protected:
+
+    /// @brief Attaches the channel at the compile-time settings.
+    bool _attach() override {
+        return _backend.attach(_GPIO, _PwmChannel, Resolution, FreqHz);
+    };
+
+    void _output(int level) override {
+        _backend.write(_PwmChannel, Policy::duty(_fixedCorrected(level)));
+    };
+
+    bool _fadeHardware(int from, int to, int64_t durationUs) override {
+        return _backend.fade(_PwmChannel, 
+                Policy::duty(_fixedCorrected(from)),
+                Policy::duty(_fixedCorrected(to)), durationUs);
+    };
+
+    private:
+
+    /// @brief [level], or its perceptual correction at the compile-time
+    /// resolution.
+    int _fixedCorrected(int level){
+        return _gamma.load()? PWM_LED_Gamma<Resolution>::duty(level) : level;
+    };
+
+};
+
+#endif // __PWM_LED_FIXED_H__
@@ -0,0 +1,212 @@
+/*!
+* @file PWM_LED_FrameBuffer.cpp
+*
+* @section intro_sec_Introduction
+*
+* Frame-buffer animation: a whole frame of levels for many LEDs, shown at
+* once on a fixed tick.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_FrameBuffer.h"
+#include <cstring>
+
+#define FRAME_TASK_PRIORITY 10
+
+#define FRAME_FRESH 4
+
+#define FRAME_INDEX_MASK 3
+
+/// The slot of [_levels] that holds the levels last written.
+#define FRAME_WRITTEN 3
+
+PWM_LED_FrameEngine::PWM_LED_FrameEngine(PWM_LED ** leds,
+        uint16_t * levels,
+        uint16_t * maxLevels,
+        uint16_t capacity,
+        uint32_t intervalUs):
+    _leds(leds),
+    _levels(levels),
+    _maxLevels(maxLevels),
+    _capacity(capacity),
+    _intervalUs(std::max(intervalUs, (uint32_t)1)){
+    _back = _frame(_backIndex);
+};
+
+bool PWM_LED_FrameEngine::add(PWM_LED & led){
+    if (_task != NULL || _size >= _capacity){
+        return false;
+    }
+    // the LED keeps playing its commands, but only the frames reach its
+    // PWM channel from now on
+    led._framed.store(true);
+    _leds[_size] = &led;
+    _maxLevels[_size] = std::min(led.maxLevel(), (int)UINT16_MAX);
+    _size++;
+    return true;
+};
+
+bool PWM_LED_FrameEngine::begin(){
+    if (_task != NULL){
+        return !_ending.load();
+    }
+    return _begin(PWM_LED_TaskStorage::acquire());
+};
+
+bool PWM_LED_FrameEngine::begin(PWM_LED_TaskStorage & storage){
+    if (_task != NULL){
+        return !_ending.load();
+    }
+    return _begin(&storage);
+};
+
+void PWM_LED_FrameEngine::end(){
+    if (_task == NULL || _ending.exchange(true)){
+        return;
+    }
+    while (!_ended.load()){
+        xTaskNotifyGive(_task);
+        vTaskDelay(1);
+    }
+    for (uint16_t i = 0; i < _size; i++){
+        _leds[i]->_framed.store(false);
+        _leds[i]->refresh();
+    }
+};
+
+void PWM_LED_FrameEngine::fill(uint16_t level){
+    for (uint16_t i = 0; i < _size; i++){
+        _back[i] = std::min(level, _maxLevels[i]);
+    }
+};
+
+void PWM_LED_FrameEngine::present(){
+    uint32_t parked = _mailbox.exchange(FRAME_FRESH | _backIndex);
+    if (parked & FRAME_FRESH){
+        _dropped.fetch_add(1);
+    }
+    // the presented frame is only read from now on, by the task and by
+    // this copy, so the next frame can start from it
+    uint16_t * presented = _back;
+    _backIndex = parked & FRAME_INDEX_MASK;
+    _back = _frame(_backIndex);
+    memcpy(_back, presented, _size * sizeof(uint16_t));
+};
+
+bool PWM_LED_FrameEngine::wait(uint32_t timeoutMs){
+    uint32_t frames = _frames.load();
+    // the task can only notify one waiter
+    TaskHandle_t none = NULL;
+    if (!_waiter.compare_exchange_strong(none, xTaskGetCurrentTaskHandle())){
+        return false;
+    }
+    uint32_t start = millis();
+    bool shown;
+    while (!(shown = _frames.load() != frames)){
+        uint32_t elapsed = millis() - start;
+        if (timeoutMs != portMAX_DELAY && elapsed >= timeoutMs){
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, timeoutMs == portMAX_DELAY? portMAX_DELAY :
+                pdMS_TO_TICKS(timeoutMs - elapsed) + 1);
+    }
+    _waiter.store(NULL);
+    return shown;
+};
+
+uint32_t PWM_LED_FrameEngine::frames(){
+    return _frames.load();
+};
+
+uint32_t PWM_LED_FrameEngine::dropped(){
+    return _dropped.load();
+};
+
+uint32_t PWM_LED_FrameEngine::writes(){
+    return _writes.load();
+};
+
+uint16_t PWM_LED_FrameEngine::size(){
+    return _size;
+};
+
+uint32_t PWM_LED_FrameEngine::interval(){
+    return _intervalUs;
+};
+
+uint16_t * PWM_LED_FrameEngine::_frame(uint8_t index){
+    return _levels + index * _capacity;
+};
+
+bool PWM_LED_FrameEngine::_begin(PWM_LED_TaskStorage * storage){
+    uint16_t * written = _frame(FRAME_WRITTEN);
+    for (uint16_t i = 0; i < _size; i++){
+        written[i] = 0;
+        _leds[i]->_output(0);
+    }
+    if (!_timer.begin(&_task)){
+        return false;
+    }
+    return PWM_LED_TaskStorage::createTask(storage,
+        this->_runTaskStatic,
+        "LED_FRAMES",
+        this,
+        FRAME_TASK_PRIORITY,
+        &_task);
+};
+
+void PWM_LED_FrameEngine::_run(void){
+    int64_t deadline = esp_timer_get_time();
+    while (!_ending.load()){
+        int64_t now = esp_timer_get_time();
+        if (now >= deadline){
+            if (_mailbox.load() & FRAME_FRESH){
+                _frontIndex = _mailbox.exchange(_frontIndex) & 
+                        FRAME_INDEX_MASK;
+                _show();
+            }
+            // ticks are scheduled at absolute times, so the rate does not
+            // drift; after a long stall the missed ticks are skipped
+            deadline += _intervalUs;
+            if (deadline <= now){
+                deadline = now + _intervalUs;
+            }
+        }
+        _timer.waitUntil(deadline);
+    }
+    _ended.store(true);
+    vTaskDelete(NULL);
+};
+
+void PWM_LED_FrameEngine::_show(){
+    const uint16_t * frame = _frame(_frontIndex);
+    uint16_t * written = _frame(FRAME_WRITTEN);
+    uint32_t writes = 0;
+    for (uint16_t i = 0; i < _size; i++){
+        if (frame[i] != written[i]){
+            written[i] = frame[i];
+            _leds[i]->_output(frame[i]);
+            writes++;
+        }
+    }
+    _writes.fetch_add(writes);
+    _frames.fetch_add(1);
+    TaskHandle_t waiter = _waiter.load();
+    if (waiter != NULL){
+        xTaskNotifyGive(waiter);
+    }
+};
+
+void PWM_LED_FrameEngine::_runTaskStatic(void * _this){
+    static_cast<PWM_LED_FrameEngine*>(_this)->_run();
+};
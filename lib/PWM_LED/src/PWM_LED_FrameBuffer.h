@@ -0,0 +1,232 @@
+/*!
+* @file PWM_LED_FrameBuffer.h
+*
+* @section intro_sec_Introduction
+*
+* Frame-buffer animation: a whole frame of levels for many LEDs, shown at
+* once on a fixed tick.
+*
+* Animating a panel with `on()`, `flash()` and `fadeTo()` takes one call
+* per LED, and the tasks driving the LEDs apply them at slightly different
+* times. A PWM_LED_FrameBuffer<Channels> instead holds a back buffer with
+* one level per LED: the application writes a frame into it with `set()`
+* and calls `present()` to hand it over. The buffers are swapped through
+* the same lock-free triple buffer as LED commands, so the application
+* never waits for the display and the display never reads a frame that is
+* half written.
+*
+* The PWM_LED_FrameEngine task wakes every `intervalUs` on absolute
+* deadlines. If a frame has been presented since the last tick it takes
+* it and writes, in one pass, only the channels whose level has changed.
+* A frame that is replaced by a newer `present()` before a tick shows it
+* is dropped, not queued, and `wait()` blocks until the next frame is
+* shown, like a vsync.
+*
+* While an LED is in a frame buffer the frame buffer owns its output: the
+* LED's own commands still play, but do not reach the PWM channel. The
+* memory is fixed by [Channels]: five levels and one pointer per LED.
+*
+* ``` C++
+* PWM_LED_FrameBuffer<64> panel(10000);           // 100 frames per second
+* for (PWM_LED * led : leds){
+*   panel.add(*led);
+* }
+* panel.begin();
+* for (;;){
+*   for (uint16_t i = 0; i < panel.size(); i++){
+*     panel.set(i, brightnessAt(i, t));
+*   }
+*   panel.present();
+*   panel.wait();
+* }
+* ```
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_FRAME_BUFFER_H__
+#define __PWM_LED_FRAME_BUFFER_H__
+
+#include "PWM_LED.h"
+
+/// The default interval between frame ticks in microseconds: 100 frames
+/// per second. Define before including this header to change it.
+#ifndef PWM_LED_FRAME_INTERVAL_US
+#define PWM_LED_FRAME_INTERVAL_US 10000
+#endif // PWM_LED_FRAME_INTERVAL_US
+
+/// @brief The task that shows the frames of a PWM_LED_FrameBuffer. Holds
+/// no storage of its own; use PWM_LED_FrameBuffer<Channels>.
+class PWM_LED_FrameEngine{
+
+    public:
+
+    /// @brief Adds [led] as the next channel of the frame. Its output is
+    /// taken over at once. Call before `begin()`.
+    /// @param led The LED, which must have been started with `begin()`
+    /// and must outlive the frame buffer.
+    /// @return false if the frame buffer is full.
+    bool add(PWM_LED & led);
+
+    /// @brief Turns every channel off and creates the task.
+    /// @return true if the task is running.
+    bool begin();
+
+    /// @brief Creates the task in statically allocated [storage].
+    bool begin(PWM_LED_TaskStorage & storage);
+
+    /// @brief Stops the task and hands the output of every LED back to
+    /// its own commands, which show their current level at once. Blocks
+    /// until the task has stopped. A frame buffer cannot be started again
+    /// once it has ended.
+    void end();
+
+    /// @brief Sets the level of channel [index] in the back buffer.
+    /// @param level The brightness, clamped to the LED's `maxLevel()`.
+    void set(uint16_t index, uint16_t level){
+        if (index < _size){
+            _back[index] = std::min(level, _maxLevels[index]);
+        }
+    };
+
+    /// @brief The level of channel [index] in the back buffer.
+    uint16_t get(uint16_t index){
+        return index < _size? _back[index] : 0;
+    };
+
+    /// @brief Sets every channel of the back buffer to [level].
+    void fill(uint16_t level);
+
+    /// @brief Hands the back buffer over to be shown at the next tick,
+    /// replacing a presented frame that has not been shown yet. The new
+    /// back buffer starts as a copy of the presented frame. Never blocks;
+    /// call from one task only.
+    void present();
+
+    /// @brief Blocks the calling task until the task shows the next frame.
+    /// Only one task can wait at a time.
+    /// @return false on timeout, or if another task is waiting.
+    bool wait(uint32_t timeoutMs = portMAX_DELAY);
+
+    /// @brief The number of frames shown.
+    uint32_t frames();
+
+    /// @brief The number of presented frames replaced before they were
+    /// shown.
+    uint32_t dropped();
+
+    /// @brief The number of channel writes.
+    uint32_t writes();
+
+    /// @brief The number of channels.
+    uint16_t size();
+
+    /// @brief The interval between ticks in microseconds.
+    uint32_t interval();
+
+    protected:
+
+    /// @param leds Storage for [capacity] LEDs.
+    /// @param levels Storage for 4 x [capacity] levels.
+    /// @param maxLevels Storage for [capacity] levels.
+    PWM_LED_FrameEngine(PWM_LED ** leds,
+            uint16_t * levels,
+            uint16_t * maxLevels,
+            uint16_t capacity,
+            uint32_t intervalUs);
+
+    private:
+
+    PWM_LED ** _leds;
+
+    /// @brief Three frame buffers, then the levels last written.
+    uint16_t * _levels;
+
+    uint16_t * _maxLevels;
+
+    uint16_t _capacity;
+
+    uint16_t _size = 0;
+
+    uint32_t _intervalUs;
+
+    /// @brief The back buffer. Owned by the caller of `present()`.
+    uint16_t * _back;
+
+    /// @brief The index of the back buffer.
+    uint8_t _backIndex = 2;
+
+    /// @brief The index of the front buffer. Owned by the task.
+    uint8_t _frontIndex = 0;
+
+    /// @brief The index of the parked buffer and a fresh flag.
+    std::atomic<uint32_t> _mailbox{1};
+
+    std::atomic<uint32_t> _frames{0};
+
+    std::atomic<uint32_t> _dropped{0};
+
+    std::atomic<uint32_t> _writes{0};
+
+    /// @brief The task blocked in `wait()`, or NULL.
+    std::atomic<TaskHandle_t> _waiter{NULL};
+
+    TaskHandle_t _task = NULL;
+
+    /// @brief Set by `end()` to stop the task.
+    std::atomic<bool> _ending{false};
+
+    /// @brief Set by the task when it has stopped.
+    std::atomic<bool> _ended{false};
+
+    PWM_LED_Timer _timer;
+
+    /// @brief The levels of frame [index].
+    uint16_t * _frame(uint8_t index);
+
+    bool _begin(PWM_LED_TaskStorage * storage);
+
+    /// @brief Shows the presented frames on the ticks.
+    void _run(void);
+
+    /// @brief Writes the channels of the front buffer that have changed.
+    void _show();
+
+    /// @brief The static delegate of [_run].
+    static void _runTaskStatic(void * _this);
+
+};
+
+/// @brief A frame buffer for up to [Channels] LEDs.
+template <uint16_t Channels>
+class PWM_LED_FrameBuffer: public PWM_LED_FrameEngine{
+
+    static_assert(Channels > 0, "A frame buffer has at least one channel.");
+
+    public:
+
+    /// @param intervalUs The interval between ticks in microseconds.
+    PWM_LED_FrameBuffer(uint32_t intervalUs = PWM_LED_FRAME_INTERVAL_US):
+        PWM_LED_FrameEngine(_ledStorage, _levelStorage, _maxLevelStorage,
+                Channels, intervalUs){};
+
+    private:
+
+    PWM_LED * _ledStorage[Channels];
+
+    uint16_t _levelStorage[4 * Channels] = {};
+
+    uint16_t _maxLevelStorage[Channels];
+
+};
+
+#endif // __PWM_LED_FRAME_BUFFER_H__
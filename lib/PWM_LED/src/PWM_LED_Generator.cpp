@@ -0,0 +1,92 @@
+/*!
+* @file PWM_LED_Generator.cpp
+*
+* @section intro_sec_Introduction
+*
+* Flashing sequences that are played in constant RAM.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Generator.h"
+
+bool PWM_LED_CompactPattern::playable() const {
+    uint16_t i = 0;
+    while (i < _size){
+        if (_data[i] == PWM_LED_REPEAT){
+            i += 3;
+        } else if (_data[i] != 0){
+            return true;
+        } else {
+            i++;
+        }
+    }
+    return false;
+};
+
+uint32_t PWM_LED_CompactPattern::cycleUnits() const {
+    if (!playable()){
+        return 0;
+    }
+    PWM_LED_CompactCursor cursor = {};
+    uint32_t units = 0;
+    for (;;){
+        bool wrapped;
+        uint8_t step = cursor.next(*this, wrapped);
+        if (wrapped){
+            return units;
+        }
+        units += step;
+    }
+};
+
+uint8_t PWM_LED_CompactCursor::next(const PWM_LED_CompactPattern & pattern,
+        bool & wrapped){
+    const uint8_t * data = pattern.data();
+    wrapped = false;
+    for (;;){
+        if (blockLeft == 0 && passesLeft > 0){
+            // play the repeat block again
+            passesLeft--;
+            blockLeft = blockLength;
+            position = blockStart;
+        }
+        if (position >= pattern.size()){
+            restart();
+            wrapped = true;
+            continue;
+        }
+        uint8_t value = data[position];
+        if (value == PWM_LED_REPEAT){
+            if (position + 2 >= pattern.size()){
+                // truncated marker
+                position = pattern.size();
+                continue;
+            }
+            if (blockLeft == 0){
+                // markers inside a block are skipped: repeats do not nest
+                uint8_t passes = data[position + 1];
+                blockLength = data[position + 2];
+                blockLeft = blockLength;
+                blockStart = position + 3;
+                passesLeft = passes > 1 && blockLength > 0? passes - 1 : 0;
+            }
+            position += 3;
+            continue;
+        }
+        position++;
+        if (blockLeft > 0){
+            blockLeft--;
+        }
+        return value;
+    }
+};
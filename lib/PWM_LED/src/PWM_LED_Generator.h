@@ -0,0 +1,187 @@
+/*!
+* @file PWM_LED_Generator.h
+*
+* @section intro_sec_Introduction
+*
+* Flashing sequences that are played in constant RAM.
+*
+* A PWM_LED_Pattern is an array of 16-bit step durations of at most 255
+* steps. Two alternatives lift those limits:
+* - PWM_LED_CompactPattern is a byte stream of 8-bit step durations in a
+*   selectable time unit, with run-length repeat markers. It can be a
+*   `static const` array in flash of up to 65535 bytes, is never copied
+*   and can be shared by any number of LEDs; each LED only keeps a small
+*   cursor into it.
+* - PWM_LED_Generator is a pull interface: the task driving the LED asks
+*   it for the duration of the next step whenever the previous step ends,
+*   so a procedurally generated or endless sequence needs no buffer.
+*
+* As with patterns, steps alternate between `on` and `off`, starting with
+* `on`.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_GENERATOR_H__
+#define __PWM_LED_GENERATOR_H__
+
+#include "PWM_LED_HAL.h"
+#include "PWM_LED_Pattern.h"
+
+/// Marks a repeat in a PWM_LED_CompactPattern. It is followed by two
+/// bytes: the number of times to play the block (1 to 255) and the number
+/// of steps in the block (1 to 255), then the block itself. Repeats do
+/// not nest.
+#define PWM_LED_REPEAT 0xFF
+
+/// @brief A sequence of steps produced on demand by the task driving the
+/// LED. The generator is called from that task only, so its state needs
+/// no locking; it must not block.
+class PWM_LED_Generator{
+
+    public:
+
+    /// @brief Rewinds the sequence. Called when `flash()` starts it.
+    virtual void restart(){};
+
+    /// @brief The duration of the next step.
+    /// @return The duration in microseconds, or 0 to end the sequence and
+    /// turn the LED off.
+    virtual uint32_t nextUs() = 0;
+
+};
+
+/// @brief A generator that calls a function for every step.
+class PWM_LED_FunctionGenerator: public PWM_LED_Generator{
+
+    public:
+
+    /// @param next Returns the duration of step [index] in microseconds,
+    /// or 0 to end the sequence.
+    /// @param context Passed to [next].
+    PWM_LED_FunctionGenerator(uint32_t (*next)(void * context, uint32_t index),
+            void * context = NULL):
+        _next(next),
+        _context(context){};
+
+    void restart() override {
+        _index = 0;
+    };
+
+    uint32_t nextUs() override {
+        return _next(_context, _index++);
+    };
+
+    private:
+
+    uint32_t (*_next)(void * context, uint32_t index);
+
+    void * _context;
+
+    uint32_t _index = 0;
+
+};
+
+/// @brief An immutable, compactly encoded flashing sequence. Every byte
+/// other than PWM_LED_REPEAT is a step of 0 to 254 units; the sequence
+/// loops when it reaches its end.
+///
+/// ``` C++
+/// // 10 quick blinks, then 1 s on and 2 s off, in units of 50 ms
+/// static const uint8_t BOOT[] = {PWM_LED_REPEAT, 10, 2,  1, 1,  20, 40};
+/// constexpr PWM_LED_CompactPattern boot(BOOT, 50000);
+/// ```
+class PWM_LED_CompactPattern{
+
+    public:
+
+    /// @brief Wraps a constant byte array without copying it.
+    /// @param data The encoded steps.
+    /// @param unitUs The time unit of the steps in microseconds.
+    template <size_t N>
+    constexpr PWM_LED_CompactPattern(const uint8_t (&data)[N],
+            uint32_t unitUs = PWM_LED_UNIT_MS):
+        PWM_LED_CompactPattern(data, N, unitUs){
+        static_assert(N > 0 && N <= 0xFFFF,
+                "A compact pattern has 1 to 65535 bytes.");
+    };
+
+    /// @brief Wraps [size] encoded bytes at [data] without copying them.
+    /// [unitUs] has no default so that a two-argument call always wraps
+    /// an array.
+    constexpr PWM_LED_CompactPattern(const uint8_t * data,
+            uint16_t size,
+            uint32_t unitUs):
+        _data(data),
+        _size(size),
+        _unitUs(unitUs){};
+
+    /// @brief The encoded steps.
+    constexpr const uint8_t * data() const { return _data; };
+
+    /// @brief The number of encoded bytes.
+    constexpr uint16_t size() const { return _size; };
+
+    /// @brief The time unit of the steps in microseconds.
+    constexpr uint32_t unitUs() const { return _unitUs; };
+
+    /// @brief Whether a cycle of the sequence has a step longer than 0.
+    /// Sequences without one are not played.
+    bool playable() const;
+
+    /// @brief The sum of the steps of a cycle, repeats included. Decodes
+    /// the whole sequence, so it is only called when a sync group member
+    /// starts part-way into a cycle.
+    uint32_t cycleUnits() const;
+
+    private:
+
+    const uint8_t * _data;
+
+    uint16_t _size;
+
+    uint32_t _unitUs;
+
+};
+
+/// @brief The position of an LED in a PWM_LED_CompactPattern.
+typedef struct PWM_LED_CompactCursor{
+
+    /// @brief The offset of the next byte.
+    uint16_t position;
+
+    /// @brief The offset of the first step of the current repeat block.
+    uint16_t blockStart;
+
+    /// @brief The number of steps in the current repeat block.
+    uint8_t blockLength;
+
+    /// @brief The number of steps left in the current pass of the block.
+    uint8_t blockLeft;
+
+    /// @brief The number of passes of the block left after this one.
+    uint8_t passesLeft;
+
+    /// @brief Rewinds the cursor to the start of the sequence.
+    void restart(){
+        *this = {};
+    };
+
+    /// @brief Decodes the next step of [pattern].
+    /// @param pattern A playable pattern.
+    /// @param wrapped Set to true if the sequence wrapped to its start.
+    /// @return The step duration in units.
+    uint8_t next(const PWM_LED_CompactPattern & pattern, bool & wrapped);
+
+}PWM_LED_compact_cursor_t;
+
+#endif // __PWM_LED_GENERATOR_H__
@@ -0,0 +1,39 @@
+/*!
+* @file PWM_LED_HAL.h
+*
+* @section intro_sec_Introduction
+*
+* The hardware abstraction layer of the PWM_LED library.
+*
+* The library only uses a small part of the Arduino, FreeRTOS and ESP-IDF
+* APIs: the LEDC functions, `millis()`, `esp_timer`, task creation and
+* task notifications, and critical sections. On the ESP32 this header
+* includes the real APIs. On any other platform (when `ARDUINO` is not
+* defined) it includes the host backend in `host/PWM_LED_Host.h`, which
+* implements the same calls on std::thread and the system clock and
+* records every `ledcWrite()` as a timestamped event, so the unchanged
+* library can run on a Linux box.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_HAL_H__
+#define __PWM_LED_HAL_H__
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+#else
+#include "host/PWM_LED_Host.h"
+#endif // ARDUINO
+
+#endif // __PWM_LED_HAL_H__
@@ -0,0 +1,74 @@
+/*!
+* @file PWM_LED_IsrQueue.cpp
+*
+* @section intro_sec_Introduction
+*
+* The lock-free ring that carries commands from interrupt handlers to the
+* task driving a PWM_LED.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_IsrQueue.h"
+
+#if PWM_LED_ISR_QUEUE_SIZE > 0
+
+#define ISR_QUEUE_MASK (PWM_LED_ISR_QUEUE_SIZE - 1)
+
+PWM_LED_IsrQueue::PWM_LED_IsrQueue(){
+    for (uint32_t i = 0; i < PWM_LED_ISR_QUEUE_SIZE; i++){
+        _slots[i].turn.store(i);
+    }
+};
+
+bool IRAM_ATTR PWM_LED_IsrQueue::push(const PWM_LED_IsrCommand & command){
+    uint32_t position = _tail.load(std::memory_order_relaxed);
+    _slot_t * slot;
+    for (;;){
+        slot = &_slots[position & ISR_QUEUE_MASK];
+        int32_t lead = (int32_t)(slot->turn.load(std::memory_order_acquire) -
+                position);
+        if (lead == 0){
+            // the slot is free: claim it, unless another producer did
+            if (_tail.compare_exchange_weak(position, position + 1,
+                    std::memory_order_relaxed)){
+                break;
+            }
+        } else if (lead < 0){
+            // the task has not read the slot of the previous lap yet
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = _tail.load(std::memory_order_relaxed);
+        }
+    }
+    slot->command = command;
+    slot->turn.store(position + 1, std::memory_order_release);
+    return true;
+};
+
+bool PWM_LED_IsrQueue::pop(PWM_LED_IsrCommand & command){
+    _slot_t & slot = _slots[_head & ISR_QUEUE_MASK];
+    if (slot.turn.load(std::memory_order_acquire) != _head + 1){
+        return false;
+    }
+    command = slot.command;
+    slot.turn.store(_head + PWM_LED_ISR_QUEUE_SIZE, std::memory_order_release);
+    _head++;
+    return true;
+};
+
+uint32_t PWM_LED_IsrQueue::dropped(){
+    return _dropped.load();
+};
+
+#endif // PWM_LED_ISR_QUEUE_SIZE
@@ -0,0 +1,150 @@
+/*!
+* @file PWM_LED_IsrQueue.h
+*
+* @section intro_sec_Introduction
+*
+* The lock-free ring that carries commands from interrupt handlers to the
+* task driving a PWM_LED.
+*
+* `on()`, `off()` and `flash()` may take the pattern registry lock and
+* call task-level FreeRTOS functions, so they cannot be called from an
+* ISR. `onFromISR()`, `offFromISR()` and `flashFromISR()` instead push a
+* fixed-size command into a bounded multi-producer, single-consumer ring
+* (after D. Vyukov's bounded queue) and wake the task with
+* `vTaskNotifyGiveFromISR()`. A push takes no lock and never blocks: it
+* claims a slot with one compare-and-swap, which is only retried when
+* another ISR, on the other core or nesting above it, claims the same
+* slot at the same moment, and fails at once if the ring is full.
+*
+* The task drains the ring when it wakes, in the same pass as the command
+* mailbox. Commands from ISRs and from tasks share one sequence, so when
+* both arrive in one wakeup the newest wins whichever path it came by.
+*
+* PWM_LED_ISR_QUEUE_SIZE can be defined as 0 for the whole build to leave
+* the ring out of LEDs that are never driven from ISRs; every `FromISR()`
+* call then returns false and is counted as dropped.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_ISR_QUEUE_H__
+#define __PWM_LED_ISR_QUEUE_H__
+
+#include "PWM_LED_Command.h"
+#include <atomic>
+
+/// The number of commands from ISRs that each LED can hold before its
+/// task drains them, a power of two, or 0 to leave the ring out. Define
+/// for the whole build to change it, for example with
+/// `-D PWM_LED_ISR_QUEUE_SIZE=4`.
+#ifndef PWM_LED_ISR_QUEUE_SIZE
+#define PWM_LED_ISR_QUEUE_SIZE 2
+#endif // PWM_LED_ISR_QUEUE_SIZE
+
+/// @brief A command pushed by an ISR.
+typedef struct PWM_LED_IsrCommand{
+
+    /// @brief The pattern of an LED_FLASHING command.
+    const PWM_LED_Pattern * pattern;
+
+    /// @brief The sequence number of the command.
+    uint32_t sequence;
+
+    /// @brief LED_ON, LED_OFF or LED_FLASHING.
+    led_state_t state;
+
+    #ifdef PWM_LED_METRICS
+    /// @brief The `esp_timer_get_time()` time of the push.
+    int64_t publishedUs;
+    #endif // PWM_LED_METRICS
+
+}PWM_LED_isr_command_t;
+
+#if PWM_LED_ISR_QUEUE_SIZE > 0
+
+/// @brief A bounded lock-free ring written by ISRs and read by one task.
+class PWM_LED_IsrQueue{
+
+    static_assert(PWM_LED_ISR_QUEUE_SIZE >= 2 &&
+            (PWM_LED_ISR_QUEUE_SIZE & (PWM_LED_ISR_QUEUE_SIZE - 1)) == 0,
+            "PWM_LED_ISR_QUEUE_SIZE is a power of two.");
+
+    public:
+
+    PWM_LED_IsrQueue();
+
+    /// @brief Adds [command]. Safe in an ISR and in any task.
+    /// @return false if the ring is full.
+    bool push(const PWM_LED_IsrCommand & command);
+
+    /// @brief Takes the oldest command. Called by the task only.
+    /// @return false if the ring is empty.
+    bool pop(PWM_LED_IsrCommand & command);
+
+    /// @brief The number of commands dropped because the ring was full.
+    uint32_t dropped();
+
+    private:
+
+    typedef struct{
+
+        /// @brief Equals the position of the slot when it is free for a
+        /// producer, and the position + 1 when it holds a command.
+        std::atomic<uint32_t> turn;
+
+        PWM_LED_IsrCommand command;
+
+    } _slot_t;
+
+    _slot_t _slots[PWM_LED_ISR_QUEUE_SIZE];
+
+    /// @brief The next position to write, claimed by producers.
+    std::atomic<uint32_t> _tail{0};
+
+    /// @brief The next position to read. Owned by the task.
+    uint32_t _head = 0;
+
+    std::atomic<uint32_t> _dropped{0};
+
+};
+
+#else // PWM_LED_ISR_QUEUE_SIZE
+
+/// @brief The ring left out: it refuses every command.
+class PWM_LED_IsrQueue{
+
+    public:
+
+    /// @brief Counts [command] as dropped. Safe in an ISR and in any task.
+    /// @return false: the ring is always full.
+    bool push(const PWM_LED_IsrCommand & /* command */){
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    };
+
+    bool pop(PWM_LED_IsrCommand & /* command */){
+        return false;
+    };
+
+    uint32_t dropped(){
+        return _dropped.load();
+    };
+
+    private:
+
+    std::atomic<uint32_t> _dropped{0};
+
+};
+
+#endif // PWM_LED_ISR_QUEUE_SIZE
+
+#endif // __PWM_LED_ISR_QUEUE_H__
@@ -0,0 +1,83 @@
+/*!
+* @file PWM_LED_Metrics.cpp
+*
+* @section intro_sec_Introduction
+*
+* Compile-time gated instrumentation of the task that drives a PWM_LED.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Metrics.h"
+#include <algorithm>
+
+#ifdef PWM_LED_METRICS
+
+/// @brief The histogram bucket of [value]: 0 for 0, otherwise the number
+/// of significant bits, capped at the last bucket.
+static uint8_t _bucket(uint32_t value){
+    uint8_t bits = 0;
+    while (value != 0 && bits < PWM_LED_METRICS_BUCKETS - 1){
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+};
+
+PWM_LED_metrics_t PWM_LED_Metrics::snapshot(){
+    portENTER_CRITICAL(&_lock);
+    _drain();
+    PWM_LED_metrics_t metrics = _totals;
+    metrics.wakeups = _wakeups.load() - _base.wakeups;
+    metrics.restarts = _restarts.load() - _base.restarts;
+    metrics.resyncs = _resyncs.load() - _base.resyncs;
+    metrics.dropped = _dropped.load() - _base.dropped;
+    metrics.stackHighWaterMark = _stack.load();
+    portEXIT_CRITICAL(&_lock);
+    return metrics;
+};
+
+void PWM_LED_Metrics::reset(){
+    portENTER_CRITICAL(&_lock);
+    _drain();
+    _totals = {};
+    _base.wakeups = _wakeups.load();
+    _base.restarts = _restarts.load();
+    _base.resyncs = _resyncs.load();
+    _base.dropped = _dropped.load();
+    portEXIT_CRITICAL(&_lock);
+};
+
+void PWM_LED_Metrics::_drain(){
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t head = _head.load(std::memory_order_acquire);
+    while (tail != head){
+        uint32_t sample = _ring[tail % PWM_LED_METRICS_RING_SIZE].load(
+                std::memory_order_relaxed);
+        int32_t value = sample & SAMPLE_VALUE_MASK;
+        if ((sample >> SAMPLE_SHIFT) == LATENESS){
+            _totals.edges++;
+            _totals.latenessHistogram[_bucket(value)]++;
+            _totals.maxLatenessUs = std::max(_totals.maxLatenessUs, value);
+        } else {
+            _totals.commands++;
+            _totals.commandLatencyHistogram[_bucket(value)]++;
+            _totals.maxCommandLatencyUs =
+                    std::max(_totals.maxCommandLatencyUs, value);
+        }
+        tail++;
+    }
+    // hand the slots back to the task
+    _tail.store(tail, std::memory_order_release);
+};
+
+#endif // PWM_LED_METRICS
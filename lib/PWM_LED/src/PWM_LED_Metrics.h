@@ -0,0 +1,233 @@
+/*!
+* @file PWM_LED_Metrics.h
+*
+* @section intro_sec_Introduction
+*
+* Compile-time gated instrumentation of the task that drives a PWM_LED.
+*
+* When `PWM_LED_METRICS` is defined (add `-DPWM_LED_METRICS` to
+* `build_flags` so that every translation unit sees the same class
+* layout), each LED records what its task does:
+* - the lateness of every edge and the latency from a command call to the
+*   output it causes are pushed into a lock-free single-producer ring
+*   buffer and aggregated into log2 histograms when the metrics are read;
+* - wakeups, pattern restarts and resyncs are counted by the task;
+* - the stack high-water mark of the driving task is sampled on every
+*   command.
+*
+* Recording never blocks and never prints. The ring is drained by
+* `PWM_LED::metrics()` in the caller's context. If the ring fills up
+* between two reads, samples are dropped and counted.
+*
+* When `PWM_LED_METRICS` is not defined, `PWM_LED_METRIC()` expands to
+* nothing, the LED holds no metrics state and `PWM_LED::metrics()`
+* returns zeros.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_METRICS_H__
+#define __PWM_LED_METRICS_H__
+
+#include "PWM_LED_HAL.h"
+#include <atomic>
+
+/// The number of samples the ring buffer of each LED holds between two
+/// reads of the metrics (a power of two). Define before including this
+/// header to change it.
+#ifndef PWM_LED_METRICS_RING_SIZE
+#define PWM_LED_METRICS_RING_SIZE 32
+#endif // PWM_LED_METRICS_RING_SIZE
+
+/// The number of histogram buckets. Bucket 0 counts values of 0 us or
+/// less, bucket n counts values from 2^(n-1) to 2^n - 1 us and the last
+/// bucket counts everything larger.
+#define PWM_LED_METRICS_BUCKETS 16
+
+#ifdef PWM_LED_METRICS
+#define PWM_LED_METRIC(statement) statement
+#else
+#define PWM_LED_METRIC(statement)
+#endif // PWM_LED_METRICS
+
+/// @brief The metrics of one LED, as returned by `PWM_LED::metrics()`.
+typedef struct PWM_LED_MetricsSnapshot{
+
+    /// @brief The number of edges played.
+    uint32_t edges;
+
+    /// @brief The largest edge lateness in microseconds.
+    int32_t maxLatenessUs;
+
+    /// @brief Histogram of the edge lateness.
+    uint32_t latenessHistogram[PWM_LED_METRICS_BUCKETS];
+
+    /// @brief The number of commands applied.
+    uint32_t commands;
+
+    /// @brief The largest command-to-output latency in microseconds.
+    int32_t maxCommandLatencyUs;
+
+    /// @brief Histogram of the command-to-output latency.
+    uint32_t commandLatencyHistogram[PWM_LED_METRICS_BUCKETS];
+
+    /// @brief The number of times the driving task serviced the LED.
+    uint32_t wakeups;
+
+    /// @brief The number of times a `flash()` command started the pattern.
+    uint32_t restarts;
+
+    /// @brief The number of times an edge was so late that the pattern
+    /// cycle was restarted from the current time.
+    uint32_t resyncs;
+
+    /// @brief The lowest stack high-water mark of the driving task seen
+    /// so far, as reported by `uxTaskGetStackHighWaterMark()`, or 0 if
+    /// no command was applied yet.
+    uint32_t stackHighWaterMark;
+
+    /// @brief The number of samples dropped because the ring was full.
+    uint32_t dropped;
+
+}PWM_LED_metrics_t;
+
+#ifdef PWM_LED_METRICS
+
+/// @brief The per-LED recorder. The record methods are called by the task
+/// driving the LED only; `snapshot()` and `reset()` may be called from
+/// any task.
+class PWM_LED_Metrics{
+
+    public:
+
+    /// @brief Records the lateness of an edge.
+    void edge(int64_t latenessUs){
+        _push(LATENESS, latenessUs);
+    };
+
+    /// @brief Records the latency from a command call to its output.
+    void command(int64_t latencyUs){
+        _push(LATENCY, latencyUs);
+    };
+
+    /// @brief Counts a wakeup of the driving task.
+    void wakeup(){
+        _increment(_wakeups);
+    };
+
+    /// @brief Counts a pattern started by `flash()`.
+    void restart(){
+        _increment(_restarts);
+    };
+
+    /// @brief Counts a pattern cycle restarted because an edge was late.
+    void resync(){
+        _increment(_resyncs);
+    };
+
+    /// @brief Records the stack high-water mark of the calling task.
+    void sampleStack(){
+        uint32_t mark = uxTaskGetStackHighWaterMark(NULL);
+        uint32_t lowest = _stack.load(std::memory_order_relaxed);
+        if (lowest == 0 || mark < lowest){
+            _stack.store(mark, std::memory_order_relaxed);
+        }
+    };
+
+    /// @brief Drains the ring buffer into the histograms.
+    /// @return The metrics recorded since the last `reset()`.
+    PWM_LED_metrics_t snapshot();
+
+    /// @brief Discards the recorded samples and zeroes the counters. The
+    /// stack high-water mark is kept.
+    void reset();
+
+    private:
+
+    /// @brief The sample types, stored in the top bits of a ring entry.
+    enum Sample{
+        LATENESS = 0,
+        LATENCY = 1,
+    };
+
+    static const uint32_t SAMPLE_SHIFT = 31;
+
+    static const uint32_t SAMPLE_VALUE_MASK = 0x7FFFFFFF;
+
+    /// @brief The sample ring. Entries are atomic so that the reader
+    /// never sees a torn sample.
+    std::atomic<uint32_t> _ring[PWM_LED_METRICS_RING_SIZE] = {};
+
+    /// @brief The number of samples written. Written by the task only.
+    std::atomic<uint32_t> _head{0};
+
+    /// @brief The number of samples read. Written by the reader only.
+    std::atomic<uint32_t> _tail{0};
+
+    std::atomic<uint32_t> _dropped{0};
+
+    std::atomic<uint32_t> _wakeups{0};
+
+    std::atomic<uint32_t> _restarts{0};
+
+    std::atomic<uint32_t> _resyncs{0};
+
+    std::atomic<uint32_t> _stack{0};
+
+    /// @brief The aggregated samples. Guarded by [_lock].
+    PWM_LED_metrics_t _totals = {};
+
+    /// @brief The counter values at the last `reset()`. Guarded by [_lock].
+    PWM_LED_metrics_t _base = {};
+
+    /// @brief Serializes readers. Never taken by the task.
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    /// @brief Adds one to a counter that only the task writes, without a
+    /// read-modify-write instruction.
+    static void _increment(std::atomic<uint32_t> & counter){
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    };
+
+    /// @brief Appends a sample to the ring, or counts it as dropped if the
+    /// ring is full.
+    void _push(Sample type, int64_t value){
+        static_assert((PWM_LED_METRICS_RING_SIZE &
+                (PWM_LED_METRICS_RING_SIZE - 1)) == 0,
+                "PWM_LED_METRICS_RING_SIZE must be a power of two");
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >=
+                PWM_LED_METRICS_RING_SIZE){
+            _increment(_dropped);
+            return;
+        }
+        if (value < 0){
+            value = 0;
+        } else if (value > SAMPLE_VALUE_MASK){
+            value = SAMPLE_VALUE_MASK;
+        }
+        _ring[head % PWM_LED_METRICS_RING_SIZE].store(
+                ((uint32_t)type << SAMPLE_SHIFT) | (uint32_t)value,
+                std::memory_order_relaxed);
+        _head.store(head + 1, std::memory_order_release);
+    };
+
+    /// @brief Moves the samples in the ring into [_totals]. Called with
+    /// [_lock] held.
+    void _drain();
+
+};
+
+#endif // PWM_LED_METRICS
+
+#endif // __PWM_LED_METRICS_H__
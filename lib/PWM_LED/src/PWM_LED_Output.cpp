@@ -0,0 +1,112 @@
+/*!
+* @file PWM_LED_Output.cpp
+*
+* @section intro_sec_Introduction
+*
+* Pluggable output backends of PWM_LED.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Output.h"
+#include "PWM_LED.h"
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <driver/ledc.h>
+#ifndef PWM_LED_NO_HW_FADE
+#define PWM_LED_HW_FADE
+#endif // PWM_LED_NO_HW_FADE
+#endif // ARDUINO_ARCH_ESP32
+
+bool PWM_LED_Output::attach(uint8_t pin, 
+        uint8_t channel, 
+        uint8_t resolution, 
+        uint32_t frequency){
+    return resolution == PWM_LED_PWM_RESOLUTION && 
+            frequency == PWM_LED_PWM_FREQ && 
+            attach(pin, channel);
+};
+
+PWM_LED_LEDC & PWM_LED_LEDC::shared(){
+    static PWM_LED_LEDC ledc;
+    return ledc;
+};
+
+bool PWM_LED_LEDC::attach(uint8_t pin, uint8_t channel){
+    return attach(pin, channel, PWM_LED_PWM_RESOLUTION, PWM_LED_PWM_FREQ);
+};
+
+bool PWM_LED_LEDC::attach(uint8_t pin, 
+        uint8_t channel, 
+        uint8_t resolution, 
+        uint32_t frequency){
+    if (channel >= PWM_LED_LEDC_CHANNELS || 
+            ledcSetup(channel, frequency, resolution) == 0){
+        return false;
+    }
+    _frequency[channel] = frequency;
+    ledcAttachPin(pin, channel);
+    return true;
+};
+
+void PWM_LED_LEDC::write(uint8_t channel, uint32_t duty){
+    ledcWrite(channel, duty);
+};
+
+bool PWM_LED_LEDC::fade(uint8_t channel,
+        uint32_t fromDuty,
+        uint32_t toDuty,
+        int64_t durationUs){
+    #ifdef PWM_LED_HW_FADE
+    // the LEDC steps the duty by [scale] every [cycles] PWM periods
+    uint32_t delta = toDuty > fromDuty? toDuty - fromDuty : fromDuty - toDuty;
+    uint32_t periods = durationUs * _frequency[channel] / 1000000;
+    if (delta == 0 || periods == 0){
+        return delta == 0;
+    }
+    uint32_t steps = std::min(std::min(delta, periods), (uint32_t)0x3FF);
+    uint32_t scale = std::min(delta / steps, (uint32_t)0x3FF);
+    uint32_t cycles = std::min(std::max(periods / steps, (uint32_t)1),
+            (uint32_t)0x3FF);
+    ledc_mode_t mode = (ledc_mode_t)(channel / 8);
+    ledc_channel_t ledcChannel = (ledc_channel_t)(channel % 8);
+    if (ledc_set_fade(mode, ledcChannel, fromDuty,
+            toDuty > fromDuty? LEDC_DUTY_DIR_INCREASE : LEDC_DUTY_DIR_DECREASE,
+            steps, cycles, scale) != ESP_OK){
+        return false;
+    }
+    return ledc_update_duty(mode, ledcChannel) == ESP_OK;
+    #else
+    (void)channel;
+    (void)fromDuty;
+    (void)toDuty;
+    (void)durationUs;
+    return false;
+    #endif // PWM_LED_HW_FADE
+};
+
+bool PWM_LED_LEDC::shareTimer(uint8_t channel, uint8_t source){
+    #ifdef ARDUINO_ARCH_ESP32
+    // the Arduino core clocks channel n from LEDC timer (n / 2) % 4 of
+    // speed group n / 8; channels in the same group can share a timer
+    if (channel / 8 != source / 8){
+        return false;
+    }
+    return ledc_bind_channel_timer((ledc_mode_t)(source / 8),
+            (ledc_channel_t)(channel % 8),
+            (ledc_timer_t)((source / 2) % 4)) == ESP_OK;
+    #else
+    (void)channel;
+    (void)source;
+    return false;
+    #endif // ARDUINO_ARCH_ESP32
+};
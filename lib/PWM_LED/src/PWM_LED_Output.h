@@ -0,0 +1,124 @@
+/*!
+* @file PWM_LED_Output.h
+*
+* @section intro_sec_Introduction
+*
+* Pluggable output backends of PWM_LED.
+*
+* A PWM_LED computes a duty cycle (at PWM_LED_PWM_RESOLUTION bits, or at
+* the resolution of a PWM_LED_Fixed) and hands it to the PWM_LED_Output it
+* was constructed with. The default
+* backend, PWM_LED_LEDC, writes the duty to an LEDC channel of the ESP32
+* and ramps fades with the LEDC hardware fade. Other backends, such as the
+* bit-angle modulation engine in PWM_LED_BAM.h, drive LEDs that have no
+* LEDC channel of their own; the PWM_LED API is the same for all of them.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_OUTPUT_H__
+#define __PWM_LED_OUTPUT_H__
+
+#include "PWM_LED_HAL.h"
+
+/// The number of LEDC channels.
+#define PWM_LED_LEDC_CHANNELS 16
+
+/// @brief The interface between a PWM_LED and the hardware that produces
+/// its PWM signal. [channel] is the channel number the LED was
+/// constructed with; its meaning is up to the backend.
+class PWM_LED_Output{
+
+    public:
+
+    /// @brief Prepares [channel] for output on GPIO [pin]. Called by
+    /// `PWM_LED::begin()`.
+    /// @return false if the channel cannot be used.
+    virtual bool attach(uint8_t pin, uint8_t channel) = 0;
+
+    /// @brief Prepares [channel] for output on GPIO [pin] at [resolution]
+    /// bits and [frequency] Hz. Called by `PWM_LED_Fixed::begin()`. The
+    /// default only accepts PWM_LED_PWM_RESOLUTION and PWM_LED_PWM_FREQ.
+    /// @param resolution The duty resolution; `write()` receives duties
+    /// of 0 to 2^resolution - 1 for the channel.
+    /// @param frequency The PWM frequency.
+    /// @return false if the channel cannot be used with these settings.
+    virtual bool attach(uint8_t pin, 
+            uint8_t channel, 
+            uint8_t resolution, 
+            uint32_t frequency);
+
+    /// @brief Sets the duty cycle of [channel]. Called by the task driving
+    /// the LED; must not block.
+    /// @param channel The channel.
+    /// @param duty The duty cycle, 0 to PWM_LED_PWM_MAX_DUTY_CYCLE or to
+    /// the maximum of the resolution the channel was attached with.
+    virtual void write(uint8_t channel, uint32_t duty) = 0;
+
+    /// @brief Ramps the duty cycle of [channel] from [fromDuty] to
+    /// [toDuty] over [durationUs] in hardware.
+    /// @return false if the backend cannot fade in hardware, in which case
+    /// the LED fades in software.
+    virtual bool fade(uint8_t /* channel */,
+            uint32_t /* fromDuty */,
+            uint32_t /* toDuty */,
+            int64_t /* durationUs */){
+        return false;
+    };
+
+};
+
+/// @brief The default backend: one LEDC channel of the ESP32 per LED.
+class PWM_LED_LEDC: public PWM_LED_Output{
+
+    public:
+
+    /// @brief The backend used by LEDs constructed without one.
+    static PWM_LED_LEDC & shared();
+
+    /// @brief Sets up the LEDC channel at PWM_LED_PWM_FREQ and
+    /// PWM_LED_PWM_RESOLUTION and attaches [pin] to it.
+    bool attach(uint8_t pin, uint8_t channel) override;
+
+    /// @brief Sets up the LEDC channel at [frequency] and [resolution] and
+    /// attaches [pin] to it. Channels 2n and 2n + 1 share an LEDC timer,
+    /// so they must use the same settings.
+    /// @return false if the LEDC cannot produce the frequency at the
+    /// resolution.
+    bool attach(uint8_t pin, 
+            uint8_t channel, 
+            uint8_t resolution, 
+            uint32_t frequency) override;
+
+    void write(uint8_t channel, uint32_t duty) override;
+
+    /// @brief Programs the LEDC gradient of [channel] directly, so that a
+    /// later `write()` overrides it without waiting for the fade.
+    bool fade(uint8_t channel,
+            uint32_t fromDuty,
+            uint32_t toDuty,
+            int64_t durationUs) override;
+
+    /// @brief Clocks [channel] from the LEDC timer of [source] so that
+    /// both share one PWM period. Only possible within a speed group.
+    /// @return false if the channels cannot share a timer.
+    bool shareTimer(uint8_t channel, uint8_t source);
+
+    private:
+
+    /// @brief The PWM frequency of each channel, which sets the step rate
+    /// of hardware fades.
+    uint32_t _frequency[PWM_LED_LEDC_CHANNELS] = {};
+
+};
+
+#endif // __PWM_LED_OUTPUT_H__
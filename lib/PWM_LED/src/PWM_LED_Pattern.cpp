@@ -0,0 +1,139 @@
+/*!
+* @file PWM_LED_Pattern.cpp
+*
+* @section intro_sec_Introduction
+*
+* Immutable flashing patterns and the registry that interns them.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Pattern.h"
+#include <algorithm>
+
+PWM_LED_Patterns::Entry PWM_LED_Patterns::_entries[PWM_LED_PATTERN_REGISTRY_SIZE];
+
+portMUX_TYPE PWM_LED_Patterns::_mux = portMUX_INITIALIZER_UNLOCKED;
+
+const PWM_LED_Pattern * PWM_LED_Patterns::intern(const uint16_t * steps,
+        uint8_t length,
+        uint16_t unitUs){
+#if PWM_LED_PATTERN_REGISTRY_STEPS > 0
+    if (length > PWM_LED_PATTERN_REGISTRY_STEPS){
+        return NULL;
+    }
+#endif
+    uint32_t hash = _hash(steps, length, unitUs);
+    Entry * free = NULL;
+    // entries before [next] have been compared and did not match
+    uint8_t next = 0;
+    while (true){
+        Entry * candidate = NULL;
+        free = NULL;
+        portENTER_CRITICAL(&_mux);
+        for (uint8_t i = 0; i < PWM_LED_PATTERN_REGISTRY_SIZE; i++){
+            Entry & entry = _entries[i];
+            if (i >= next &&
+                entry.hash == hash &&
+                entry.pattern._length == length &&
+                entry.pattern._unitUs == unitUs){
+                // the reference keeps the slot from being rewritten
+                // while its steps are compared outside the lock
+                entry.refs++;
+                candidate = &entry;
+                next = i + 1;
+                break;
+            }
+            if (entry.refs == 0 && (free == NULL || entry.hash == 0)){
+                free = &entry;
+            }
+        }
+        if (candidate == NULL && free != NULL){
+            // reserve the slot so that no other caller matches or reuses it
+            free->hash = 0;
+            free->refs = 1;
+        }
+        portEXIT_CRITICAL(&_mux);
+        if (candidate == NULL){
+            break;
+        }
+        if (std::equal(steps, steps + length, candidate->buffer)){
+            return &candidate->pattern;
+        }
+        // a hash collision
+        candidate->refs--;
+    }
+    if (free == NULL){
+        return NULL;
+    }
+    // the slot is reserved, so the buffer can be (re)allocated and written
+    // outside the critical section
+#if PWM_LED_PATTERN_REGISTRY_STEPS == 0
+    if (free->capacity < length){
+        delete[] free->buffer;
+        free->buffer = new uint16_t[length];
+        free->capacity = length;
+    }
+#endif
+    std::copy(steps, steps + length, free->buffer);
+    PWM_LED_Pattern pattern(free->buffer, length, unitUs);
+    portENTER_CRITICAL(&_mux);
+    free->pattern = pattern;
+    free->hash = hash;
+    portEXIT_CRITICAL(&_mux);
+    return &free->pattern;
+};
+
+void PWM_LED_Patterns::acquire(const PWM_LED_Pattern * pattern){
+    Entry * entry = _entry(pattern);
+    if (entry != NULL){
+        entry->refs++;
+    }
+};
+
+void PWM_LED_Patterns::release(const PWM_LED_Pattern * pattern){
+    Entry * entry = _entry(pattern);
+    if (entry != NULL){
+        entry->refs--;
+    }
+};
+
+uint8_t PWM_LED_Patterns::size(){
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < PWM_LED_PATTERN_REGISTRY_SIZE; i++){
+        if (_entries[i].refs > 0){
+            count++;
+        }
+    }
+    return count;
+};
+
+PWM_LED_Patterns::Entry * PWM_LED_Patterns::_entry(const PWM_LED_Pattern * pattern){
+    uintptr_t offset = (uintptr_t)pattern - (uintptr_t)_entries;
+    if ((uintptr_t)pattern < (uintptr_t)_entries || 
+        offset >= sizeof(_entries)){
+        return NULL;
+    }
+    Entry * entry = &_entries[offset / sizeof(Entry)];
+    return &entry->pattern == pattern? entry : NULL;
+};
+
+uint32_t PWM_LED_Patterns::_hash(const uint16_t * steps,
+        uint8_t length,
+        uint16_t unitUs){
+    uint32_t hash = 2166136261U;
+    hash = (hash ^ unitUs) * 16777619U;
+    for (uint8_t i = 0; i < length; i++){
+        hash = (hash ^ steps[i]) * 16777619U;
+    }
+    return hash == 0? 1 : hash;
+};
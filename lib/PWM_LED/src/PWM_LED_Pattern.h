@@ -0,0 +1,371 @@
+/*!
+* @file PWM_LED_Pattern.h
+*
+* @section intro_sec_Introduction
+*
+* Immutable flashing patterns and the registry that interns them.
+*
+* A PWM_LED_Pattern is a handle to an array of step durations that is
+* never copied by the LED. Patterns built from constant arrays can be
+* declared `constexpr` and live in flash. Patterns supplied at run time
+* are copied once into the PWM_LED_Patterns registry, which deduplicates
+* identical patterns by hash and reference-counts them, so any number of
+* LEDs playing the same pattern share one copy.
+*
+* `PWM_LED_morse()` and `PWM_LED_blinkCode()` build patterns at compile
+* time (C++14 or later), so they can be declared `constexpr` and played 
+* with no construction cost and no RAM copy.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_PATTERN_H__
+#define __PWM_LED_PATTERN_H__
+
+#include "PWM_LED_HAL.h"
+#include <atomic>
+
+/// Pattern time unit of one millisecond, in microseconds (the default).
+#define PWM_LED_UNIT_MS 1000U
+
+/// Pattern time unit of 100 microseconds, for fast strobe patterns.
+#define PWM_LED_UNIT_100US 100U
+
+/// The number of distinct run-time patterns the registry can hold. Define
+/// before including this header to change it.
+#ifndef PWM_LED_PATTERN_REGISTRY_SIZE
+#define PWM_LED_PATTERN_REGISTRY_SIZE 16
+#endif // PWM_LED_PATTERN_REGISTRY_SIZE
+
+/// The number of steps each registry slot holds in place. The default, 0,
+/// allocates the steps of a pattern on the heap the first time its slot
+/// holds one that long; a non-zero size never allocates and rejects longer
+/// patterns. Define before including this header to change it.
+#ifndef PWM_LED_PATTERN_REGISTRY_STEPS
+#define PWM_LED_PATTERN_REGISTRY_STEPS 0
+#endif // PWM_LED_PATTERN_REGISTRY_STEPS
+
+/// @brief A fixed-size array of step durations built at compile time by
+/// `PWM_LED_morse()` or `PWM_LED_blinkCode()`. [N] is the capacity; only
+/// the first [length] steps are used.
+template <size_t N>
+struct PWM_LED_Steps{
+
+    /// @brief The step durations in units of [unitUs].
+    uint16_t steps[N];
+
+    /// @brief The number of steps used.
+    uint8_t length;
+
+    /// @brief The time unit of [steps] in microseconds.
+    uint16_t unitUs;
+
+};
+
+/// @brief An immutable flashing pattern: a sequence of step durations in
+/// which the even-index steps are `on` and the odd-index steps are `off`.
+class PWM_LED_Pattern{
+
+    public:
+
+    /// @brief Wraps a constant array of [N] step durations without
+    /// copying it. The array must outlive every LED that plays it.
+    /// @param steps The step durations in units of [unitUs].
+    /// @param unitUs The time unit of [steps] in microseconds.
+    template <size_t N>
+    constexpr PWM_LED_Pattern(const uint16_t (&steps)[N],
+            uint16_t unitUs = PWM_LED_UNIT_MS):
+        PWM_LED_Pattern(steps, N, unitUs){
+        static_assert(N > 0 && N <= 255, "A pattern has 1 to 255 steps.");
+    };
+
+    /// @brief Wraps [length] step durations at [steps] without copying
+    /// them. The array must outlive every LED that plays it.
+    /// @param steps The step durations in units of [unitUs].
+    /// @param length The number of steps, at most 255.
+    /// @param unitUs The time unit of [steps] in microseconds. Not
+    /// defaulted, so that `PWM_LED_Pattern(array, unitUs)` cannot resolve
+    /// to this constructor.
+    constexpr PWM_LED_Pattern(const uint16_t * steps,
+            uint8_t length,
+            uint16_t unitUs):
+        _steps(steps),
+        _length(length),
+        _unitUs(unitUs),
+        _cycleUnits(_sum(steps, length)),
+        _rampOn(0),
+        _rampOff(0){};
+
+    /// @brief Wraps steps built by `PWM_LED_morse()` or 
+    /// `PWM_LED_blinkCode()` without copying them. [steps] must outlive
+    /// every LED that plays it, so declare it `constexpr` or `static`.
+    /// @param steps The compile-time pattern.
+    template <size_t N>
+    constexpr PWM_LED_Pattern(const PWM_LED_Steps<N> & steps):
+        PWM_LED_Pattern(steps.steps, steps.length, steps.unitUs){};
+
+    /// @brief The step durations.
+    constexpr const uint16_t * steps() const { return _steps; };
+
+    /// @brief The number of steps.
+    constexpr uint8_t length() const { return _length; };
+
+    /// @brief The time unit of the steps in microseconds.
+    constexpr uint16_t unitUs() const { return _unitUs; };
+
+    /// @brief The duration of one cycle of the pattern in microseconds.
+    constexpr int64_t cycleUs() const {
+        return (int64_t)_cycleUnits * _unitUs;
+    };
+
+    /// @brief A copy of the pattern with soft edges: every `on` step fades
+    /// in over [rampOn] and every `off` step fades out over [rampOff], in
+    /// units of [unitUs]. A ramp is cut short by the end of its step.
+    /// @param rampOn The fade-in time of the `on` steps.
+    /// @param rampOff The fade-out time of the `off` steps.
+    constexpr PWM_LED_Pattern withRamps(uint16_t rampOn, 
+            uint16_t rampOff) const {
+        return PWM_LED_Pattern(*this, rampOn, rampOff);
+    };
+
+    /// @brief The fade-in time of the `on` steps in microseconds.
+    constexpr int64_t rampOnUs() const {
+        return (int64_t)_rampOn * _unitUs;
+    };
+
+    /// @brief The fade-out time of the `off` steps in microseconds.
+    constexpr int64_t rampOffUs() const {
+        return (int64_t)_rampOff * _unitUs;
+    };
+
+    private:
+
+    friend class PWM_LED_Patterns;
+
+    /// @brief Copies [pattern] with new ramp times.
+    constexpr PWM_LED_Pattern(const PWM_LED_Pattern & pattern,
+            uint16_t rampOn,
+            uint16_t rampOff):
+        _steps(pattern._steps),
+        _length(pattern._length),
+        _unitUs(pattern._unitUs),
+        _cycleUnits(pattern._cycleUnits),
+        _rampOn(rampOn),
+        _rampOff(rampOff){};
+
+    /// @brief Sums [length] step durations at [steps].
+    static constexpr uint32_t _sum(const uint16_t * steps, uint8_t length){
+        return length == 0? 0 : steps[0] + _sum(steps + 1, length - 1);
+    };
+
+    const uint16_t * _steps;
+
+    uint8_t _length;
+
+    uint16_t _unitUs;
+
+    /// @brief The sum of the step durations.
+    uint32_t _cycleUnits;
+
+    /// @brief The fade-in time of the `on` steps.
+    uint16_t _rampOn;
+
+    /// @brief The fade-out time of the `off` steps.
+    uint16_t _rampOff;
+
+};
+
+/// @brief The registry of run-time patterns.
+///
+/// `intern()` copies a pattern into RAM once and returns a reference
+/// counted handle; interning an identical pattern again returns the same
+/// handle. An entry whose count drops to zero stays cached until its slot
+/// is needed for a new pattern. Patterns that are not in the registry
+/// (constant patterns) are ignored by `acquire()` and `release()`.
+class PWM_LED_Patterns{
+
+    public:
+
+    /// @brief Returns the registry handle of a copy of the pattern,
+    /// adding one reference that the caller must `release()`.
+    /// @param steps The step durations in units of [unitUs].
+    /// @param length The number of steps.
+    /// @param unitUs The time unit of [steps] in microseconds.
+    /// Allocates the steps on the heap when a slot first holds a pattern
+    /// that long, unless `PWM_LED_PATTERN_REGISTRY_STEPS` is defined.
+    /// @return The handle, or NULL if the registry is full or the pattern
+    /// is longer than `PWM_LED_PATTERN_REGISTRY_STEPS`.
+    static const PWM_LED_Pattern * intern(const uint16_t * steps,
+            uint8_t length,
+            uint16_t unitUs = PWM_LED_UNIT_MS);
+
+    /// @brief Adds a reference to [pattern] if it is in the registry.
+    static void acquire(const PWM_LED_Pattern * pattern);
+
+    /// @brief Drops a reference to [pattern] if it is in the registry.
+    static void release(const PWM_LED_Pattern * pattern);
+
+    /// @brief The number of registry entries currently referenced.
+    static uint8_t size();
+
+    private:
+
+    /// @brief A registry slot.
+    struct Entry{
+
+        /// @brief The interned pattern, pointing at [buffer].
+        PWM_LED_Pattern pattern{(const uint16_t *)NULL, 0, PWM_LED_UNIT_MS};
+
+#if PWM_LED_PATTERN_REGISTRY_STEPS > 0
+        /// @brief The storage of the steps.
+        uint16_t buffer[PWM_LED_PATTERN_REGISTRY_STEPS];
+#else
+        /// @brief The heap storage of the steps.
+        uint16_t * buffer = NULL;
+
+        /// @brief The number of steps [buffer] can hold.
+        uint8_t capacity = 0;
+#endif
+
+        /// @brief The hash of the steps and unit. Zero while the slot is
+        /// being written.
+        uint32_t hash = 0;
+
+        /// @brief The reference count.
+        std::atomic<int32_t> refs{0};
+
+    };
+
+    /// @brief Returns the registry entry of [pattern], or NULL.
+    static Entry * _entry(const PWM_LED_Pattern * pattern);
+
+    /// @brief Hashes a pattern (FNV-1a). Never returns zero.
+    static uint32_t _hash(const uint16_t * steps,
+            uint8_t length,
+            uint16_t unitUs);
+
+    static Entry _entries[PWM_LED_PATTERN_REGISTRY_SIZE];
+
+    static portMUX_TYPE _mux;
+
+};
+
+#if __cplusplus >= 201402L
+
+/// @brief Deliberately not `constexpr`: evaluating a call to it while
+/// building a pattern at compile time is a compile error. It is never
+/// defined.
+void PWM_LED_invalidPattern();
+
+/// @brief Builds a Morse pattern at compile time.
+///
+/// `.` is a dot (one unit on), `-` or `_` a dash (three units on), each
+/// followed by one unit off. A space ends a letter (three units off) and 
+/// `/` ends a word (seven units off). The pattern ends with a word gap 
+/// before it repeats. Any other character fails to compile.
+/// @param code The Morse code, e.g. `"... --- ..."`.
+/// @param dotMs The duration of one unit in milliseconds, at most 9362 
+/// so that a word gap of seven units fits a step. A longer unit fails to
+/// compile.
+/// @return The steps; declare the result `constexpr`.
+template <size_t L>
+constexpr PWM_LED_Steps<2 * (L - 1)> PWM_LED_morse(const char (&code)[L],
+        uint16_t dotMs = 100){
+    static_assert(L > 1, "A Morse pattern needs at least one symbol.");
+    static_assert(2 * (L - 1) <= 255, 
+        "A Morse pattern is limited to 127 characters (255 steps).");
+    if (dotMs > UINT16_MAX / 7){
+        PWM_LED_invalidPattern();
+    }
+    PWM_LED_Steps<2 * (L - 1)> result{};
+    uint8_t n = 0;
+    for (size_t i = 0; i + 1 < L; i++){
+        char symbol = code[i];
+        if (symbol == '.' || symbol == '-' || symbol == '_'){
+            result.steps[n++] = symbol == '.'? dotMs : 3 * dotMs;
+            result.steps[n++] = dotMs;
+        } else if ((symbol == ' ' || symbol == '/') && n > 0){
+            result.steps[n - 1] = symbol == ' '? 3 * dotMs : 7 * dotMs;
+        } else {
+            PWM_LED_invalidPattern();
+        }
+    }
+    if (n == 0){
+        PWM_LED_invalidPattern();
+    }
+    result.steps[n - 1] = 7 * dotMs;
+    result.length = n;
+    result.unitUs = PWM_LED_UNIT_MS;
+    return result;
+};
+
+/// @brief The total number of blinks in a blink code.
+constexpr uint16_t PWM_LED_blinkCount(){
+    return 0;
+};
+
+/// @brief The total number of blinks in a blink code.
+template <typename... Digits>
+constexpr uint16_t PWM_LED_blinkCount(uint8_t digit, Digits... digits){
+    return digit + PWM_LED_blinkCount(digits...);
+};
+
+/// @brief true if no digit of a blink code is zero.
+constexpr bool PWM_LED_blinkDigitsValid(){
+    return true;
+};
+
+/// @brief true if no digit of a blink code is zero.
+template <typename... Digits>
+constexpr bool PWM_LED_blinkDigitsValid(uint8_t digit, Digits... digits){
+    return digit > 0 && PWM_LED_blinkDigitsValid(digits...);
+};
+
+/// @brief Builds a blink code at compile time: each digit is shown as
+/// that many blinks, digits are separated by [gapMs] and the code ends
+/// with [breakMs] before it repeats. `PWM_LED_blinkCode<3, 2>()` blinks
+/// three times, pauses, then blinks twice.
+/// @param onMs The duration of each blink in milliseconds.
+/// @param offMs The pause between blinks of one digit in milliseconds.
+/// @param gapMs The pause between digits in milliseconds.
+/// @param breakMs The pause before the code repeats in milliseconds.
+/// @return The steps; declare the result `constexpr`.
+template <uint8_t... Digits>
+constexpr PWM_LED_Steps<2 * PWM_LED_blinkCount(Digits...)> PWM_LED_blinkCode(
+        uint16_t onMs = 200,
+        uint16_t offMs = 300,
+        uint16_t gapMs = 1000,
+        uint16_t breakMs = 3000){
+    static_assert(sizeof...(Digits) > 0, "A blink code needs a digit.");
+    static_assert(PWM_LED_blinkDigitsValid(Digits...), 
+        "Every digit of a blink code is at least 1.");
+    static_assert(2 * PWM_LED_blinkCount(Digits...) <= 255,
+        "A blink code is limited to 127 blinks (255 steps).");
+    PWM_LED_Steps<2 * PWM_LED_blinkCount(Digits...)> result{};
+    const uint8_t digits[] = {Digits...};
+    uint8_t n = 0;
+    for (uint8_t digit : digits){
+        for (uint8_t i = 0; i < digit; i++){
+            result.steps[n++] = onMs;
+            result.steps[n++] = offMs;
+        }
+        result.steps[n - 1] = gapMs;
+    }
+    result.steps[n - 1] = breakMs;
+    result.length = n;
+    result.unitUs = PWM_LED_UNIT_MS;
+    return result;
+};
+
+#endif // __cplusplus >= 201402L
+
+#endif // __PWM_LED_PATTERN_H__
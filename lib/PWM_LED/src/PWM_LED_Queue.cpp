@@ -0,0 +1,194 @@
+/*!
+* @file PWM_LED_Queue.cpp
+*
+* @section intro_sec_Introduction
+*
+* The prioritised pattern queue of a PWM_LED.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Queue.h"
+
+#if PWM_LED_QUEUE_SIZE > 0
+
+/// @brief The pool index encoded in the low byte of an entry id.
+#define QUEUE_ID_SLOT(id) ((id) & 0xFF)
+
+/// @brief The generation encoded in the high byte of an entry id.
+#define QUEUE_ID_GENERATION(id) ((id) >> 8)
+
+PWM_LED_Queue::PWM_LED_Queue(){
+    for (uint8_t i = 0; i < PWM_LED_QUEUE_SIZE; i++){
+        _entries[i] = {};
+        _free[i] = PWM_LED_QUEUE_SIZE - 1 - i;
+    }
+};
+
+uint16_t PWM_LED_Queue::add(const led_command_t & command,
+        uint8_t priority,
+        uint16_t repeats,
+        int64_t durationUs){
+    portENTER_CRITICAL(&_lock);
+    if (_freeCount == 0){
+        portEXIT_CRITICAL(&_lock);
+        PWM_LED_Patterns::release(command.pattern);
+        return 0;
+    }
+    uint8_t slot = _free[--_freeCount];
+    PWM_LED_QueueEntry & entry = _entries[slot];
+    entry.command = command;
+    entry.priority = priority;
+    entry.repeats = repeats;
+    entry.cycles = 0;
+    entry.durationUs = durationUs;
+    entry.endUs = 0;
+    entry.order = ++_order;
+    entry.cancelled = false;
+    // generation 0 is skipped so that no id is 0
+    entry.generation = entry.generation == 0xFF? 1 : entry.generation + 1;
+    uint16_t id = ((uint16_t)entry.generation << 8) | slot;
+    entry.heapIndex = _size;
+    _heap[_size] = slot;
+    _size++;
+    _siftUp(entry.heapIndex);
+    portEXIT_CRITICAL(&_lock);
+    return id;
+};
+
+bool PWM_LED_Queue::cancel(uint16_t id){
+    uint8_t slot = QUEUE_ID_SLOT(id);
+    if (slot >= PWM_LED_QUEUE_SIZE){
+        return false;
+    }
+    portENTER_CRITICAL(&_lock);
+    PWM_LED_QueueEntry & entry = _entries[slot];
+    bool queued = entry.heapIndex < _size && _heap[entry.heapIndex] == slot &&
+            entry.generation == QUEUE_ID_GENERATION(id) && !entry.cancelled;
+    if (queued){
+        entry.cancelled = true;
+    }
+    portEXIT_CRITICAL(&_lock);
+    return queued;
+};
+
+void PWM_LED_Queue::clear(){
+    portENTER_CRITICAL(&_lock);
+    for (uint8_t i = 0; i < _size; i++){
+        _entries[_heap[i]].cancelled = true;
+    }
+    portEXIT_CRITICAL(&_lock);
+};
+
+uint8_t PWM_LED_Queue::size(){
+    return _size;
+};
+
+PWM_LED_QueueEntry * PWM_LED_Queue::top(){
+    for (;;){
+        portENTER_CRITICAL(&_lock);
+        // cancelled entries are removed one at a time, so that their
+        // patterns are released outside the critical section
+        const PWM_LED_Pattern * released = NULL;
+        bool removed = false;
+        for (uint8_t i = 0; i < _size; i++){
+            if (_entries[_heap[i]].cancelled){
+                released = _entries[_heap[i]].command.pattern;
+                _removeAt(i);
+                removed = true;
+                break;
+            }
+        }
+        PWM_LED_QueueEntry * entry = _size > 0? &_entries[_heap[0]] : NULL;
+        portEXIT_CRITICAL(&_lock);
+        if (!removed){
+            return entry;
+        }
+        PWM_LED_Patterns::release(released);
+    }
+};
+
+void PWM_LED_Queue::remove(PWM_LED_QueueEntry * entry){
+    portENTER_CRITICAL(&_lock);
+    uint8_t slot = entry - _entries;
+    bool queued = entry->heapIndex < _size && _heap[entry->heapIndex] == slot;
+    // read the pattern before the slot can be reused by `add()`
+    const PWM_LED_Pattern * released = entry->command.pattern;
+    if (queued){
+        _removeAt(entry->heapIndex);
+    }
+    portEXIT_CRITICAL(&_lock);
+    if (queued){
+        PWM_LED_Patterns::release(released);
+    }
+};
+
+void PWM_LED_Queue::_removeAt(uint8_t i){
+    uint8_t slot = _heap[i];
+    _size--;
+    if (i != _size){
+        _swap(i, _size);
+        _siftDown(i);
+        _siftUp(i);
+    }
+    _entries[slot].heapIndex = PWM_LED_QUEUE_SIZE;
+    _free[_freeCount++] = slot;
+};
+
+bool PWM_LED_Queue::_before(uint8_t a, uint8_t b){
+    const PWM_LED_QueueEntry & x = _entries[_heap[a]];
+    const PWM_LED_QueueEntry & y = _entries[_heap[b]];
+    if (x.priority != y.priority){
+        return x.priority > y.priority;
+    }
+    return (int32_t)(x.order - y.order) > 0;
+};
+
+void PWM_LED_Queue::_swap(uint8_t a, uint8_t b){
+    uint8_t slot = _heap[a];
+    _heap[a] = _heap[b];
+    _heap[b] = slot;
+    _entries[_heap[a]].heapIndex = a;
+    _entries[_heap[b]].heapIndex = b;
+};
+
+void PWM_LED_Queue::_siftUp(uint8_t i){
+    while (i > 0){
+        uint8_t parent = (i - 1) / 2;
+        if (!_before(i, parent)){
+            return;
+        }
+        _swap(i, parent);
+        i = parent;
+    }
+};
+
+void PWM_LED_Queue::_siftDown(uint8_t i){
+    for (;;){
+        uint8_t first = i;
+        uint16_t left = 2 * i + 1;
+        uint16_t right = left + 1;
+        if (left < _size && _before(left, first)){
+            first = left;
+        }
+        if (right < _size && _before(right, first)){
+            first = right;
+        }
+        if (first == i){
+            return;
+        }
+        _swap(i, first);
+        i = first;
+    }
+};
+
+#endif // PWM_LED_QUEUE_SIZE
@@ -0,0 +1,201 @@
+/*!
+* @file PWM_LED_Queue.h
+*
+* @section intro_sec_Introduction
+*
+* The prioritised pattern queue of a PWM_LED.
+*
+* `on()`, `off()` and `flash()` set the base state of an LED. Patterns
+* added with `PWM_LED::enqueue()` play on top of it: the entry with the
+* highest priority plays (the newest one among equal priorities) until it
+* has played its repeat count or its duration, is cancelled, or is
+* preempted by a higher priority entry. When the queue is empty the LED
+* returns to its base state. A preempted entry resumes from the start of
+* its current cycle and keeps the cycles it has already played.
+*
+* Callers add and cancel entries under a short critical section. All
+* other work, including removing finished and cancelled entries and
+* releasing their patterns, is done by the task driving the LED when it
+* wakes for an edge or a command, so the queue causes no extra wakeups.
+*
+* The pool of entries would make up most of the size of an LED, so the
+* queue is opt-in: it is left out unless PWM_LED_QUEUE_SIZE is defined
+* above 0 for the whole build, and without it `enqueue()` returns 0.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_QUEUE_H__
+#define __PWM_LED_QUEUE_H__
+
+#include "PWM_LED_Command.h"
+
+/// The number of entries the queue of each LED can hold (at most 255), or
+/// 0 to leave the queue out. Define for the whole build to change it, for
+/// example with `-D PWM_LED_QUEUE_SIZE=4`.
+#ifndef PWM_LED_QUEUE_SIZE
+#define PWM_LED_QUEUE_SIZE 0
+#endif // PWM_LED_QUEUE_SIZE
+
+/// @brief An entry of the pattern queue.
+typedef struct PWM_LED_QueueEntry{
+
+    /// @brief The sequence to play, as an LED_FLASHING command.
+    led_command_t command;
+
+    /// @brief The priority; higher values preempt lower ones.
+    uint8_t priority;
+
+    /// @brief The number of cycles to play, or 0 to repeat until
+    /// cancelled or until [durationUs] has passed.
+    uint16_t repeats;
+
+    /// @brief The number of cycles played so far.
+    uint16_t cycles;
+
+    /// @brief How long the entry plays in microseconds after it first
+    /// starts, or 0 for no limit.
+    int64_t durationUs;
+
+    /// @brief The time at which the entry ends, or 0 if it has not
+    /// started or has no duration.
+    int64_t endUs;
+
+    /// @brief Orders entries of equal priority; newer entries win.
+    uint32_t order;
+
+    /// @brief The position of the entry in the heap.
+    uint8_t heapIndex;
+
+    /// @brief Incremented every time the slot is reused, so that stale
+    /// ids do not cancel a new entry.
+    uint8_t generation;
+
+    /// @brief Set by `cancel()`; the task removes the entry.
+    bool cancelled;
+
+}PWM_LED_queue_entry_t;
+
+#if PWM_LED_QUEUE_SIZE > 0
+
+/// @brief A max-heap of queue entries in a fixed pool.
+class PWM_LED_Queue{
+
+    public:
+
+    PWM_LED_Queue();
+
+    /// @brief Adds an entry. O(log n). Called by any task.
+    /// @param command The LED_FLASHING command to play; a registry
+    /// pattern reference is handed over to the queue.
+    /// @param priority The priority.
+    /// @param repeats The number of cycles, 0 for no limit.
+    /// @param durationUs The play time, 0 for no limit.
+    /// @return The id of the entry, or 0 if the queue is full.
+    uint16_t add(const led_command_t & command,
+            uint8_t priority,
+            uint16_t repeats,
+            int64_t durationUs);
+
+    /// @brief Marks the entry [id] as cancelled. Called by any task.
+    /// @return false if the entry has already ended.
+    bool cancel(uint16_t id);
+
+    /// @brief Marks every entry as cancelled. Called by any task.
+    void clear();
+
+    /// @brief The number of entries, including cancelled entries that the
+    /// task has not removed yet.
+    uint8_t size();
+
+    /// @brief Removes the cancelled entries and returns the entry that
+    /// should play. Called by the task only.
+    /// @return The top entry, or NULL if the queue is empty.
+    PWM_LED_QueueEntry * top();
+
+    /// @brief Removes [entry] and releases its pattern. Called by the
+    /// task only.
+    void remove(PWM_LED_QueueEntry * entry);
+
+    private:
+
+    PWM_LED_QueueEntry _entries[PWM_LED_QUEUE_SIZE];
+
+    /// @brief Pool indices of the entries, as a max-heap.
+    uint8_t _heap[PWM_LED_QUEUE_SIZE];
+
+    uint8_t _size = 0;
+
+    /// @brief Pool indices of the free entries, as a stack.
+    uint8_t _free[PWM_LED_QUEUE_SIZE];
+
+    uint8_t _freeCount = PWM_LED_QUEUE_SIZE;
+
+    uint32_t _order = 0;
+
+    /// @brief Guards the heap and the free stack.
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    /// @brief Whether the entry at heap position [a] should play before
+    /// the one at [b].
+    bool _before(uint8_t a, uint8_t b);
+
+    void _swap(uint8_t a, uint8_t b);
+
+    void _siftUp(uint8_t i);
+
+    void _siftDown(uint8_t i);
+
+    /// @brief Removes the entry at heap position [i]. Called with [_lock]
+    /// held; the caller releases the pattern.
+    void _removeAt(uint8_t i);
+
+};
+
+#else // PWM_LED_QUEUE_SIZE
+
+/// @brief The queue left out: it holds no entry and takes no pool.
+class PWM_LED_Queue{
+
+    public:
+
+    /// @brief Releases the pattern of [command].
+    /// @return 0: the queue is always full.
+    uint16_t add(const led_command_t & command,
+            uint8_t /* priority */,
+            uint16_t /* repeats */,
+            int64_t /* durationUs */){
+        PWM_LED_Patterns::release(command.pattern);
+        return 0;
+    };
+
+    bool cancel(uint16_t /* id */){
+        return false;
+    };
+
+    void clear(){};
+
+    uint8_t size(){
+        return 0;
+    };
+
+    PWM_LED_QueueEntry * top(){
+        return NULL;
+    };
+
+    void remove(PWM_LED_QueueEntry * /* entry */){};
+
+};
+
+#endif // PWM_LED_QUEUE_SIZE
+
+#endif // __PWM_LED_QUEUE_H__
@@ -0,0 +1,337 @@
+/*!
+* @file PWM_LED_Stream.cpp
+*
+* @section intro_sec_Introduction
+*
+* A framed binary command protocol that drives many PWM_LEDs from one
+* byte stream.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Stream.h"
+#include <cstring>
+
+/// @brief The CRC-16/CCITT-FALSE table, built by the compiler.
+struct PWM_LED_CrcTable{
+
+    uint16_t entries[256];
+
+};
+
+/// @brief [crc] shifted through [bits] more bits of the polynomial.
+static constexpr uint16_t crcShift(uint16_t crc, uint8_t bits){
+    return bits == 0? crc : crcShift(crc & 0x8000? 
+            (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1), 
+            bits - 1);
+};
+
+template <uint32_t... I>
+static constexpr PWM_LED_CrcTable crcTable(PWM_LED_Indices<I...>){
+    return PWM_LED_CrcTable{{crcShift(I << 8, 8)...}};
+};
+
+static constexpr PWM_LED_CrcTable CRC_TABLE = 
+        crcTable(PWM_LED_MakeIndices<256>::type());
+
+/// @brief The little-endian 16-bit number at [data].
+static inline uint16_t read16(const uint8_t * data){
+    return data[0] | data[1] << 8;
+};
+
+bool PWM_LED_Stream::add(PWM_LED & led){
+    if (_size >= PWM_LED_STREAM_MAX_LEDS || _size >= PWM_LED_STREAM_ALL){
+        return false;
+    }
+    _leds[_size] = &led;
+    _size++;
+    return true;
+};
+
+void PWM_LED_Stream::setPatterns(const PWM_LED_Pattern * const * patterns,
+        uint8_t count){
+    _patterns = patterns;
+    _patternCount = patterns == NULL? 0 : count;
+};
+
+uint32_t PWM_LED_Stream::feed(const uint8_t * data, size_t length){
+    uint32_t frames = _frames;
+    const uint8_t * end = data + length;
+    while (data < end){
+        switch (_state){
+            case _SYNC_1:
+                // skip to the next frame
+                data = (const uint8_t *)memchr(data, PWM_LED_STREAM_SYNC_1,
+                        end - data);
+                if (data == NULL){
+                    return _frames - frames;
+                }
+                data++;
+                _state = _SYNC_2;
+                break;
+            case _SYNC_2:
+                // a repeated first byte may still start a frame
+                if (*data != PWM_LED_STREAM_SYNC_1){
+                    _state = *data == PWM_LED_STREAM_SYNC_2?
+                            _LENGTH_LOW : _SYNC_1;
+                }
+                data++;
+                break;
+            case _LENGTH_LOW:
+                _length = *data++;
+                _state = _LENGTH_HIGH;
+                break;
+            case _LENGTH_HIGH:
+                _length |= *data++ << 8;
+                _received = 0;
+                if (_length > PWM_LED_STREAM_FRAME_SIZE){
+                    _errors++;
+                    _state = _SYNC_1;
+                } else {
+                    _state = _length == 0? _CRC_LOW : _PAYLOAD;
+                }
+                break;
+            case _PAYLOAD: {
+                // copy as much of the payload as has arrived in one go
+                size_t count = std::min((size_t)(_length - _received),
+                        (size_t)(end - data));
+                memcpy(_frame + _received, data, count);
+                _received += count;
+                data += count;
+                if (_received == _length){
+                    _state = _CRC_LOW;
+                }
+                break;
+            }
+            case _CRC_LOW:
+                _crc = *data++;
+                _state = _CRC_HIGH;
+                break;
+            case _CRC_HIGH: {
+                _crc |= *data++ << 8;
+                _state = _SYNC_1;
+                uint8_t header[2] = {(uint8_t)_length,
+                        (uint8_t)(_length >> 8)};
+                if (crc(_frame, _length, crc(header, 2)) == _crc){
+                    _apply();
+                    _frames++;
+                } else {
+                    _errors++;
+                }
+                break;
+            }
+        }
+    }
+    return _frames - frames;
+};
+
+uint32_t PWM_LED_Stream::frames(){
+    return _frames;
+};
+
+uint32_t PWM_LED_Stream::records(){
+    return _records;
+};
+
+uint32_t PWM_LED_Stream::errors(){
+    return _errors;
+};
+
+uint8_t PWM_LED_Stream::size(){
+    return _size;
+};
+
+uint16_t PWM_LED_Stream::crc(const uint8_t * data,
+        size_t length,
+        uint16_t crc){
+    for (size_t i = 0; i < length; i++){
+        crc = (crc << 8) ^ CRC_TABLE.entries[(crc >> 8) ^ data[i]];
+    }
+    return crc;
+};
+
+void PWM_LED_Stream::_apply(){
+    // hold back the engines' notifications while the batch is published,
+    // then wake each engine once to apply the whole batch in one pass
+    PWM_LED_Engine * engines[PWM_LED_STREAM_MAX_LEDS];
+    uint8_t engineCount = 0;
+    for (uint8_t i = 0; i < _size; i++){
+        PWM_LED_Engine * engine = _leds[i]->_engine;
+        if (engine != NULL && !engine->_holdNotify.load()){
+            engine->_holdNotify.store(true);
+            engines[engineCount] = engine;
+            engineCount++;
+        }
+    }
+    uint16_t position = 0;
+    while (position + 2 <= _length){
+        uint8_t id = _frame[position];
+        uint16_t length = 0;
+        if (id == PWM_LED_STREAM_ALL){
+            for (uint8_t i = 0; i < _size; i++){
+                length = _applyRecord(*_leds[i], _frame + position,
+                        _length - position);
+            }
+            if (_size == 0){
+                _errors++;
+                break;
+            }
+        } else if (id < _size){
+            length = _applyRecord(*_leds[id], _frame + position,
+                    _length - position);
+        } else {
+            _errors++;
+            break;
+        }
+        if (length == 0){
+            // the rest of the frame cannot be parsed
+            _errors++;
+            break;
+        }
+        position += length;
+        _records++;
+    }
+    for (uint8_t i = 0; i < engineCount; i++){
+        engines[i]->_holdNotify.store(false);
+        engines[i]->_wake();
+    }
+};
+
+uint16_t PWM_LED_Stream::_applyRecord(PWM_LED & led,
+        const uint8_t * record,
+        uint16_t available){
+    switch (record[1]){
+        case STREAM_OFF:
+            led.off();
+            return 2;
+        case STREAM_ON:
+            led.on();
+            return 2;
+        case STREAM_FADE:
+            if (available < 6){
+                return 0;
+            }
+            led.fadeTo(read16(record + 2), read16(record + 4));
+            return 6;
+        case STREAM_FLASH:
+            if (available < 3){
+                return 0;
+            }
+            if (record[2] < _patternCount){
+                led.flash(*_patterns[record[2]]);
+            } else {
+                _errors++;
+            }
+            return 3;
+        case STREAM_STEPS: {
+            if (available < 5 || available < 5 + 2 * record[4]){
+                return 0;
+            }
+            uint8_t length = record[4];
+            for (uint8_t i = 0; i < length; i++){
+                _steps[i] = read16(record + 5 + 2 * i);
+            }
+            if (!led.flash(_steps, length, read16(record + 2))){
+                _errors++;
+            }
+            return 5 + 2 * length;
+        }
+        default:
+            return 0;
+    }
+};
+
+PWM_LED_StreamFrame::PWM_LED_StreamFrame(uint8_t * buffer,
+        uint16_t capacity):
+    _buffer(buffer),
+    _capacity(capacity){
+    clear();
+};
+
+void PWM_LED_StreamFrame::clear(){
+    _length = 4;
+    _records = 0;
+};
+
+bool PWM_LED_StreamFrame::off(uint8_t id){
+    return _record(id, STREAM_OFF, 2);
+};
+
+bool PWM_LED_StreamFrame::on(uint8_t id){
+    return _record(id, STREAM_ON, 2);
+};
+
+bool PWM_LED_StreamFrame::fade(uint8_t id,
+        uint16_t level,
+        uint16_t durationMs){
+    if (!_record(id, STREAM_FADE, 6)){
+        return false;
+    }
+    _put16(level);
+    _put16(durationMs);
+    return true;
+};
+
+bool PWM_LED_StreamFrame::flash(uint8_t id, uint8_t pattern){
+    if (!_record(id, STREAM_FLASH, 3)){
+        return false;
+    }
+    _buffer[_length++] = pattern;
+    return true;
+};
+
+bool PWM_LED_StreamFrame::flash(uint8_t id,
+        const uint16_t * steps,
+        uint8_t length,
+        uint16_t unitUs){
+    if (!_record(id, STREAM_STEPS, 5 + 2 * length)){
+        return false;
+    }
+    _put16(unitUs);
+    _buffer[_length++] = length;
+    for (uint8_t i = 0; i < length; i++){
+        _put16(steps[i]);
+    }
+    return true;
+};
+
+uint16_t PWM_LED_StreamFrame::records(){
+    return _records;
+};
+
+uint16_t PWM_LED_StreamFrame::finish(){
+    uint16_t payload = _length - 4;
+    _buffer[0] = PWM_LED_STREAM_SYNC_1;
+    _buffer[1] = PWM_LED_STREAM_SYNC_2;
+    _buffer[2] = (uint8_t)payload;
+    _buffer[3] = (uint8_t)(payload >> 8);
+    uint16_t crc = PWM_LED_Stream::crc(_buffer + 2, payload + 2);
+    _buffer[_length] = (uint8_t)crc;
+    _buffer[_length + 1] = (uint8_t)(crc >> 8);
+    return _length + 2;
+};
+
+bool PWM_LED_StreamFrame::_record(uint8_t id, uint8_t op, uint16_t length){
+    // leave room for the checksum
+    if ((uint32_t)_length + length + 2 > _capacity){
+        return false;
+    }
+    _buffer[_length++] = id;
+    _buffer[_length++] = op;
+    _records++;
+    return true;
+};
+
+void PWM_LED_StreamFrame::_put16(uint16_t value){
+    _buffer[_length++] = (uint8_t)value;
+    _buffer[_length++] = (uint8_t)(value >> 8);
+};
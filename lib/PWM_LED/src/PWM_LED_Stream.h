@@ -0,0 +1,280 @@
+/*!
+* @file PWM_LED_Stream.h
+*
+* @section intro_sec_Introduction
+*
+* A framed binary command protocol that drives many PWM_LEDs from one
+* byte stream, such as a serial link to a host PC.
+*
+* A frame carries a batch of records, each of which commands one LED:
+*
+* ```
+* frame   := 0xA5 0x5A length:u16 payload[length] crc:u16
+* payload := record*
+* record  := id:u8 op:u8 arguments
+*   0x00 OFF
+*   0x01 ON
+*   0x02 FADE   level:u16 durationMs:u16
+*   0x03 FLASH  pattern:u8            an index into the pattern table
+*   0x04 STEPS  unitUs:u16 length:u8 steps:u16[length]
+* ```
+*
+* All numbers are little-endian; [crc] is the CRC-16/CCITT-FALSE of
+* [length] and [payload], and an [id] of 0xFF addresses every LED.
+*
+* PWM_LED_Stream decodes the bytes as they arrive, into a fixed frame
+* buffer, without allocating. A frame whose checksum does not match is
+* dropped whole, so a corrupted batch never half-applies. The records of a
+* valid frame are applied in order with the notifications of the engines
+* driving the LEDs held back, and each engine is then woken once, so it
+* applies the whole batch in one pass. STEPS records are interned in the
+* pattern registry, which holds PWM_LED_PATTERN_REGISTRY_SIZE patterns;
+* FLASH records play constant patterns from a table and need no registry
+* slot.
+*
+* PWM_LED_StreamFrame builds frames on the sending side, e.g. a test rig
+* on a PC linked to the host build of the library.
+*
+* ``` C++
+* PWM_LED_Stream stream;
+* stream.add(status);                             // id 0
+* stream.add(power);                              // id 1
+* stream.setPatterns(patterns, 4);
+* ...
+* stream.poll(Serial);                            // in loop()
+* ```
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_STREAM_H__
+#define __PWM_LED_STREAM_H__
+
+#include "PWM_LED.h"
+
+/// The number of LEDs a stream can address. Define before including this
+/// header to change it.
+#ifndef PWM_LED_STREAM_MAX_LEDS
+#define PWM_LED_STREAM_MAX_LEDS 64
+#endif // PWM_LED_STREAM_MAX_LEDS
+
+/// The largest payload of a frame in bytes; longer frames are dropped.
+/// Define before including this header to change it.
+#ifndef PWM_LED_STREAM_FRAME_SIZE
+#define PWM_LED_STREAM_FRAME_SIZE 512
+#endif // PWM_LED_STREAM_FRAME_SIZE
+
+/// The first and second byte of every frame.
+#define PWM_LED_STREAM_SYNC_1 0xA5
+#define PWM_LED_STREAM_SYNC_2 0x5A
+
+/// The [id] of a record that commands every LED of the stream.
+#define PWM_LED_STREAM_ALL 0xFF
+
+/// The bytes around the payload: sync, length and checksum.
+#define PWM_LED_STREAM_OVERHEAD 6
+
+/// @brief The operations of a stream record.
+typedef enum PWM_LED_StreamOp{
+
+    /// @brief `off()`.
+    STREAM_OFF = 0x00,
+
+    /// @brief `on()`.
+    STREAM_ON = 0x01,
+
+    /// @brief `fadeTo(level, durationMs)`.
+    STREAM_FADE = 0x02,
+
+    /// @brief `flash(pattern)` with a pattern of the pattern table.
+    STREAM_FLASH = 0x03,
+
+    /// @brief `flash(steps, length, unitUs)`.
+    STREAM_STEPS = 0x04,
+
+}PWM_LED_stream_op_t;
+
+/// @brief Decodes a command stream and applies it to its LEDs.
+class PWM_LED_Stream{
+
+    public:
+
+    /// @brief Adds [led] to the stream; its id is the number of LEDs
+    /// added before it.
+    /// @param led The LED, which must outlive the stream.
+    /// @return false if the stream is full.
+    bool add(PWM_LED & led);
+
+    /// @brief Sets the table of patterns that FLASH records play.
+    /// @param patterns The patterns, which must outlive the stream.
+    /// @param count The number of patterns.
+    void setPatterns(const PWM_LED_Pattern * const * patterns,
+            uint8_t count);
+
+    /// @brief Decodes [length] bytes and applies every frame they
+    /// complete. Call from one task only.
+    /// @return The number of frames applied.
+    uint32_t feed(const uint8_t * data, size_t length);
+
+    /// @brief Feeds all bytes available on [stream], e.g. `Serial`. Works
+    /// with any class that has `available()` and
+    /// `readBytes(uint8_t*, size_t)`.
+    /// @return The number of frames applied.
+    template <class Source>
+    uint32_t poll(Source & stream){
+        uint8_t buffer[64];
+        uint32_t frames = 0;
+        int available;
+        while ((available = stream.available()) > 0){
+            size_t read = stream.readBytes(buffer,
+                    std::min((size_t)available, sizeof(buffer)));
+            if (read == 0){
+                break;
+            }
+            frames += feed(buffer, read);
+        }
+        return frames;
+    };
+
+    /// @brief The number of frames applied.
+    uint32_t frames();
+
+    /// @brief The number of records decoded from valid frames.
+    uint32_t records();
+
+    /// @brief The number of frames dropped for a bad checksum or length,
+    /// and of records skipped for an unknown id, op or pattern or a full
+    /// pattern registry.
+    uint32_t errors();
+
+    /// @brief The number of LEDs.
+    uint8_t size();
+
+    /// @brief The CRC-16/CCITT-FALSE of [length] bytes, continued from
+    /// [crc].
+    static uint16_t crc(const uint8_t * data,
+            size_t length,
+            uint16_t crc = 0xFFFF);
+
+    private:
+
+    /// @brief The states of the decoder.
+    typedef enum{
+        _SYNC_1,
+        _SYNC_2,
+        _LENGTH_LOW,
+        _LENGTH_HIGH,
+        _PAYLOAD,
+        _CRC_LOW,
+        _CRC_HIGH,
+    } _state_t;
+
+    PWM_LED * _leds[PWM_LED_STREAM_MAX_LEDS];
+
+    uint8_t _size = 0;
+
+    const PWM_LED_Pattern * const * _patterns = NULL;
+
+    uint8_t _patternCount = 0;
+
+    _state_t _state = _SYNC_1;
+
+    /// @brief The length of the frame being received.
+    uint16_t _length = 0;
+
+    /// @brief The number of payload bytes received.
+    uint16_t _received = 0;
+
+    /// @brief The checksum sent with the frame.
+    uint16_t _crc = 0;
+
+    /// @brief The payload of the frame being received.
+    uint8_t _frame[PWM_LED_STREAM_FRAME_SIZE];
+
+    /// @brief The steps of a STEPS record, as `flash()` takes them.
+    uint16_t _steps[UINT8_MAX];
+
+    uint32_t _frames = 0;
+
+    uint32_t _records = 0;
+
+    uint32_t _errors = 0;
+
+    /// @brief Applies the records of the received frame in one pass of
+    /// each engine.
+    void _apply();
+
+    /// @brief Applies the record at [record] to [led].
+    /// @return The length of the record, or 0 if it is malformed.
+    uint16_t _applyRecord(PWM_LED & led,
+            const uint8_t * record,
+            uint16_t available);
+
+};
+
+/// @brief Builds a frame of a command stream in a caller's buffer.
+class PWM_LED_StreamFrame{
+
+    public:
+
+    /// @param buffer The buffer, at least PWM_LED_STREAM_OVERHEAD bytes.
+    /// @param capacity The size of [buffer].
+    PWM_LED_StreamFrame(uint8_t * buffer, uint16_t capacity);
+
+    /// @brief Starts a new frame in the buffer.
+    void clear();
+
+    /// @brief Adds an OFF record. Each record method returns false, and
+    /// leaves the frame unchanged, if the record does not fit.
+    bool off(uint8_t id);
+
+    bool on(uint8_t id);
+
+    bool fade(uint8_t id, uint16_t level, uint16_t durationMs);
+
+    /// @brief Adds a FLASH record that plays [pattern] of the receiver's
+    /// pattern table.
+    bool flash(uint8_t id, uint8_t pattern);
+
+    /// @brief Adds a STEPS record.
+    bool flash(uint8_t id,
+            const uint16_t * steps,
+            uint8_t length,
+            uint16_t unitUs = PWM_LED_UNIT_MS);
+
+    /// @brief The number of records in the frame.
+    uint16_t records();
+
+    /// @brief Completes the header and checksum.
+    /// @return The length of the frame in the buffer.
+    uint16_t finish();
+
+    private:
+
+    uint8_t * _buffer;
+
+    uint16_t _capacity;
+
+    /// @brief The length of the frame so far.
+    uint16_t _length = 0;
+
+    uint16_t _records = 0;
+
+    /// @brief Appends the header of a record of [length] bytes.
+    /// @return false if it does not fit.
+    bool _record(uint8_t id, uint8_t op, uint16_t length);
+
+    void _put16(uint16_t value);
+
+};
+
+#endif // __PWM_LED_STREAM_H__
@@ -0,0 +1,106 @@
+/*!
+* @file PWM_LED_SyncGroup.cpp
+*
+* @section intro_sec_Introduction
+*
+* Phase-locked playback of a pattern or waveform on many LEDs.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_SyncGroup.h"
+
+bool PWM_LED_SyncGroup::add(PWM_LED & led, uint16_t phase){
+    portENTER_CRITICAL(&_lock);
+    bool added = _size < PWM_LED_SYNC_MAX_LEDS;
+    if (added){
+        _leds[_size] = &led;
+        _phases[_size] = phase;
+        _size++;
+    }
+    portEXIT_CRITICAL(&_lock);
+    return added;
+};
+
+bool PWM_LED_SyncGroup::setPhase(uint8_t index, uint16_t phase){
+    portENTER_CRITICAL(&_lock);
+    bool member = index < _size;
+    if (member){
+        _phases[index] = phase;
+    }
+    portEXIT_CRITICAL(&_lock);
+    return member;
+};
+
+int64_t PWM_LED_SyncGroup::flash(const PWM_LED_Pattern & pattern){
+    led_command_t command = {};
+    if (pattern.cycleUs() != 0){
+        command.state = LED_FLASHING;
+        command.pattern = &pattern;
+    }
+    return _start(command);
+};
+
+int64_t PWM_LED_SyncGroup::flash(const PWM_LED_CompactPattern & pattern){
+    led_command_t command = {};
+    if (pattern.playable()){
+        command.state = LED_FLASHING;
+        command.flash.compact = &pattern;
+    }
+    return _start(command);
+};
+
+int64_t PWM_LED_SyncGroup::wave(const PWM_LED_Waveform & waveform,
+        uint32_t periodMs,
+        uint16_t amplitude,
+        uint32_t intervalUs){
+    led_command_t command = {};
+    if (periodMs != 0){
+        command.state = LED_WAVE;
+        command.wave.waveform = &waveform;
+        command.wave.periodMs = periodMs;
+        command.wave.intervalUs = std::max(intervalUs, (uint32_t)1);
+        command.wave.amplitude = amplitude;
+    }
+    return _start(command);
+};
+
+int64_t PWM_LED_SyncGroup::epoch(){
+    return _epoch;
+};
+
+uint8_t PWM_LED_SyncGroup::size(){
+    return _size;
+};
+
+int64_t PWM_LED_SyncGroup::_start(led_command_t & command){
+    PWM_LED * leds[PWM_LED_SYNC_MAX_LEDS];
+    uint16_t phases[PWM_LED_SYNC_MAX_LEDS];
+    portENTER_CRITICAL(&_lock);
+    uint8_t size = _size;
+    for (uint8_t i = 0; i < size; i++){
+        leds[i] = _leds[i];
+        phases[i] = _phases[i];
+    }
+    portEXIT_CRITICAL(&_lock);
+    // every member gets the same epoch, far enough ahead for the last
+    // member's task to pick up its command before it
+    command.epochUs = esp_timer_get_time() + PWM_LED_SYNC_LEAD_US;
+    _epoch = command.epochUs;
+    for (uint8_t i = 0; i < size; i++){
+        command.phase = phases[i];
+        // each command holds its own reference to a registry pattern
+        PWM_LED_Patterns::acquire(command.pattern);
+        leds[i]->_publish(command);
+    }
+    return command.epochUs;
+};
@@ -0,0 +1,146 @@
+/*!
+* @file PWM_LED_SyncGroup.h
+*
+* @section intro_sec_Introduction
+*
+* Phase-locked playback of a pattern, compact pattern or waveform on many
+* LEDs.
+*
+* LEDs that are flashed one after the other start their patterns at the
+* moments their tasks pick up the commands, so they run a few ticks apart.
+* A PWM_LED_SyncGroup starts all of its members from one shared epoch
+* instead: `flash()` and `wave()` publish the command to every member
+* with the same start time, PWM_LED_SYNC_LEAD_US in the future, and each
+* task holds its LED until then. Every member plays from the epoch,
+* shifted by its own phase, so a row of LEDs can run a chase or a
+* "knight-rider" sweep.
+*
+* Members schedule every edge at the epoch plus the sum of the steps, so
+* they cannot drift apart; the skew between them is only the time it
+* takes their tasks, or their engine, to write the edges. A member that
+* falls behind, or returns from its pattern queue, steps straight to the
+* step that plays at the current time, rather than restarting from it or
+* replaying the missed edges, so it rejoins the group in phase.
+*
+* A new `flash()` or `wave()` starts at its own lead epoch, not at the
+* next edge common to the running pattern: a member hands the buffer of
+* its running command back to the publishers as soon as it receives the
+* next command, so it cannot keep playing until a later edge, and holding
+* its output for up to a whole cycle would be a longer pause than the
+* lead.
+*
+* ``` C++
+* PWM_LED_SyncGroup row;
+* for (uint8_t i = 0; i < 8; i++){
+*   row.add(leds[i], i * 0x10000 / 8);     // phase in 1/65536ths
+* }
+* row.wave(PWM_LED_Waveform::sine(), 1000);
+* ```
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_SYNC_GROUP_H__
+#define __PWM_LED_SYNC_GROUP_H__
+
+#include "PWM_LED.h"
+
+/// The number of LEDs a sync group can hold. Define before including this
+/// header to change it.
+#ifndef PWM_LED_SYNC_MAX_LEDS
+#define PWM_LED_SYNC_MAX_LEDS 16
+#endif // PWM_LED_SYNC_MAX_LEDS
+
+/// The time between a group `flash()` or `wave()` call and the epoch at
+/// which the members start, in microseconds. Must cover the time the
+/// members' tasks take to pick up the command. Define before including
+/// this header to change it.
+#ifndef PWM_LED_SYNC_LEAD_US
+#define PWM_LED_SYNC_LEAD_US 5000
+#endif // PWM_LED_SYNC_LEAD_US
+
+/// @brief LEDs that play a pattern or waveform from one shared epoch,
+/// each with its own phase.
+class PWM_LED_SyncGroup{
+
+    public:
+
+    /// @brief Adds [led] to the group. Call before `flash()` or `wave()`.
+    /// @param led The LED, which must outlive the group.
+    /// @param phase How far ahead of the group the LED plays, in
+    /// 1/65536ths of the cycle of the pattern or the period of the
+    /// waveform.
+    /// @return false if the group is full.
+    bool add(PWM_LED & led, uint16_t phase = 0);
+
+    /// @brief Changes the phase of the member [index], from the next
+    /// `flash()` or `wave()`.
+    /// @return false if there is no such member.
+    bool setPhase(uint8_t index, uint16_t phase);
+
+    /// @brief Flashes every member with [pattern] from a new epoch. The
+    /// members hold their current output until the epoch, and then all
+    /// start at once.
+    /// @param pattern The pattern, which must outlive the playback.
+    /// @return The epoch, an `esp_timer_get_time()` time.
+    int64_t flash(const PWM_LED_Pattern & pattern);
+
+    /// @brief Deleted: the LEDs would keep a pointer to the temporary.
+    int64_t flash(const PWM_LED_Pattern && pattern) = delete;
+
+    /// @brief Flashes every member with a compact sequence from a new
+    /// epoch. See `flash(pattern)`.
+    int64_t flash(const PWM_LED_CompactPattern & pattern);
+
+    /// @brief Deleted: the LEDs would keep a pointer to the temporary.
+    int64_t flash(const PWM_LED_CompactPattern && pattern) = delete;
+
+    /// @brief Plays [waveform] on every member from a new epoch. See
+    /// `PWM_LED::wave()`.
+    /// @return The epoch, an `esp_timer_get_time()` time.
+    int64_t wave(const PWM_LED_Waveform & waveform,
+            uint32_t periodMs,
+            uint16_t amplitude = 0xFFFF,
+            uint32_t intervalUs = PWM_LED_WAVE_INTERVAL_US);
+
+    /// @brief Deleted: the LEDs would keep a pointer to the temporary.
+    int64_t wave(const PWM_LED_Waveform && waveform,
+            uint32_t periodMs,
+            uint16_t amplitude = 0xFFFF,
+            uint32_t intervalUs = PWM_LED_WAVE_INTERVAL_US) = delete;
+
+    /// @brief The epoch of the last `flash()` or `wave()`, or 0.
+    int64_t epoch();
+
+    /// @brief The number of members.
+    uint8_t size();
+
+    private:
+
+    PWM_LED * _leds[PWM_LED_SYNC_MAX_LEDS];
+
+    uint16_t _phases[PWM_LED_SYNC_MAX_LEDS];
+
+    uint8_t _size = 0;
+
+    int64_t _epoch = 0;
+
+    /// @brief Guards the members.
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    /// @brief Publishes [command] to every member with the member's
+    /// phase and a new epoch.
+    int64_t _start(led_command_t & command);
+
+};
+
+#endif // __PWM_LED_SYNC_GROUP_H__
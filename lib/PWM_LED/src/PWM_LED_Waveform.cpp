@@ -0,0 +1,73 @@
+/*!
+* @file PWM_LED_Waveform.cpp
+*
+* @section intro_sec_Introduction
+*
+* Periodic brightness envelopes played from lookup tables.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_LED_Waveform.h"
+
+/// @brief 65535 * (1 - cos(2 pi i / 64)) / 2.
+static const uint16_t SINE[] = {
+    0, 158, 630, 1411, 2494, 3869, 5522, 7438,
+    9597, 11980, 14563, 17321, 20228, 23256, 26375, 29556,
+    32767, 35979, 39160, 42279, 45307, 48214, 50972, 53555,
+    55938, 58097, 60013, 61666, 63041, 64124, 64905, 65377,
+    65535, 65377, 64905, 64124, 63041, 61666, 60013, 58097,
+    55938, 53555, 50972, 48214, 45307, 42279, 39160, 35979,
+    32768, 29556, 26375, 23256, 20228, 17321, 14563, 11980,
+    9597, 7438, 5522, 3869, 2494, 1411, 630, 158,
+};
+
+/// @brief Interpolation between the two samples is the ramp itself.
+static const uint16_t TRIANGLE[] = {0, 65535};
+
+/// @brief 65535 * (exp(sin(2 pi i / 64 - pi / 2)) - 1 / e) / (e - 1 / e).
+static const uint16_t BREATHING[] = {
+    0, 50, 199, 451, 811, 1286, 1883, 2614,
+    3491, 4527, 5740, 7145, 8759, 10600, 12683, 15022,
+    17625, 20496, 23632, 27016, 30624, 34417, 38340, 42326,
+    46291, 50144, 53780, 57094, 59980, 62341, 64093, 65171,
+    65535, 65171, 64093, 62341, 59980, 57094, 53780, 50144,
+    46291, 42326, 38340, 34417, 30624, 27016, 23632, 20496,
+    17625, 15022, 12683, 10600, 8759, 7145, 5740, 4527,
+    3491, 2614, 1883, 1286, 811, 451, 199, 50,
+};
+
+uint16_t PWM_LED_Waveform::sample(uint16_t position) const {
+    // the integer part of position * length is the sample index, the
+    // fraction the weight of the next sample
+    uint32_t scaled = (uint32_t)position * _length;
+    uint16_t index = scaled >> 16;
+    uint32_t weight = scaled & 0xFFFF;
+    int32_t from = _table[index];
+    int32_t to = _table[index + 1 < _length? index + 1 : 0];
+    return from + (int32_t)(((int64_t)(to - from) * weight) >> 16);
+};
+
+const PWM_LED_Waveform & PWM_LED_Waveform::sine(){
+    static const PWM_LED_Waveform waveform(SINE);
+    return waveform;
+};
+
+const PWM_LED_Waveform & PWM_LED_Waveform::triangle(){
+    static const PWM_LED_Waveform waveform(TRIANGLE);
+    return waveform;
+};
+
+const PWM_LED_Waveform & PWM_LED_Waveform::breathing(){
+    static const PWM_LED_Waveform waveform(BREATHING);
+    return waveform;
+};
@@ -0,0 +1,90 @@
+/*!
+* @file PWM_LED_Waveform.h
+*
+* @section intro_sec_Introduction
+*
+* Periodic brightness envelopes played from lookup tables.
+*
+* A PWM_LED_Waveform is a table of 16-bit fixed-point samples of one
+* period of an envelope, from 0 (off) to 65535 (the brightness of the
+* LED). `PWM_LED::wave()` plays it: the task driving the LED wakes at a
+* fixed update interval, looks up the position of the current time in the
+* period and interpolates linearly between the two nearest samples. The
+* tables are constant and shared by every LED; each LED only keeps its
+* start time, period, phase and amplitude.
+*
+* The CPU cost of a waveform is one wakeup and at most one duty write per
+* update interval, set per call and by default PWM_LED_WAVE_INTERVAL_US;
+* the duty is only written when it changes.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_WAVEFORM_H__
+#define __PWM_LED_WAVEFORM_H__
+
+#include "PWM_LED_HAL.h"
+
+/// The default interval between two updates of a waveform in 
+/// microseconds (50 Hz). Define before including this header to change it.
+#ifndef PWM_LED_WAVE_INTERVAL_US
+#define PWM_LED_WAVE_INTERVAL_US 20000
+#endif // PWM_LED_WAVE_INTERVAL_US
+
+/// @brief One period of a brightness envelope, as a table of samples
+/// spaced evenly over the period. The last sample is followed by the
+/// first one of the next period.
+class PWM_LED_Waveform{
+
+    public:
+
+    /// @brief Wraps a constant table without copying it.
+    /// @param table Samples from 0 (off) to 65535 (full brightness).
+    template <size_t N>
+    constexpr PWM_LED_Waveform(const uint16_t (&table)[N]):
+        _table(table),
+        _length(N){
+        static_assert(N >= 2 && N <= 0xFFFF,
+                "A waveform has 2 to 65535 samples.");
+    };
+
+    /// @brief The samples.
+    constexpr const uint16_t * table() const { return _table; };
+
+    /// @brief The number of samples.
+    constexpr uint16_t length() const { return _length; };
+
+    /// @brief The envelope at [position], interpolated linearly.
+    /// @param position The position in the period, in 1/65536ths.
+    /// @return The sample, 0 to 65535.
+    uint16_t sample(uint16_t position) const;
+
+    /// @brief A raised cosine: off at the start of the period, full 
+    /// brightness in the middle.
+    static const PWM_LED_Waveform & sine();
+
+    /// @brief A linear ramp up and down.
+    static const PWM_LED_Waveform & triangle();
+
+    /// @brief The "breathing" envelope, exp(sin(x)) scaled to the full
+    /// range, which lingers at low brightness like a sleeping device.
+    static const PWM_LED_Waveform & breathing();
+
+    private:
+
+    const uint16_t * _table;
+
+    uint16_t _length;
+
+};
+
+#endif // __PWM_LED_WAVEFORM_H__
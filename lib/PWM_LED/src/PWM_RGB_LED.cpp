@@ -0,0 +1,183 @@
+/*!
+* @file PWM_RGB_LED.cpp
+*
+* @section intro_sec_Introduction
+*
+* Controls an RGB LED connected to three GPIO pins as a single LED.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "PWM_RGB_LED.h"
+
+PWM_RGB_LED::PWM_RGB_LED(uint8_t redPin,
+        uint8_t redPwmChannel,
+        uint8_t greenPin,
+        uint8_t greenPwmChannel,
+        uint8_t bluePin,
+        uint8_t bluePwmChannel,
+        int & brightness, 
+        int onState):
+            PWM_RGB_LED(PWM_LED_LEDC::shared(), redPin, redPwmChannel, 
+                    greenPin, greenPwmChannel, bluePin, bluePwmChannel,
+                    brightness, onState){};
+
+PWM_RGB_LED::PWM_RGB_LED(PWM_LED_Output & output,
+        uint8_t redPin,
+        uint8_t redChannel,
+        uint8_t greenPin,
+        uint8_t greenChannel,
+        uint8_t bluePin,
+        uint8_t blueChannel,
+        int & brightness, 
+        int onState):
+            PWM_LED(output, redPin, redChannel, brightness, onState),
+            _pins{greenPin, bluePin},
+            _channels{redChannel, greenChannel, blueChannel}{};
+
+PWM_RGB_LED::PWM_RGB_LED(uint8_t redPin,
+        uint8_t redPwmChannel,
+        uint8_t greenPin,
+        uint8_t greenPwmChannel,
+        uint8_t bluePin,
+        uint8_t bluePwmChannel,
+        PWM_LED_BrightnessGroup & group, 
+        int onState):
+            PWM_RGB_LED(PWM_LED_LEDC::shared(), redPin, redPwmChannel, 
+                    greenPin, greenPwmChannel, bluePin, bluePwmChannel,
+                    group, onState){};
+
+PWM_RGB_LED::PWM_RGB_LED(PWM_LED_Output & output,
+        uint8_t redPin,
+        uint8_t redChannel,
+        uint8_t greenPin,
+        uint8_t greenChannel,
+        uint8_t bluePin,
+        uint8_t blueChannel,
+        PWM_LED_BrightnessGroup & group, 
+        int onState):
+            PWM_LED(output, redPin, redChannel, group, onState),
+            _pins{greenPin, bluePin},
+            _channels{redChannel, greenChannel, blueChannel}{};
+
+bool PWM_RGB_LED::_attach(){
+    if (PWM_LED::_attach() && _setupChannels()){
+        _shareTimer();
+        return true;
+    }
+    return false;
+};
+
+void PWM_RGB_LED::setColor(LED_Color color){
+    setColor12(color);
+};
+
+void PWM_RGB_LED::setColor12(uint16_t rgb){
+    // expand each 4-bit channel to 8 bits (0xF -> 0xFF)
+    setColor24(((uint32_t)(rgb & 0xF00) << 8 | (rgb & 0x0F0) << 4 | 
+            (rgb & 0x00F)) * 0x11);
+};
+
+void PWM_RGB_LED::setColor24(uint32_t rgb){
+    _color.store(rgb & 0xFFFFFF);
+    refresh();
+};
+
+void PWM_RGB_LED::setColorHSV(uint16_t hue, 
+        uint8_t saturation, 
+        uint8_t value){
+    setColor24(PWM_LED_hsv(hue, saturation, value));
+};
+
+uint32_t PWM_RGB_LED::color(){
+    return _color.load();
+};
+
+void PWM_RGB_LED::setWhiteBalance(uint32_t rgb){
+    _balance.store(rgb & 0xFFFFFF);
+    refresh();
+};
+
+uint32_t PWM_RGB_LED::whiteBalance(){
+    return _balance.load();
+};
+
+void PWM_RGB_LED::_output(int level){
+    int levels[3];
+    _levels(level, levels);
+    for (uint8_t i = 0; i < 3; i++){
+        _backend.write(_channels[i], _dutyCycle(levels[i]));
+    }
+};
+
+bool PWM_RGB_LED::_fadeHardware(int from, int to, int64_t durationUs){
+    int fromLevels[3];
+    int toLevels[3];
+    _levels(from, fromLevels);
+    _levels(to, toLevels);
+    for (uint8_t i = 0; i < 3; i++){
+        if (!_backend.fade(_channels[i],
+                _dutyCycle(fromLevels[i]),
+                _dutyCycle(toLevels[i]),
+                durationUs)){
+            // stop the channels already fading, so that the software fade
+            // that takes over drives all three from the same start
+            for (uint8_t j = 0; j < i; j++){
+                _backend.write(_channels[j], _dutyCycle(fromLevels[j]));
+            }
+            return false;
+        }
+    }
+    return true;
+};
+
+bool PWM_RGB_LED::_setupChannels(){
+    for (uint8_t i = 0; i < 2; i++){
+        if (!_backend.attach(_pins[i], _channels[i + 1])){
+            return false;
+        }
+    }
+    return true;
+};
+
+void PWM_RGB_LED::_shareTimer(){
+    if (&_backend != &PWM_LED_LEDC::shared()){
+        return;
+    }
+    for (uint8_t i = 1; i < 3; i++){
+        PWM_LED_LEDC::shared().shareTimer(_channels[i], _channels[0]);
+    }
+};
+
+void PWM_RGB_LED::_levels(int level, int levels[3]){
+    typedef PWM_LED_Gamma<16> Linear;
+    uint32_t color = _color.load();
+    uint32_t balance = _balance.load();
+    bool gamma = _gamma.load();
+    // the brightness as linear light in 1/65535ths
+    uint32_t light = gamma? Linear::duty((uint32_t)level * 0xFFFF / 
+            PWM_LED_PWM_MAX_DUTY_CYCLE) : 0;
+    for (uint8_t i = 0; i < 3; i++){
+        uint32_t component = (color >> (16 - 8 * i)) & 0xFF;
+        uint32_t scale = (balance >> (16 - 8 * i)) & 0xFF;
+        if (!gamma){
+            levels[i] = ((uint32_t)level * component * scale + 32512) / 65025;
+            continue;
+        }
+        // both the brightness and the component are perceptual, so they
+        // are multiplied as light to keep the ratio of the channels
+        uint32_t share = Linear::duty(component * 0x101);
+        uint32_t linear = (uint32_t)(((uint64_t)light * share + 0x8000) >> 16);
+        linear = (linear * scale + 127) / 255;
+        levels[i] = (linear * PWM_LED_PWM_MAX_DUTY_CYCLE + 0x7FFF) / 0xFFFF;
+    }
+};
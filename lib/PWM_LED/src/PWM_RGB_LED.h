@@ -0,0 +1,162 @@
+/*!
+* @file PWM_RGB_LED.h
+*
+* @section intro_sec_Introduction
+*
+* Controls an RGB LED connected to three GPIO pins as a single LED.
+*
+* The red, green and blue channels share one command path, one task (or
+* one engine entry) and one timer, and are written together at every edge
+* and fade update, so the color does not tear while the LED flashes or 
+* fades. The color is set with an LED_Color value, an arbitrary 12-bit
+* or 24-bit RGB color or an HSV color and is scaled by the `brightness`
+* and a per-channel white balance.
+*
+* With `setGamma(true)` the brightness and the color components are 
+* treated as perceptual values: both are converted to linear light with
+* PWM_LED_Gamma before they are multiplied, so dimming keeps the ratio of
+* the channels, and with it the hue, and low levels step evenly. All of
+* it is integer maths with no division by a variable.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_RGB_LED_H__
+#define __PWM_RGB_LED_H__
+
+#include "PWM_LED.h"
+
+/// @brief An RGB LED driven as one PWM_LED: `on()`, `off()`, `flash()`
+/// and `fadeTo()` update all three channels in the same step.
+class PWM_RGB_LED: public PWM_LED{
+
+    public:
+
+    PWM_RGB_LED(uint8_t redPin,
+             uint8_t redPwmChannel,
+             uint8_t greenPin,
+             uint8_t greenPwmChannel,
+             uint8_t bluePin,
+             uint8_t bluePwmChannel,
+             int & brightness, 
+             int onState = LOW);
+
+    /// @brief Constructs an RGB LED whose three channels are driven 
+    /// through [output] instead of LEDC channels.
+    PWM_RGB_LED(PWM_LED_Output & output,
+             uint8_t redPin,
+             uint8_t redChannel,
+             uint8_t greenPin,
+             uint8_t greenChannel,
+             uint8_t bluePin,
+             uint8_t blueChannel,
+             int & brightness, 
+             int onState = LOW);
+
+    /// @brief Constructs an RGB LED whose brightness is the level of 
+    /// [group].
+    PWM_RGB_LED(uint8_t redPin,
+             uint8_t redPwmChannel,
+             uint8_t greenPin,
+             uint8_t greenPwmChannel,
+             uint8_t bluePin,
+             uint8_t bluePwmChannel,
+             PWM_LED_BrightnessGroup & group, 
+             int onState = LOW);
+
+    /// @brief Constructs an RGB LED that is driven through [output] and
+    /// whose brightness is the level of [group].
+    PWM_RGB_LED(PWM_LED_Output & output,
+             uint8_t redPin,
+             uint8_t redChannel,
+             uint8_t greenPin,
+             uint8_t greenChannel,
+             uint8_t bluePin,
+             uint8_t blueChannel,
+             PWM_LED_BrightnessGroup & group, 
+             int onState = LOW);
+
+    /// @brief Sets the color to one of the LED_Color values.
+    /// @param color The color.
+    void setColor(LED_Color color);
+
+    /// @brief Sets the color from a 12-bit 0xRGB value.
+    /// @param rgb The color, 4 bits per channel.
+    void setColor12(uint16_t rgb);
+
+    /// @brief Sets the color from a 24-bit 0xRRGGBB value.
+    /// @param rgb The color, 8 bits per channel.
+    void setColor24(uint32_t rgb);
+
+    /// @brief Sets the color from hue, saturation and value. See 
+    /// `PWM_LED_hsv()`.
+    /// @param hue The hue in 1/65536ths of the color circle.
+    /// @param saturation 0 (grey) to 255 (pure color).
+    /// @param value 0 to 255.
+    void setColorHSV(uint16_t hue, uint8_t saturation, uint8_t value = 0xFF);
+
+    /// @brief The current color as a 24-bit 0xRRGGBB value.
+    uint32_t color();
+
+    /// @brief Scales each channel so that the LED shows white for 
+    /// 0xFFFFFF, e.g. 0xFFB0A0 to tame a strong green and blue die.
+    /// @param rgb The scale of each channel, 0 to 255 (1.0).
+    void setWhiteBalance(uint32_t rgb);
+
+    /// @brief The white balance as a 24-bit 0xRRGGBB value.
+    uint32_t whiteBalance();
+
+    protected:
+
+    /// @brief Sets up the three channels when `begin()` is called.
+    bool _attach() override;
+
+    /// @brief Writes [level] to the three channels, scaled by the color.
+    /// @param level The brightness.
+    void _output(int level) override;
+
+    /// @brief Asks the backend to fade the three channels in hardware.
+    bool _fadeHardware(int from, int to, int64_t durationUs) override;
+
+    private:
+
+    /// @brief The GPIO pins of the green and blue channels.
+    uint8_t _pins[2];
+
+    /// @brief The PWM channels of the red, green and blue channels.
+    uint8_t _channels[3];
+
+    /// @brief The color as a 24-bit 0xRRGGBB value.
+    std::atomic<uint32_t> _color{0xFFFFFF};
+
+    /// @brief The white balance as a 24-bit 0xRRGGBB value.
+    std::atomic<uint32_t> _balance{0xFFFFFF};
+
+    /// @brief Sets up the green and blue channels.
+    /// @return false if the backend cannot use them.
+    bool _setupChannels();
+
+    /// @brief Clocks the green and blue channels from the red channel's
+    /// LEDC timer so that all three share one PWM period, if the LED is
+    /// driven by LEDC channels.
+    void _shareTimer();
+
+    /// @brief Computes the duty-cycle brightness of the three channels:
+    /// [level] scaled by the color and the white balance, in linear light
+    /// if the gamma correction is on.
+    /// @param level The brightness.
+    /// @param levels Set to the red, green and blue levels.
+    void _levels(int level, int levels[3]);
+
+};
+
+#endif // __PWM_RGB_LED_H__
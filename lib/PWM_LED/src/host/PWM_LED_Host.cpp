@@ -0,0 +1,512 @@
+/*!
+* @file PWM_LED_Host.cpp
+*
+* @section intro_sec_Introduction
+*
+* Host (Linux) backend of the PWM_LED hardware abstraction layer.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef ARDUINO
+
+#include "PWM_LED_Host.h"
+#include <stdarg.h>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+
+/// @brief The number of channels of the simulated PWM peripheral.
+#define PWM_LED_HOST_CHANNELS 16
+
+/// @brief The size of the simulated heap.
+#define PWM_LED_HOST_HEAP_SIZE 327680
+
+/// @brief The approximate heap cost of a task control block, a queue
+/// (semaphore) and an esp_timer on the ESP32.
+#define PWM_LED_HOST_TCB_BYTES 360
+#define PWM_LED_HOST_QUEUE_BYTES 88
+#define PWM_LED_HOST_TIMER_BYTES 56
+
+/// @brief The bytes taken from the simulated heap.
+static std::atomic<uint32_t> _heapUsed{0};
+
+struct PWM_LED_HostTask{
+
+    std::mutex mutex;
+
+    std::condition_variable notified;
+
+    uint32_t notifications = 0;
+
+};
+
+struct PWM_LED_HostSemaphore{
+
+    std::mutex mutex;
+
+    std::condition_variable given;
+
+    bool available = false;
+
+};
+
+struct PWM_LED_HostTimer{
+
+    esp_timer_cb_t callback;
+
+    void * arg;
+
+    std::mutex mutex;
+
+    std::condition_variable changed;
+
+    /// @brief The expiry time, or -1 when the timer is not running.
+    int64_t due = -1;
+
+};
+
+/// @brief The task of the calling thread. Threads not started by
+/// xTaskCreate() get a task on first use, so that the main thread can
+/// wait for notifications too.
+static thread_local PWM_LED_HostTask * _currentTask = nullptr;
+
+static std::chrono::steady_clock::time_point _epoch()
+{
+    static const std::chrono::steady_clock::time_point epoch =
+            std::chrono::steady_clock::now();
+    return epoch;
+};
+
+/// @brief Waits on [condition] until [ready] returns true, for at most
+/// [ticks] milliseconds. @return the result of [ready].
+template<typename Ready>
+static bool _waitTicks(std::condition_variable & condition,
+        std::unique_lock<std::mutex> & lock,
+        TickType_t ticks,
+        Ready ready)
+{
+    if (ticks == portMAX_DELAY){
+        condition.wait(lock, ready);
+        return true;
+    }
+    return condition.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+};
+
+// ---------------------------------------------------------------------------
+// FreeRTOS
+// ---------------------------------------------------------------------------
+
+BaseType_t xTaskCreate(TaskFunction_t function,
+        const char * name,
+        uint32_t stackDepth,
+        void * parameters,
+        UBaseType_t priority,
+        TaskHandle_t * handle)
+{
+    _heapUsed += stackDepth + PWM_LED_HOST_TCB_BYTES;
+    PWM_LED_HostTask * task = new PWM_LED_HostTask();
+    if (handle) *handle = task;
+    std::thread([task, function, parameters](){
+        _currentTask = task;
+        function(parameters);
+    }).detach();
+    return pdPASS;
+};
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function,
+        const char * name,
+        uint32_t stackDepth,
+        void * parameters,
+        UBaseType_t priority,
+        StackType_t * stack,
+        StaticTask_t * task)
+{
+    TaskHandle_t handle = nullptr;
+    xTaskCreate(function, name, stackDepth, parameters, priority, &handle);
+    // the stack and control block are the caller's
+    _heapUsed -= stackDepth + PWM_LED_HOST_TCB_BYTES;
+    return handle;
+};
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    if (!_currentTask) _currentTask = new PWM_LED_HostTask();
+    return _currentTask;
+};
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+    PWM_LED_HostTask * task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    _waitTicks(task->notified, lock, ticksToWait,
+            [task](){ return task->notifications > 0; });
+    uint32_t value = task->notifications;
+    if (clearOnExit) task->notifications = 0;
+    else if (value) task->notifications--;
+    return value;
+};
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->notified.notify_all();
+    return pdPASS;
+};
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * woken)
+{
+    xTaskNotifyGive(task);
+    if (woken) *woken = pdFALSE;
+};
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+};
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // the thread of the calling task ends when its function returns
+};
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return 0;
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    _heapUsed += PWM_LED_HOST_QUEUE_BYTES;
+    return new PWM_LED_HostSemaphore();
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t * buffer)
+{
+    return new PWM_LED_HostSemaphore();
+};
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (!_waitTicks(semaphore->given, lock, ticksToWait,
+            [semaphore](){ return semaphore->available; })) return pdFALSE;
+    semaphore->available = false;
+    return pdTRUE;
+};
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    {
+        std::lock_guard<std::mutex> lock(semaphore->mutex);
+        if (semaphore->available) return pdFALSE;
+        semaphore->available = true;
+    }
+    semaphore->given.notify_all();
+    return pdTRUE;
+};
+
+// ---------------------------------------------------------------------------
+// ESP-IDF esp_timer
+// ---------------------------------------------------------------------------
+
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _epoch()).count();
+};
+
+/// @brief The thread of a timer: sleeps until the timer is due and runs
+/// its callback with the lock released.
+static void _runTimer(PWM_LED_HostTimer * timer)
+{
+    std::unique_lock<std::mutex> lock(timer->mutex);
+    for (;;){
+        if (timer->due < 0){
+            timer->changed.wait(lock);
+            continue;
+        }
+        std::chrono::steady_clock::time_point due =
+                _epoch() + std::chrono::microseconds(timer->due);
+        timer->changed.wait_until(lock, due);
+        // Stopped or restarted while waiting.
+        if (timer->due < 0 || esp_timer_get_time() < timer->due) continue;
+        timer->due = -1;
+        lock.unlock();
+        timer->callback(timer->arg);
+        lock.lock();
+    }
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * args,
+        esp_timer_handle_t * handle)
+{
+    if (!args || !args->callback || !handle) return ESP_FAIL;
+    _heapUsed += PWM_LED_HOST_TIMER_BYTES;
+    PWM_LED_HostTimer * timer = new PWM_LED_HostTimer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    std::thread(_runTimer, timer).detach();
+    *handle = timer;
+    return ESP_OK;
+};
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        if (timer->due >= 0) return ESP_ERR_INVALID_STATE;
+        timer->due = esp_timer_get_time() + (int64_t)timeoutUs;
+    }
+    timer->changed.notify_all();
+    return ESP_OK;
+};
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        if (timer->due < 0) return ESP_ERR_INVALID_STATE;
+        timer->due = -1;
+    }
+    timer->changed.notify_all();
+    return ESP_OK;
+};
+
+// ---------------------------------------------------------------------------
+// ESP-IDF heap
+// ---------------------------------------------------------------------------
+
+uint32_t esp_get_free_heap_size()
+{
+    return PWM_LED_HOST_HEAP_SIZE - _heapUsed.load();
+};
+
+// ---------------------------------------------------------------------------
+// Arduino
+// ---------------------------------------------------------------------------
+
+unsigned long millis()
+{
+    return (unsigned long)(esp_timer_get_time() / 1000);
+};
+
+unsigned long micros()
+{
+    return (unsigned long)esp_timer_get_time();
+};
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+};
+
+void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+};
+
+/// @brief The levels of the simulated GPIO pins, one bit per pin.
+static std::atomic<uint64_t> _pins{0};
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+};
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin >= 64) return;
+    if (value) _pins.fetch_or((uint64_t)1 << pin);
+    else _pins.fetch_and(~((uint64_t)1 << pin));
+};
+
+int digitalRead(uint8_t pin)
+{
+    if (pin >= 64) return LOW;
+    return (_pins.load() >> pin) & 1 ? HIGH : LOW;
+};
+
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolution)
+{
+    if (channel >= PWM_LED_HOST_CHANNELS) return 0;
+    PWM_LED_Trace::configure(channel, resolution, -1);
+    return frequency;
+};
+
+void ledcAttachPin(uint8_t pin, uint8_t channel)
+{
+    if (channel >= PWM_LED_HOST_CHANNELS) return;
+    PWM_LED_Trace::configure(channel, 0, pin);
+};
+
+void ledcWrite(uint8_t channel, uint32_t duty)
+{
+    if (channel >= PWM_LED_HOST_CHANNELS) return;
+    PWM_LED_Trace::record(channel, duty);
+};
+
+PWM_LED_HostSerial Serial;
+
+void PWM_LED_HostSerial::begin(unsigned long baud)
+{
+};
+
+int PWM_LED_HostSerial::printf(const char * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int count = vprintf(format, args);
+    va_end(args);
+    return count;
+};
+
+void PWM_LED_HostSerial::print(const char * text)
+{
+    fputs(text, stdout);
+};
+
+void PWM_LED_HostSerial::println(const char * text)
+{
+    puts(text);
+};
+
+// ---------------------------------------------------------------------------
+// Output trace
+// ---------------------------------------------------------------------------
+
+/// @brief The configuration of a channel; a resolution of 0 means the
+/// channel was never set up.
+typedef struct {
+    uint8_t resolution;
+    int pin;
+    uint32_t duty;
+} PWM_LED_host_channel_t;
+
+static std::mutex _traceMutex;
+static std::vector<PWM_LED_TraceEvent> _trace;
+static PWM_LED_host_channel_t _channels[PWM_LED_HOST_CHANNELS] = {};
+
+void PWM_LED_Trace::record(uint8_t channel, uint32_t duty)
+{
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    _channels[channel].duty = duty;
+    _trace.push_back({esp_timer_get_time(), channel, duty});
+};
+
+void PWM_LED_Trace::configure(uint8_t channel, uint8_t resolution, int pin)
+{
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    if (resolution) _channels[channel].resolution = resolution;
+    if (pin >= 0) _channels[channel].pin = pin;
+};
+
+std::vector<PWM_LED_TraceEvent> PWM_LED_Trace::events()
+{
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    return _trace;
+};
+
+std::vector<PWM_LED_TraceEvent> PWM_LED_Trace::events(uint8_t channel)
+{
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    std::vector<PWM_LED_TraceEvent> events;
+    for (const PWM_LED_TraceEvent & event : _trace){
+        if (event.channel == channel) events.push_back(event);
+    }
+    return events;
+};
+
+uint32_t PWM_LED_Trace::duty(uint8_t channel)
+{
+    if (channel >= PWM_LED_HOST_CHANNELS) return 0;
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    return _channels[channel].duty;
+};
+
+void PWM_LED_Trace::clear()
+{
+    std::lock_guard<std::mutex> lock(_traceMutex);
+    _trace.clear();
+};
+
+bool PWM_LED_Trace::writeCSV(const char * path)
+{
+    FILE * file = fopen(path, "w");
+    if (!file) return false;
+    std::vector<PWM_LED_TraceEvent> trace = events();
+    fputs("time_us,channel,duty\n", file);
+    for (const PWM_LED_TraceEvent & event : trace){
+        fprintf(file, "%lld,%u,%u\n", (long long)event.timeUs,
+                (unsigned)event.channel, (unsigned)event.duty);
+    }
+    return fclose(file) == 0;
+};
+
+/// @brief Writes [value] as a VCD binary vector of [width] bits.
+static void _writeVector(FILE * file, uint32_t value, uint8_t width, char id)
+{
+    fputc('b', file);
+    for (int bit = width - 1; bit >= 0; bit--){
+        fputc((value >> bit) & 1 ? '1' : '0', file);
+    }
+    fprintf(file, " %c\n", id);
+};
+
+bool PWM_LED_Trace::writeVCD(const char * path)
+{
+    FILE * file = fopen(path, "w");
+    if (!file) return false;
+    std::vector<PWM_LED_TraceEvent> trace;
+    PWM_LED_host_channel_t channels[PWM_LED_HOST_CHANNELS];
+    {
+        std::lock_guard<std::mutex> lock(_traceMutex);
+        trace = _trace;
+        std::copy(_channels, _channels + PWM_LED_HOST_CHANNELS, channels);
+    }
+    // Channels that were written without being set up get a 32 bit signal.
+    for (const PWM_LED_TraceEvent & event : trace){
+        if (!channels[event.channel].resolution){
+            channels[event.channel].resolution = 32;
+        }
+    }
+    fputs("$timescale 1us $end\n$scope module PWM_LED $end\n", file);
+    for (uint8_t channel = 0; channel < PWM_LED_HOST_CHANNELS; channel++){
+        if (!channels[channel].resolution) continue;
+        fprintf(file, "$var wire %u %c ch%u $end\n",
+                (unsigned)channels[channel].resolution,
+                (char)('!' + channel), (unsigned)channel);
+    }
+    fputs("$upscope $end\n$enddefinitions $end\n$dumpvars\n", file);
+    for (uint8_t channel = 0; channel < PWM_LED_HOST_CHANNELS; channel++){
+        if (!channels[channel].resolution) continue;
+        _writeVector(file, 0, channels[channel].resolution,
+                (char)('!' + channel));
+    }
+    fputs("$end\n", file);
+    int64_t time = -1;
+    for (const PWM_LED_TraceEvent & event : trace){
+        if (event.timeUs != time){
+            time = event.timeUs;
+            fprintf(file, "#%lld\n", (long long)time);
+        }
+        _writeVector(file, event.duty, channels[event.channel].resolution,
+                (char)('!' + event.channel));
+    }
+    return fclose(file) == 0;
+};
+
+#endif // ARDUINO
@@ -0,0 +1,274 @@
+/*!
+* @file PWM_LED_Host.h
+*
+* @section intro_sec_Introduction
+*
+* Host (Linux) backend of the PWM_LED hardware abstraction layer.
+*
+* Implements the Arduino, FreeRTOS and ESP-IDF calls used by the library
+* on std::thread and std::chrono::steady_clock:
+* - FreeRTOS tasks are threads; task notifications, semaphores and
+*   critical sections are built on mutexes and condition variables. The
+*   tick is one millisecond.
+* - `esp_timer_get_time()`, `millis()` and `micros()` count from the
+*   start of the process; one-shot `esp_timer`s run their callbacks on a
+*   thread of their own.
+* - `ledcSetup()`, `ledcAttachPin()` and `ledcWrite()` drive a simulated
+*   PWM peripheral. Every `ledcWrite()` is recorded by PWM_LED_Trace as a
+*   timestamped event that can be exported as CSV or VCD.
+*
+* Only included when `ARDUINO` is not defined.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __PWM_LED_HOST_H__
+#define __PWM_LED_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+#define IRAM_ATTR
+
+// ---------------------------------------------------------------------------
+// FreeRTOS
+// ---------------------------------------------------------------------------
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFU
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+struct PWM_LED_HostTask;
+typedef PWM_LED_HostTask * TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/// @brief Storage of a statically allocated task. Unused on the host.
+typedef struct { uint8_t unused; } StaticTask_t;
+
+BaseType_t xTaskCreate(TaskFunction_t function,
+        const char * name,
+        uint32_t stackDepth,
+        void * parameters,
+        UBaseType_t priority,
+        TaskHandle_t * handle);
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function,
+        const char * name,
+        uint32_t stackDepth,
+        void * parameters,
+        UBaseType_t priority,
+        StackType_t * stack,
+        StaticTask_t * task);
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * woken);
+
+void vTaskDelay(TickType_t ticks);
+
+/// @brief Only deletes the calling task ([task] NULL), which must then
+/// return from its function: a host task is a thread, and it ends there.
+void vTaskDelete(TaskHandle_t task);
+
+/// @brief Always 0: thread stacks are not instrumented on the host.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+struct PWM_LED_HostSemaphore;
+typedef PWM_LED_HostSemaphore * SemaphoreHandle_t;
+
+/// @brief Storage of a statically allocated semaphore. Unused on the host.
+typedef struct { uint8_t unused; } StaticSemaphore_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t * buffer);
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+/// @brief A critical section, implemented as a recursive mutex.
+typedef struct { std::recursive_mutex mutex; } portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) ((mux)->mutex.lock())
+#define portEXIT_CRITICAL(mux) ((mux)->mutex.unlock())
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+
+// ---------------------------------------------------------------------------
+// ESP-IDF esp_timer
+// ---------------------------------------------------------------------------
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef void (*esp_timer_cb_t)(void * arg);
+
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void * arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char * name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct PWM_LED_HostTimer;
+typedef PWM_LED_HostTimer * esp_timer_handle_t;
+
+/// @brief Microseconds since the start of the process.
+int64_t esp_timer_get_time();
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * args,
+        esp_timer_handle_t * handle);
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+// ---------------------------------------------------------------------------
+// ESP-IDF heap
+// ---------------------------------------------------------------------------
+
+/// @brief The free size of a simulated heap of PWM_LED_HOST_HEAP_SIZE
+/// bytes. Tasks, semaphores and `esp_timer`s created on the heap are 
+/// charged approximately what they take on the ESP32 (the stack plus the
+/// control block); statically allocated ones are not charged, so the heap
+/// use of a configuration can be compared on the host.
+uint32_t esp_get_free_heap_size();
+
+// ---------------------------------------------------------------------------
+// Arduino
+// ---------------------------------------------------------------------------
+
+unsigned long millis();
+
+unsigned long micros();
+
+void delay(uint32_t ms);
+
+void delayMicroseconds(uint32_t us);
+
+/// @brief Simulated GPIO pins 0 to 63. Writes are not traced.
+void pinMode(uint8_t pin, uint8_t mode);
+
+void digitalWrite(uint8_t pin, uint8_t value);
+
+int digitalRead(uint8_t pin);
+
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolution);
+
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+
+void ledcWrite(uint8_t channel, uint32_t duty);
+
+/// @brief Minimal stand-in for the Arduino `Serial` port, writing to
+/// stdout.
+class PWM_LED_HostSerial{
+
+    public:
+
+    void begin(unsigned long baud);
+
+    int printf(const char * format, ...);
+
+    void print(const char * text);
+
+    void println(const char * text = "");
+
+    explicit operator bool() const { return true; };
+
+};
+
+extern PWM_LED_HostSerial Serial;
+
+// ---------------------------------------------------------------------------
+// Output trace
+// ---------------------------------------------------------------------------
+
+/// @brief A duty cycle written to a PWM channel.
+typedef struct PWM_LED_TraceEvent{
+
+    /// @brief The `esp_timer_get_time()` time of the write.
+    int64_t timeUs;
+
+    /// @brief The PWM channel.
+    uint8_t channel;
+
+    /// @brief The duty cycle written.
+    uint32_t duty;
+
+} PWM_LED_trace_event_t;
+
+/// @brief Records the output timeline of the simulated PWM peripheral.
+class PWM_LED_Trace{
+
+    public:
+
+    /// @brief Records a write. Called by `ledcWrite()`.
+    static void record(uint8_t channel, uint32_t duty);
+
+    /// @brief Records the resolution and pin of a channel. Called by
+    /// `ledcSetup()` and `ledcAttachPin()`.
+    static void configure(uint8_t channel, uint8_t resolution, int pin);
+
+    /// @brief A copy of the events recorded so far.
+    static std::vector<PWM_LED_TraceEvent> events();
+
+    /// @brief The events recorded for one channel.
+    static std::vector<PWM_LED_TraceEvent> events(uint8_t channel);
+
+    /// @brief The last duty written to [channel], or 0.
+    static uint32_t duty(uint8_t channel);
+
+    /// @brief Discards the recorded events.
+    static void clear();
+
+    /// @brief Writes the events as CSV (`time_us,channel,duty`).
+    /// @return false if the file could not be written.
+    static bool writeCSV(const char * path);
+
+    /// @brief Writes the events as a Value Change Dump with one integer
+    /// signal per configured channel and a 1 us timescale.
+    /// @return false if the file could not be written.
+    static bool writeVCD(const char * path);
+
+};
+
+#endif // __PWM_LED_HOST_H__
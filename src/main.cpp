@@ -8,10 +8,11 @@
 *
 * This sketch requires an RGB LED connected to pins 14, 27 and 12. The
 * LEDs are associated with three instances of the PWM_LED class and
-* driven by PWM channels 2, 3 and 4 respectively. The three LEDs all
-* use the same `brightness` value, passed by reference to the PWM_LED
-* instances. Changing the value of `brightness` changes the brightness
-* of all three LEDs.
+* driven by PWM channels 2, 3 and 4 respectively. All three LEDs are
+* driven by one shared PWM_LED_Engine task. The three LEDs all
+* belong to the same `brightness` group. Setting the level of the group
+* changes the brightness of all three LEDs at once, including an LED that
+* is on.
 *
 * The PWM_LED instances are initialized in the `setup()`
 * routine and then turned on for 1 second, one after the other.
@@ -19,8 +20,8 @@
 * During the loop() task the LEDs are activated as follows:
 * - the RED LED is turned on for 1.5 seconds and then turned off.
 * - the GREEN LED is turned on for 1 second and then turned off.
-* - the BLUE LED is flashed in a dot-dash-dot (. - .) pattern for 
-*   5 seconds and then turned on.
+* - the BLUE LED is flashed in a dot-dash-dot (. - .) pattern 5 times,
+*   and the loop waits until it is done.
 *
 *
 * The brightness is halved at the end of every loop and rolls over 
@@ -61,9 +62,11 @@
 /// @brief Create a dot - dash - dot flashing pattern
 uint16_t pattern[] = {DOT,OFF,DASH,OFF,DOT,BREAK};
 
-/// @brief The variable that holds the brightness value, passed
-/// by reference to the PWM_LED instance.
-int brightness = 0xff;
+/// @brief The brightness shared by the three LEDs.
+PWM_LED_BrightnessGroup brightness(0xff);
+
+/// @brief The engine task shared by the three LEDs.
+PWM_LED_Engine engine;
 
 // instantiate the PWM_LED instances.
 PWM_LED red(LED_RED_PIN, LED_RED_PWM, brightness, HIGH);
@@ -81,10 +84,13 @@ void setup() {
   // handshake
   Serial.println("Up and running!");
 
-  // initialize the LED instances
-  red.begin();
-  blue.begin();
-  green.begin();
+  // initialize the LED instances in one pass
+  PWM_LED * leds[] = {&red, &blue, &green};
+  engine.begin(leds, 3);
+  // so that halving the brightness looks like an even step
+  for (PWM_LED * led : leds){
+    led->setGamma(true);
+  }
 
   // test the LEDs are working
   red.on();
@@ -96,7 +102,7 @@ void setup() {
   blue.on();
   delay (500);
   // set the brightness around 25%
-  brightness = 64;
+  brightness.set(64);
   Serial.println("setup() done!");
   delay(1000);            // wait one second  
   blue.off();             // turn BLUE off
@@ -106,8 +112,8 @@ void loop() {
 
   // print the brightness to the debug port
   Serial.printf("Brightness is %S percent (%u)\n", 
-    String(double(brightness) / 0xff * 100, 0), 
-    brightness);
+    String(double(brightness.level()) / 0xff * 100, 0), 
+    brightness.level());
   
   // do a bit of turning on and off and flashing
   delay(1000);            // wait one second
@@ -119,15 +125,12 @@ void loop() {
   delay(2000);            // keep RED on for 2 seconds
   red.off();              // turn RED off
   delay(1000);            // wait one second
-  blue.flash(pattern, 6); // flash dot-dash-dot pattern on BLUE
-  delay(10000);            // keep flashing for 10 seconds
-  blue.off();             // turn BLUE off
+  // flash dot-dash-dot pattern on BLUE five times and wait until done
+  blue.flash(pattern, 6, PWM_LED_UNIT_MS, 5).wait();
  
-  // halve the brightness
-  brightness = (int)((float)(brightness) / 2);
-  
-  // roll over brightness at zero
-  brightness = brightness <= 1 ? 0xff : brightness;
+  // halve the brightness and roll over at or below 1
+  int level = brightness.level() / 2;
+  brightness.set(level <= 1 ? 0xff : level);
   // double the dot lengths until they are 2.5 seconds long
   pattern[0] = pattern[0] > 2500? 10: pattern[0] * 2;;
   pattern[4] = pattern[0];
@@ -0,0 +1,130 @@
+/*!
+* @file test_bam.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of the bit-angle modulation backend: the planes it writes for the
+* duty of an LED and the time each plane is shown.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+#include "PWM_LED_BAM.h"
+
+/// The BAM channel of the LED, which is also its bit of the planes.
+#define BAM_CHANNEL 5
+
+/// A coarse depth and frame rate, so that the shortest slot of 1333 us
+/// is long against the jitter of the host timer.
+#define BAM_BITS 4
+#define BAM_FRAME_HZ 50
+
+#define BAM_SLOT_US (1000000 / (BAM_FRAME_HZ * ((1 << BAM_BITS) - 1)))
+
+/// The number of frames whose planes are checked.
+#define BAM_FRAMES 10
+
+/// A brightness of 170 of 255 is rounded to 10 of 15: planes 1 and 3.
+static int brightness = 170;
+
+#define BAM_VALUE 10
+
+/// @brief A sink that records the time and the first word of every plane.
+class RecordingSink: public PWM_LED_BAM_Sink{
+
+    public:
+
+    int16_t attach(uint8_t, uint8_t channel) override {
+        return channel;
+    };
+
+    void write(const uint32_t * plane) override {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _writes.push_back({esp_timer_get_time(), 0, plane[0]});
+    };
+
+    /// @brief The planes written at or after [fromUs]; the duty of each
+    /// event holds the plane.
+    std::vector<PWM_LED_TraceEvent> writes(int64_t fromUs){
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<PWM_LED_TraceEvent> writes;
+        for (const PWM_LED_TraceEvent & write : _writes){
+            if (write.timeUs >= fromUs){
+                writes.push_back(write);
+            }
+        }
+        return writes;
+    };
+
+    private:
+
+    std::mutex _mutex;
+
+    std::vector<PWM_LED_TraceEvent> _writes;
+
+};
+
+static RecordingSink sink;
+
+static PWM_LED_BAM bam(sink, BAM_BITS, BAM_FRAME_HZ);
+
+static PWM_LED bamLed(bam, 0, BAM_CHANNEL, brightness, HIGH);
+
+/// @brief Checks that every plane written from [fromUs] holds bit n of
+/// [value] for the LED, and returns the share of the time the LED was on
+/// in thousandths.
+static int64_t checkPlanes(int64_t fromUs, uint8_t value){
+    std::vector<PWM_LED_TraceEvent> writes = sink.writes(fromUs);
+    TEST_ASSERT_GREATER_OR_EQUAL(BAM_FRAMES * BAM_BITS, writes.size());
+    // planes are written in order, and the last one of a frame is shown
+    // for half of it, so the longest of the first slots tells them apart
+    size_t last = 0;
+    for (size_t k = 1; k < BAM_BITS; k++){
+        if (writes[k + 1].timeUs - writes[k].timeUs >
+                writes[last + 1].timeUs - writes[last].timeUs){
+            last = k;
+        }
+    }
+    int64_t onUs = 0;
+    int64_t totalUs = 0;
+    for (size_t k = 0; k + 1 < writes.size(); k++){
+        int64_t slotUs = writes[k + 1].timeUs - writes[k].timeUs;
+        uint8_t plane = (k + 2 * BAM_BITS - 1 - last) % BAM_BITS;
+        bool on = (writes[k].duty >> BAM_CHANNEL) & 1;
+        TEST_ASSERT_EQUAL(bool((value >> plane) & 1), on);
+        onUs += on? slotUs : 0;
+        totalUs += slotUs;
+    }
+    return onUs * 1000 / totalUs;
+};
+
+static void test_bam_planes(){
+    TEST_ASSERT_TRUE(bamLed.begin());
+    bamLed.on();
+    // a duty takes effect from the next frame
+    delay(1000 / BAM_FRAME_HZ + 5);
+    int64_t startUs = esp_timer_get_time();
+    delay(BAM_FRAMES * 1000 / BAM_FRAME_HZ);
+    TEST_ASSERT_INT_WITHIN(50, BAM_VALUE * 1000 / ((1 << BAM_BITS) - 1),
+            checkPlanes(startUs, BAM_VALUE));
+    TEST_ASSERT_GREATER_OR_EQUAL(BAM_FRAMES, bam.frames());
+    bamLed.off();
+    delay(1000 / BAM_FRAME_HZ + 5);
+    startUs = esp_timer_get_time();
+    delay(BAM_FRAMES * 1000 / BAM_FRAME_HZ);
+    TEST_ASSERT_EQUAL(0, checkPlanes(startUs, 0));
+};
+
+void runBamTests(){
+    RUN_TEST(test_bam_planes);
+};
@@ -0,0 +1,110 @@
+/*!
+* @file test_brightness.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of brightness groups: a new level reaches steady and flashing
+* members right away, and the members of an engine in one pass.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+
+#define GROUP_CHANNEL 50
+
+#define GROUP_LEDS 4
+
+/// The member that flashes; the others are steady on.
+#define FLASHING_LED 3
+
+#define BRIGHT 200
+#define DIM 50
+
+/// The longest a member may take to apply a new level: one tick, and
+/// the host scheduling delay of its task.
+#define APPLY_BOUND_US 5000
+
+/// The longest time between the writes of the members of one engine.
+#define PASS_BOUND_US 1000
+
+static RecordingOutput recorder;
+
+static PWM_LED_BrightnessGroup group(BRIGHT);
+
+static PWM_LED_Engine groupEngine;
+
+/// Two steady members on their own tasks and two on an engine, one of
+/// which flashes.
+static PWM_LED groupLeds[GROUP_LEDS] = {
+    {recorder, 50, GROUP_CHANNEL + 0, group, HIGH},
+    {recorder, 51, GROUP_CHANNEL + 1, group, HIGH},
+    {recorder, 52, GROUP_CHANNEL + 2, group, HIGH},
+    {recorder, 53, GROUP_CHANNEL + 3, group, HIGH}};
+
+/// On for 200 ms, so that the level changes in the middle of a step.
+static const uint16_t SLOW_STEPS[] = {200, 200};
+
+static constexpr PWM_LED_Pattern SLOW(SLOW_STEPS);
+
+static void test_group_level(){
+    TEST_ASSERT_TRUE(groupLeds[0].begin());
+    TEST_ASSERT_TRUE(groupLeds[1].begin());
+    TEST_ASSERT_TRUE(groupLeds[2].begin(groupEngine));
+    TEST_ASSERT_TRUE(groupLeds[FLASHING_LED].begin(groupEngine));
+    TEST_ASSERT_EQUAL(GROUP_LEDS, group.size());
+    for (uint8_t i = 0; i < GROUP_LEDS; i++){
+        if (i == FLASHING_LED){
+            groupLeds[i].flash(SLOW);
+        } else {
+            groupLeds[i].on();
+        }
+    }
+    delay(50);
+    for (uint8_t i = 0; i < GROUP_LEDS; i++){
+        TEST_ASSERT_EQUAL_UINT32(BRIGHT,
+                recorder.writes(GROUP_CHANNEL + i, 0).back().duty);
+    }
+    int64_t setUs = esp_timer_get_time();
+    group.set(DIM);
+    delay(50);
+    int64_t engineUs[GROUP_LEDS];
+    for (uint8_t i = 0; i < GROUP_LEDS; i++){
+        // every member, the flashing one in its `on` step too, writes the
+        // new level at once and never the old one again
+        std::vector<PWM_LED_TraceEvent> writes =
+                recorder.writes(GROUP_CHANNEL + i, setUs);
+        TEST_ASSERT_EQUAL(1, writes.size());
+        TEST_ASSERT_EQUAL_UINT32(DIM, writes[0].duty);
+        TEST_ASSERT_LESS_OR_EQUAL(APPLY_BOUND_US, writes[0].timeUs - setUs);
+        engineUs[i] = writes[0].timeUs;
+    }
+    // the engine re-writes its members in the same pass
+    TEST_ASSERT_INT_WITHIN(PASS_BOUND_US, engineUs[2],
+            engineUs[FLASHING_LED]);
+    // the next `on` step of the flashing member plays the new level
+    delay(2 * SLOW_STEPS[0]);
+    std::vector<PWM_LED_TraceEvent> flashed =
+            recorder.writes(GROUP_CHANNEL + FLASHING_LED, setUs);
+    TEST_ASSERT_GREATER_OR_EQUAL(3, flashed.size());
+    for (const PWM_LED_TraceEvent & write : flashed){
+        TEST_ASSERT_TRUE(write.duty == 0 || write.duty == DIM);
+    }
+    for (PWM_LED & led : groupLeds){
+        led.off();
+    }
+    group.set(BRIGHT);
+};
+
+void runBrightnessTests(){
+    RUN_TEST(test_group_level);
+};
@@ -0,0 +1,166 @@
+/*!
+* @file test_color.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of the color maths: the gamma tables against the lightness curve,
+* HSV colors, and the duty cycles an RGB LED writes for its color, white
+* balance and gamma correction.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+#include "PWM_RGB_LED.h"
+
+#define RED_CHANNEL 60
+#define GREEN_CHANNEL 61
+#define BLUE_CHANNEL 62
+#define MONO_CHANNEL 63
+
+/// The longest time between the writes of the three channels of one
+/// update.
+#define UPDATE_BOUND_US 1000
+
+static_assert(PWM_LED_hsv(0, 0xFF, 0xFF) == 0xFF0000, "red");
+static_assert(PWM_LED_hsv(0x5555, 0xFF, 0xFF) == 0x00FF00, "green");
+static_assert(PWM_LED_hsv(0xAAAA, 0xFF, 0xFF) == 0x0000FF, "blue");
+static_assert(PWM_LED_hsv(0x8000, 0xFF, 0x80) == 0x008080, "teal");
+static_assert(PWM_LED_hsv(0x1234, 0, 0x80) == 0x808080, "grey");
+static_assert(PWM_LED_Gamma<8>::duty(0) == 0, "black");
+static_assert(PWM_LED_Gamma<8>::duty(255) == 255, "white");
+
+static int brightness = 200;
+
+static RecordingOutput recorder;
+
+static PWM_RGB_LED rgbLed(recorder, 60, RED_CHANNEL, 61, GREEN_CHANNEL,
+        62, BLUE_CHANNEL, brightness, HIGH);
+
+static PWM_LED monoLed(recorder, 63, MONO_CHANNEL, brightness, HIGH);
+
+static const uint16_t BLINK_STEPS[] = {20, 20};
+
+static constexpr PWM_LED_Pattern BLINK(BLINK_STEPS);
+
+/// @brief The last duty cycle written to [channel].
+static uint32_t lastDuty(uint8_t channel){
+    return recorder.writes(channel, 0).back().duty;
+};
+
+/// @brief Checks the duty cycles last written to the red, green and blue
+/// channels.
+static void checkRgb(uint32_t red, uint32_t green, uint32_t blue){
+    delay(10);
+    TEST_ASSERT_EQUAL_UINT32(red, lastDuty(RED_CHANNEL));
+    TEST_ASSERT_EQUAL_UINT32(green, lastDuty(GREEN_CHANNEL));
+    TEST_ASSERT_EQUAL_UINT32(blue, lastDuty(BLUE_CHANNEL));
+};
+
+/// @brief Checks that the gamma table of a resolution rises and that
+/// its lookups stay within [tolerance] of the curve.
+template <uint8_t Resolution>
+static void checkGamma(uint32_t tolerance){
+    typedef PWM_LED_Gamma<Resolution> Gamma;
+    uint32_t previous = 0;
+    for (uint32_t level = 0; level <= Gamma::maxDuty; level++){
+        uint32_t duty = Gamma::duty(level);
+        TEST_ASSERT_GREATER_OR_EQUAL(previous, duty);
+        TEST_ASSERT_INT_WITHIN(tolerance, Gamma::curve(level), duty);
+        previous = duty;
+    }
+    TEST_ASSERT_EQUAL_UINT32(Gamma::maxDuty, previous);
+};
+
+static void test_gamma_curve(){
+    // up to 8 bits every level has an entry; above, a lookup is on the
+    // chord between two entries, a few levels off the curve at most
+    checkGamma<8>(0);
+    checkGamma<12>(3);
+    checkGamma<16>(4);
+    // the linear foot, and L* = 50 at 18.4% of the light
+    TEST_ASSERT_EQUAL_UINT32(100, PWM_LED_Gamma<16>::curve(903));
+    TEST_ASSERT_INT_WITHIN(2, 12071, PWM_LED_Gamma<16>::curve(0x8000));
+};
+
+static void test_rgb_color(){
+    TEST_ASSERT_TRUE(rgbLed.begin());
+    TEST_ASSERT_TRUE(monoLed.begin());
+    rgbLed.setColor24(0xFF8000);
+    rgbLed.on();
+    checkRgb(200, 100, 0);
+    rgbLed.setColorHSV(0x5555, 0xFF);
+    checkRgb(0, 200, 0);
+    TEST_ASSERT_EQUAL_UINT32(0x00FF00, rgbLed.color());
+    rgbLed.setColor(COLOR_CYAN);
+    rgbLed.setWhiteBalance(0xFFFF80);
+    checkRgb(0, 200, 100);
+    rgbLed.setWhiteBalance(0xFFFFFF);
+    rgbLed.setColor24(0xFFFFFF);
+    // the three channels of an edge are written together
+    int64_t startUs = esp_timer_get_time();
+    rgbLed.flash(BLINK);
+    delay(4 * BLINK_STEPS[0] + 10);
+    rgbLed.off();
+    delay(10);
+    std::vector<PWM_LED_TraceEvent> red = recorder.writes(RED_CHANNEL, startUs);
+    std::vector<PWM_LED_TraceEvent> green =
+            recorder.writes(GREEN_CHANNEL, startUs);
+    std::vector<PWM_LED_TraceEvent> blue =
+            recorder.writes(BLUE_CHANNEL, startUs);
+    TEST_ASSERT_GREATER_OR_EQUAL(4, red.size());
+    TEST_ASSERT_EQUAL(red.size(), green.size());
+    TEST_ASSERT_EQUAL(red.size(), blue.size());
+    for (size_t i = 0; i < red.size(); i++){
+        TEST_ASSERT_EQUAL_UINT32(red[i].duty, green[i].duty);
+        TEST_ASSERT_EQUAL_UINT32(red[i].duty, blue[i].duty);
+        TEST_ASSERT_INT_WITHIN(UPDATE_BOUND_US, red[i].timeUs, blue[i].timeUs);
+    }
+};
+
+static void test_rgb_gamma(){
+    // a single LED writes the corrected level
+    monoLed.setGamma(true);
+    monoLed.on();
+    delay(10);
+    TEST_ASSERT_EQUAL_UINT32(PWM_LED_Gamma<8>::duty(brightness),
+            lastDuty(MONO_CHANNEL));
+    monoLed.off();
+    monoLed.setGamma(false);
+    // a perceptual component of 0x80 is about 18% of the light
+    rgbLed.setGamma(true);
+    rgbLed.setColor24(0xFF8080);
+    brightness = 255;
+    rgbLed.on();
+    delay(10);
+    TEST_ASSERT_EQUAL_UINT32(255, lastDuty(RED_CHANNEL));
+    uint32_t green = lastDuty(GREEN_CHANNEL);
+    TEST_ASSERT_INT_WITHIN(1, PWM_LED_Gamma<8>::duty(0x80), green);
+    TEST_ASSERT_EQUAL_UINT32(green, lastDuty(BLUE_CHANNEL));
+    // dimming keeps the ratio of the channels, and with it the hue
+    brightness = 180;
+    rgbLed.refresh();
+    delay(10);
+    uint32_t red = lastDuty(RED_CHANNEL);
+    TEST_ASSERT_INT_WITHIN(1, PWM_LED_Gamma<8>::duty(180), red);
+    TEST_ASSERT_INT_WITHIN(1, (red * green + 127) / 255,
+            lastDuty(GREEN_CHANNEL));
+    rgbLed.off();
+    rgbLed.setGamma(false);
+    brightness = 200;
+};
+
+void runColorTests(){
+    RUN_TEST(test_gamma_curve);
+    RUN_TEST(test_rgb_color);
+    RUN_TEST(test_rgb_gamma);
+};
@@ -0,0 +1,395 @@
+/*!
+* @file test_commands.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of `on()`, `off()` and `flash()`, including commands published
+* from several threads at once.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+#include "PWM_LED_FrameBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#define TASK_CHANNEL 0
+#define ENGINE_CHANNEL 1
+#define STATE_CHANNEL 2
+#define REGISTRY_CHANNEL 3
+#define WAIT_CHANNEL 19
+#define SLACK_CHANNEL 20
+#define ISR_CHANNEL 22
+#define FRAME_CHANNEL 23
+#define DONE_CHANNEL 44
+
+/// The number of commands from ISRs whose latency is measured.
+#define ISR_SAMPLES 200
+
+/// The number of sequences whose `wait()` is timed against their last
+/// edge.
+#define DONE_SAMPLES 20
+
+/// The documented worst case from an edge to the task it wakes, or from
+/// an ISR command to its edge: one tick. The host threads can be 
+/// preempted at any time, so only the median of `wait()` and the 99th
+/// percentile of ISR commands are held to it.
+#define LATENCY_BOUND_US (portTICK_PERIOD_MS * 1000)
+
+/// The host bound of every wakeup: a task woken this late was not woken 
+/// by its edge, nor an edge this late by its command.
+#define HOST_BOUND_US (20 * LATENCY_BOUND_US)
+
+/// The number of LEDs that flash run-time patterns at once.
+#define REGISTRY_LEDS 8
+
+/// The number of threads publishing to one LED at once.
+#define STRESS_THREADS 4
+
+/// The number of commands of each thread; every third is `off()` and the
+/// last is `flash()`.
+#define STRESS_COMMANDS 3001
+
+static int brightness = 200;
+
+static PWM_LED_Engine engine;
+
+static PWM_LED taskLed(10, TASK_CHANNEL, brightness, HIGH);
+
+static PWM_LED engineLed(11, ENGINE_CHANNEL, brightness, HIGH);
+
+static PWM_LED stateLed(12, STATE_CHANNEL, brightness, HIGH);
+
+static PWM_LED registryLeds[REGISTRY_LEDS] = {
+    {13, REGISTRY_CHANNEL + 0, brightness, HIGH},
+    {14, REGISTRY_CHANNEL + 1, brightness, HIGH},
+    {15, REGISTRY_CHANNEL + 2, brightness, HIGH},
+    {16, REGISTRY_CHANNEL + 3, brightness, HIGH},
+    {17, REGISTRY_CHANNEL + 4, brightness, HIGH},
+    {18, REGISTRY_CHANNEL + 5, brightness, HIGH},
+    {19, REGISTRY_CHANNEL + 6, brightness, HIGH},
+    {20, REGISTRY_CHANNEL + 7, brightness, HIGH}};
+
+/// @brief A backend past the simulated LEDC channels, for tests that do
+/// not read the output.
+class SilentOutput: public PWM_LED_Output{
+
+    public:
+
+    bool attach(uint8_t, uint8_t) override {
+        return true;
+    };
+
+    void write(uint8_t, uint32_t) override {};
+
+};
+
+static SilentOutput silent;
+
+static PWM_LED waitLed(silent, 29, WAIT_CHANNEL, brightness, HIGH);
+
+static RecordingOutput recorder;
+
+static PWM_LED isrLed(recorder, 36, ISR_CHANNEL, brightness, HIGH);
+
+static PWM_LED frameLed(recorder, 37, FRAME_CHANNEL, brightness, HIGH);
+
+static PWM_LED doneLed(recorder, 38, DONE_CHANNEL, brightness, HIGH);
+
+/// A frame buffer that shows frames as fast as its task can.
+static PWM_LED_FrameBuffer<1> panel(1);
+
+static PWM_LED_Engine slackEngine;
+
+static PWM_LED slackLeds[2] = {
+    {silent, 30, SLACK_CHANNEL + 0, brightness, HIGH},
+    {silent, 31, SLACK_CHANNEL + 1, brightness, HIGH}};
+
+/// Thread [t] flashes on and off for (t + 1) x 10 ms, so the pattern that
+/// plays tells which thread published it.
+static const uint16_t stressSteps[STRESS_THREADS][2] = {
+    {10, 10}, {20, 20}, {30, 30}, {40, 40}};
+
+static const PWM_LED_Pattern stressPatterns[STRESS_THREADS] = {
+    PWM_LED_Pattern(stressSteps[0]),
+    PWM_LED_Pattern(stressSteps[1]),
+    PWM_LED_Pattern(stressSteps[2]),
+    PWM_LED_Pattern(stressSteps[3])};
+
+static void countDone(void * context, bool){
+    static_cast<std::atomic<uint32_t>*>(context)->fetch_add(1);
+};
+
+/// @brief Hammers [led] with `flash()` and `off()` from several threads,
+/// then checks that the command the LED settled on plays whole and that
+/// every command was completed exactly once.
+static void stress(PWM_LED & led, uint8_t channel){
+    std::atomic<uint32_t> done[STRESS_THREADS];
+    uint32_t flashed[STRESS_THREADS] = {};
+    uint32_t last[STRESS_THREADS] = {};
+    uint32_t dropped = PWM_LED_Dispatcher::dropped();
+    std::thread threads[STRESS_THREADS];
+    for (uint8_t t = 0; t < STRESS_THREADS; t++){
+        done[t].store(0);
+        threads[t] = std::thread([&, t]{
+            for (uint32_t k = 0; k < STRESS_COMMANDS; k++){
+                if (k % 3 == 2){
+                    led.off();
+                } else {
+                    PWM_LED_Handle handle = led.flash(stressPatterns[t], 0,
+                            countDone, &done[t]);
+                    flashed[t]++;
+                    last[t] = handle.sequence();
+                }
+            }
+        });
+    }
+    for (std::thread & thread : threads){
+        thread.join();
+    }
+    delay(50);
+    // the sequence of the playing command tells which call published it
+    uint32_t sequence = led.sequence();
+    int winner = -1;
+    for (uint8_t t = 0; t < STRESS_THREADS; t++){
+        if (last[t] == sequence){
+            winner = t;
+        }
+    }
+    int64_t from = esp_timer_get_time();
+    delay(300);
+    std::vector<PWM_LED_TraceEvent> played = edges(channel, from);
+    if (winner < 0){
+        // an `off()` was the newest command
+        TEST_ASSERT_EQUAL(LED_OFF, led.state());
+        TEST_ASSERT_EQUAL_UINT32(0, PWM_LED_Trace::duty(channel));
+        TEST_ASSERT_EQUAL(0, played.size());
+    } else {
+        TEST_ASSERT_EQUAL(LED_FLASHING, led.state());
+        TEST_ASSERT_GREATER_OR_EQUAL(4, played.size());
+        // edges are anchored to the pattern start, so late edges do not
+        // shift the mean step
+        int64_t meanUs = (played.back().timeUs - played.front().timeUs) / 
+                (int64_t)(played.size() - 1);
+        TEST_ASSERT_INT_WITHIN(3000, (winner + 1) * 10000, meanUs);
+    }
+    // replacing the last flash completes it; every flash is then done
+    // once, either through its callback or as a dropped callback
+    led.off();
+    delay(50);
+    uint32_t calls = 0;
+    uint32_t completions = 0;
+    for (uint8_t t = 0; t < STRESS_THREADS; t++){
+        TEST_ASSERT_LESS_OR_EQUAL(flashed[t], done[t].load());
+        calls += flashed[t];
+        completions += done[t].load();
+    }
+    TEST_ASSERT_EQUAL_UINT32(calls,
+            completions + PWM_LED_Dispatcher::dropped() - dropped);
+    TEST_ASSERT_EQUAL(LED_OFF, led.state());
+    TEST_ASSERT_EQUAL_UINT32(0, PWM_LED_Trace::duty(channel));
+};
+
+static void test_concurrent_commands_task(){
+    TEST_ASSERT_TRUE(taskLed.begin());
+    stress(taskLed, TASK_CHANNEL);
+};
+
+static void test_concurrent_commands_engine(){
+    TEST_ASSERT_TRUE(engineLed.begin(engine));
+    stress(engineLed, ENGINE_CHANNEL);
+};
+
+static void test_state_follows_commands(){
+    TEST_ASSERT_TRUE(stateLed.begin());
+    for (uint16_t i = 0; i < 1000; i++){
+        stateLed.on();
+        TEST_ASSERT_EQUAL(LED_ON, stateLed.state());
+        stateLed.off();
+        TEST_ASSERT_EQUAL(LED_OFF, stateLed.state());
+    }
+    stateLed.flash(stressPatterns[0]);
+    TEST_ASSERT_EQUAL(LED_FLASHING, stateLed.state());
+    delay(20);
+    TEST_ASSERT_EQUAL(LED_FLASHING, stateLed.state());
+    stateLed.off();
+    TEST_ASSERT_EQUAL(LED_OFF, stateLed.state());
+};
+
+static void test_registry_exhaustion(){
+    // every LED changes its run-time pattern many times, so the registry
+    // only holds up if each LED pins just the pattern it plays
+    uint16_t steps[2];
+    for (PWM_LED & led : registryLeds){
+        TEST_ASSERT_TRUE(led.begin());
+    }
+    for (uint16_t round = 0; round < 20; round++){
+        for (uint8_t i = 0; i < REGISTRY_LEDS; i++){
+            steps[0] = 10 + round;
+            steps[1] = 10 + i;
+            TEST_ASSERT_TRUE(registryLeds[i].flash(steps, 2));
+        }
+        delay(5);
+    }
+    delay(20);
+    TEST_ASSERT_LESS_OR_EQUAL(REGISTRY_LEDS, PWM_LED_Patterns::size());
+    // a full registry is reported and leaves the LED as it was
+    const PWM_LED_Pattern * held[PWM_LED_PATTERN_REGISTRY_SIZE];
+    uint8_t heldCount = 0;
+    for (uint16_t i = 0; i < PWM_LED_PATTERN_REGISTRY_SIZE; i++){
+        steps[0] = 1000 + i;
+        const PWM_LED_Pattern * pattern = PWM_LED_Patterns::intern(steps, 2);
+        if (pattern != NULL){
+            held[heldCount++] = pattern;
+        }
+    }
+    steps[0] = 2000;
+    TEST_ASSERT_FALSE(registryLeds[0].flash(steps, 2));
+    TEST_ASSERT_TRUE(registryLeds[0].flash(steps, 2, PWM_LED_UNIT_MS, 1)
+            .done());
+    TEST_ASSERT_EQUAL(LED_FLASHING, registryLeds[0].state());
+    for (uint8_t i = 0; i < heldCount; i++){
+        PWM_LED_Patterns::release(held[i]);
+    }
+    TEST_ASSERT_TRUE(registryLeds[0].flash(steps, 2));
+    for (PWM_LED & led : registryLeds){
+        led.off();
+    }
+};
+
+static void test_second_waiter_refused(){
+    // three cycles of 40 ms
+    TEST_ASSERT_TRUE(waitLed.begin());
+    PWM_LED_Handle handle = waitLed.flash(stressPatterns[1], 3);
+    std::atomic<bool> first{false};
+    std::thread waiter([&]{ first.store(handle.wait(1000)); });
+    delay(20);
+    // the LED can only wake one waiter, so a second one returns at once
+    // rather than leaving the first asleep
+    uint32_t start = millis();
+    TEST_ASSERT_FALSE(handle.wait(1000));
+    TEST_ASSERT_LESS_THAN(10, millis() - start);
+    waiter.join();
+    TEST_ASSERT_TRUE(first.load());
+    TEST_ASSERT_TRUE(handle.wait(0));
+    TEST_ASSERT_EQUAL(LED_OFF, waitLed.state());
+};
+
+static void test_wait_follows_last_edge(){
+    TEST_ASSERT_TRUE(doneLed.begin());
+    delay(10);
+    std::vector<int64_t> delays;
+    for (uint8_t i = 0; i < DONE_SAMPLES; i++){
+        // two cycles of 10 ms
+        int64_t start = esp_timer_get_time();
+        PWM_LED_Handle handle = doneLed.flash(stressPatterns[0], 2);
+        TEST_ASSERT_TRUE(handle.wait(1000));
+        int64_t woken = esp_timer_get_time();
+        // the sequence ends with the write that turns the LED off at the
+        // end of its last cycle
+        PWM_LED_TraceEvent last = recorder.writes(DONE_CHANNEL, start).back();
+        TEST_ASSERT_EQUAL_UINT32(0, last.duty);
+        TEST_ASSERT_GREATER_OR_EQUAL(40000 - LATENCY_BOUND_US, 
+                last.timeUs - start);
+        TEST_ASSERT_GREATER_OR_EQUAL(last.timeUs, woken);
+        TEST_ASSERT_LESS_OR_EQUAL(HOST_BOUND_US, woken - last.timeUs);
+        delays.push_back(woken - last.timeUs);
+    }
+    // the waiter is notified right after the last edge is written
+    std::sort(delays.begin(), delays.end());
+    TEST_ASSERT_LESS_OR_EQUAL(LATENCY_BOUND_US, 
+            delays[DONE_SAMPLES / 2]);
+};
+
+static void test_wakeups_saved(){
+    // a slack of 15 ms lets one wakeup serve two 10 ms edges of the same
+    // LED, which saves no wakeup: the LED would have caught up the same
+    // way on its own
+    TEST_ASSERT_TRUE(slackLeds[0].begin(slackEngine));
+    slackLeds[0].setSlack(15000);
+    slackLeds[0].flash(stressPatterns[0]);
+    delay(200);
+    TEST_ASSERT_EQUAL_UINT32(0, slackEngine.wakeupsSaved());
+    // a second LED whose edges fall in between shares those wakeups
+    TEST_ASSERT_TRUE(slackLeds[1].begin(slackEngine));
+    slackLeds[1].setSlack(15000);
+    delay(5);
+    slackLeds[1].flash(stressPatterns[0]);
+    delay(200);
+    TEST_ASSERT_GREATER_THAN(0, slackEngine.wakeupsSaved());
+    for (PWM_LED & led : slackLeds){
+        led.off();
+    }
+};
+
+static void test_isr_latency(){
+    TEST_ASSERT_TRUE(isrLed.begin());
+    delay(10);
+    std::vector<int64_t> latencies;
+    for (uint16_t i = 0; i < ISR_SAMPLES; i++){
+        int64_t start = esp_timer_get_time();
+        BaseType_t woken = pdFALSE;
+        TEST_ASSERT_TRUE(i % 2 == 0? isrLed.onFromISR(&woken) : 
+                isrLed.offFromISR(&woken));
+        std::vector<PWM_LED_TraceEvent> writes;
+        for (uint16_t wait = 0; writes.empty() && wait < 1000; wait++){
+            delayMicroseconds(100);
+            writes = recorder.writes(ISR_CHANNEL, start);
+        }
+        TEST_ASSERT_EQUAL(1, writes.size());
+        TEST_ASSERT_EQUAL_UINT32(i % 2 == 0? brightness : 0, writes[0].duty);
+        TEST_ASSERT_LESS_OR_EQUAL(HOST_BOUND_US, 
+                writes[0].timeUs - start);
+        latencies.push_back(writes[0].timeUs - start);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    TEST_ASSERT_LESS_OR_EQUAL(LATENCY_BOUND_US, 
+            latencies[ISR_SAMPLES * 99 / 100]);
+    TEST_ASSERT_EQUAL_UINT32(0, isrLed.droppedFromISR());
+};
+
+static void test_frame_buffer_end(){
+    TEST_ASSERT_TRUE(frameLed.begin());
+    TEST_ASSERT_TRUE(panel.add(frameLed));
+    TEST_ASSERT_TRUE(panel.begin());
+    panel.set(0, 100);
+    panel.present();
+    TEST_ASSERT_TRUE(panel.wait(100));
+    // the command plays, but the frame buffer owns the output
+    frameLed.on();
+    delay(10);
+    TEST_ASSERT_EQUAL_UINT32(100,
+            recorder.writes(FRAME_CHANNEL, 0).back().duty);
+    // once ended, the task stops and the LED shows its own level at once
+    panel.end();
+    uint32_t frames = panel.frames();
+    delay(10);
+    TEST_ASSERT_EQUAL_UINT32(frames, panel.frames());
+    TEST_ASSERT_EQUAL_UINT32(brightness,
+            recorder.writes(FRAME_CHANNEL, 0).back().duty);
+    TEST_ASSERT_FALSE(panel.begin());
+    frameLed.off();
+};
+
+void runCommandTests(){
+    RUN_TEST(test_concurrent_commands_task);
+    RUN_TEST(test_concurrent_commands_engine);
+    RUN_TEST(test_state_follows_commands);
+    RUN_TEST(test_registry_exhaustion);
+    RUN_TEST(test_second_waiter_refused);
+    RUN_TEST(test_wait_follows_last_edge);
+    RUN_TEST(test_wakeups_saved);
+    RUN_TEST(test_isr_latency);
+    RUN_TEST(test_frame_buffer_end);
+};
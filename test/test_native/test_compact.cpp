@@ -0,0 +1,134 @@
+/*!
+* @file test_compact.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of compact patterns and step generators: the timeline they play,
+* repeat blocks, steps of no length and the end of a generated sequence.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+
+#define COMPACT_CHANNEL 45
+#define GENERATOR_CHANNEL 46
+
+/// The largest lateness of an edge.
+#define EDGE_TOLERANCE_US 5000
+
+/// The number of steps of a generated cycle.
+#define GENERATED_STEPS 6
+
+static int brightness = 200;
+
+static RecordingOutput recorder;
+
+static PWM_LED compactLed(recorder, 45, COMPACT_CHANNEL, brightness, HIGH);
+
+static PWM_LED generatorLed(recorder, 46, GENERATOR_CHANNEL, brightness,
+        HIGH);
+
+/// Two 10 ms blinks, then 20 ms on, no time off and 10 ms on, which show
+/// as one 30 ms blink, and 30 ms off: a cycle of 100 ms, in units of 2 ms.
+static const uint8_t BLINKS[] = {PWM_LED_REPEAT, 2, 2,  5, 5,  10, 0, 5, 15};
+
+static constexpr PWM_LED_CompactPattern COMPACT(BLINKS, 2000);
+
+/// The times of the edges of a cycle of COMPACT in milliseconds; rising
+/// edges first.
+static const int64_t COMPACT_EDGES_MS[] = {0, 10, 20, 30, 40, 70};
+
+#define COMPACT_CYCLE_MS 100
+
+/// @brief Steps of 5, 10, ... 30 ms, then the end of the cycle.
+static uint32_t rampingSteps(void *, uint32_t index){
+    return index < GENERATED_STEPS? (index + 1) * 5000 : 0;
+};
+
+static PWM_LED_FunctionGenerator generator(rampingSteps);
+
+/// @brief Checks that the duty of every edge of [played] alternates from
+/// on, and that edge i is [expectedMs][i] after the first, within the
+/// tolerance.
+static void checkEdges(const std::vector<PWM_LED_TraceEvent> & played,
+        const std::vector<int64_t> & expectedMs){
+    TEST_ASSERT_GREATER_OR_EQUAL(expectedMs.size(), played.size());
+    for (size_t i = 0; i < expectedMs.size(); i++){
+        TEST_ASSERT_EQUAL_UINT32(i % 2 == 0? brightness : 0, played[i].duty);
+        TEST_ASSERT_INT_WITHIN(EDGE_TOLERANCE_US, expectedMs[i] * 1000,
+                played[i].timeUs - played[0].timeUs);
+    }
+};
+
+/// @brief The writes to [channel] from [fromUs] that changed its duty.
+static std::vector<PWM_LED_TraceEvent> changes(uint8_t channel,
+        int64_t fromUs){
+    std::vector<PWM_LED_TraceEvent> changes;
+    uint32_t duty = 0;
+    for (const PWM_LED_TraceEvent & write : recorder.writes(channel, fromUs)){
+        if (write.duty != duty){
+            changes.push_back(write);
+        }
+        duty = write.duty;
+    }
+    return changes;
+};
+
+static void test_compact_timeline(){
+    TEST_ASSERT_TRUE(COMPACT.playable());
+    TEST_ASSERT_TRUE(compactLed.begin());
+    delay(10);
+    int64_t startUs = esp_timer_get_time();
+    compactLed.flash(COMPACT);
+    delay(2 * COMPACT_CYCLE_MS + 10);
+    compactLed.off();
+    // the repeat block plays twice, and the step of no length writes
+    // nothing, so the blinks on either side of it show as one
+    std::vector<int64_t> expectedMs;
+    for (uint8_t cycle = 0; cycle < 2; cycle++){
+        for (int64_t edgeMs : COMPACT_EDGES_MS){
+            expectedMs.push_back(cycle * COMPACT_CYCLE_MS + edgeMs);
+        }
+    }
+    checkEdges(changes(COMPACT_CHANNEL, startUs), expectedMs);
+};
+
+static void test_generator_repeats(){
+    TEST_ASSERT_TRUE(generatorLed.begin());
+    delay(10);
+    int64_t startUs = esp_timer_get_time();
+    PWM_LED_Handle handle = generatorLed.flash(generator, 2);
+    TEST_ASSERT_TRUE(handle.wait(1000));
+    // each cycle of the generator starts on, so the last step of the
+    // first cycle, which is off, is followed by a rising edge
+    std::vector<int64_t> expectedMs;
+    int64_t edgeMs = 0;
+    for (uint8_t i = 0; i < 2 * GENERATED_STEPS; i++){
+        expectedMs.push_back(edgeMs);
+        edgeMs += rampingSteps(NULL, i % GENERATED_STEPS) / 1000;
+    }
+    std::vector<PWM_LED_TraceEvent> played =
+            changes(GENERATOR_CHANNEL, startUs);
+    checkEdges(played, expectedMs);
+    // the LED stays off after the last step, which is off
+    TEST_ASSERT_EQUAL(expectedMs.size(), played.size());
+    int64_t lastUs = recorder.writes(GENERATOR_CHANNEL, startUs).back().timeUs;
+    TEST_ASSERT_INT_WITHIN(EDGE_TOLERANCE_US, edgeMs * 1000,
+            lastUs - played[0].timeUs);
+    TEST_ASSERT_EQUAL(LED_OFF, generatorLed.state());
+};
+
+void runCompactTests(){
+    RUN_TEST(test_compact_timeline);
+    RUN_TEST(test_generator_repeats);
+};
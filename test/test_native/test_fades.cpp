@@ -0,0 +1,181 @@
+/*!
+* @file test_fades.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of the accuracy and the update rate of `fadeTo()` and of the soft
+* edges of `PWM_LED_Pattern::withRamps()`, read from the recorded output.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+#include "PWM_RGB_LED.h"
+
+#define FADE_CHANNEL 13
+#define SLOW_FADE_CHANNEL 14
+#define RAMP_CHANNEL 15
+#define RGB_CHANNEL 16
+
+/// The largest lateness of a fade update.
+#define UPDATE_TOLERANCE_US 4000
+
+static int brightness = 255;
+
+static PWM_LED fadeLed(23, FADE_CHANNEL, brightness, HIGH);
+
+static PWM_LED slowFadeLed(24, SLOW_FADE_CHANNEL, brightness, HIGH);
+
+static PWM_LED rampLed(25, RAMP_CHANNEL, brightness, HIGH);
+
+/// @brief A backend that fades only its first channel in hardware and
+/// records which channels are fading.
+class PartialFadeOutput: public PWM_LED_Output{
+
+    public:
+
+    bool fading[3] = {};
+
+    uint32_t writes[3] = {};
+
+    bool attach(uint8_t, uint8_t) override {
+        return true;
+    };
+
+    void write(uint8_t channel, uint32_t) override {
+        fading[channel - RGB_CHANNEL] = false;
+        writes[channel - RGB_CHANNEL]++;
+    };
+
+    bool fade(uint8_t channel, uint32_t, uint32_t, int64_t) override {
+        if (channel != RGB_CHANNEL){
+            return false;
+        }
+        fading[0] = true;
+        return true;
+    };
+
+};
+
+static PartialFadeOutput partialFade;
+
+static PWM_RGB_LED rgbLed(partialFade, 26, RGB_CHANNEL, 27, RGB_CHANNEL + 1,
+        28, RGB_CHANNEL + 2, brightness, HIGH);
+
+/// On and off for 200 ms, fading in over 100 ms and out over 60 ms.
+static const uint16_t RAMP_STEPS[] = {200, 200};
+
+static constexpr PWM_LED_Pattern RAMPED =
+        PWM_LED_Pattern(RAMP_STEPS).withRamps(100, 60);
+
+/// @brief Fades [led] from off to [level] over [durationMs] and checks
+/// every write against the straight line of the fade.
+/// @return The writes of the fade.
+static std::vector<PWM_LED_TraceEvent> checkFade(PWM_LED & led,
+        uint8_t channel,
+        int level,
+        uint16_t durationMs){
+    int64_t durationUs = (int64_t)durationMs * 1000;
+    TEST_ASSERT_TRUE(led.begin());
+    delay(10);
+    int64_t startUs = esp_timer_get_time();
+    led.fadeTo(level, durationMs);
+    delay(durationMs + 50);
+    std::vector<PWM_LED_TraceEvent> writes = edges(channel, startUs);
+    TEST_ASSERT_GREATER_THAN(0, writes.size());
+    uint32_t previous = 0;
+    for (const PWM_LED_TraceEvent & write : writes){
+        // the level the fade should have reached when the write was made,
+        // allowing for the update being late
+        int64_t elapsedUs = write.timeUs - startUs;
+        int64_t expected = std::min((int64_t)level,
+                level * elapsedUs / durationUs);
+        int64_t earliest = std::max((int64_t)0,
+                level * (elapsedUs - UPDATE_TOLERANCE_US) / durationUs);
+        TEST_ASSERT_GREATER_THAN(previous, write.duty);
+        TEST_ASSERT_LESS_OR_EQUAL(expected, write.duty);
+        TEST_ASSERT_GREATER_OR_EQUAL(earliest, write.duty);
+        previous = write.duty;
+    }
+    TEST_ASSERT_EQUAL_UINT32(level, writes.back().duty);
+    TEST_ASSERT_INT_WITHIN(UPDATE_TOLERANCE_US, startUs + durationUs,
+            writes.back().timeUs);
+    TEST_ASSERT_EQUAL(LED_ON, led.state());
+    return writes;
+};
+
+static void test_fade_accuracy(){
+    // one duty step takes 2 ms, so the updates are limited by the
+    // fade interval: one every 20 ms
+    std::vector<PWM_LED_TraceEvent> writes =
+            checkFade(fadeLed, FADE_CHANNEL, 255, 500);
+    uint32_t updates = 500000 / PWM_LED_FADE_INTERVAL_US;
+    TEST_ASSERT_INT_WITHIN(2, updates, writes.size());
+};
+
+static void test_slow_fade_update_rate(){
+    // one duty step takes 100 ms, so the LED is updated once per step
+    std::vector<PWM_LED_TraceEvent> writes =
+            checkFade(slowFadeLed, SLOW_FADE_CHANNEL, 10, 1000);
+    TEST_ASSERT_EQUAL(10, writes.size());
+    for (size_t i = 0; i < writes.size(); i++){
+        TEST_ASSERT_EQUAL_UINT32(i + 1, writes[i].duty);
+    }
+};
+
+static void test_ramp_updates(){
+    TEST_ASSERT_TRUE(rampLed.begin());
+    delay(10);
+    int64_t startUs = esp_timer_get_time();
+    rampLed.flash(RAMPED);
+    delay(2 * RAMPED.cycleUs() / 1000);
+    rampLed.off();
+    std::vector<PWM_LED_TraceEvent> writes = edges(RAMP_CHANNEL, startUs);
+    // every cycle fades in, holds and fades out, and each ramp is updated
+    // at most once per fade interval
+    uint32_t rampUpdates = (RAMPED.rampOnUs() + RAMPED.rampOffUs()) /
+            PWM_LED_FADE_INTERVAL_US;
+    TEST_ASSERT_LESS_OR_EQUAL(2 * (rampUpdates + 4), writes.size());
+    TEST_ASSERT_GREATER_OR_EQUAL(2 * (rampUpdates - 2), writes.size());
+    // the fade in reaches the full level at the end of its ramp
+    size_t peak = 0;
+    while (peak < writes.size() && writes[peak].duty != (uint32_t)brightness){
+        TEST_ASSERT_TRUE(peak == 0 ||
+                writes[peak].duty > writes[peak - 1].duty);
+        peak++;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(writes.size() - 1, peak);
+    TEST_ASSERT_INT_WITHIN(UPDATE_TOLERANCE_US, startUs + RAMPED.rampOnUs(),
+            writes[peak].timeUs);
+};
+
+static void test_rgb_partial_hardware_fade(){
+    // the green channel cannot fade in hardware, so the red one must not
+    // keep fading while software drives all three
+    TEST_ASSERT_TRUE(rgbLed.begin());
+    rgbLed.setColor(COLOR_YELLOW);
+    delay(10);
+    uint32_t writes = partialFade.writes[1];
+    rgbLed.fadeTo(255, 200);
+    // before the first software update
+    delay(5);
+    TEST_ASSERT_FALSE(partialFade.fading[0]);
+    delay(100);
+    TEST_ASSERT_GREATER_THAN(writes + 2, partialFade.writes[1]);
+};
+
+void runFadeTests(){
+    RUN_TEST(test_fade_accuracy);
+    RUN_TEST(test_slow_fade_update_rate);
+    RUN_TEST(test_ramp_updates);
+    RUN_TEST(test_rgb_partial_hardware_fade);
+};
@@ -0,0 +1,126 @@
+/*!
+* @file test_fixed.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of PWM_LED_Fixed: the channel settings it attaches with, and the
+* duty cycles it writes at its resolution and polarity.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+#include "PWM_LED_Fixed.h"
+
+#define HIGH_CHANNEL 55
+#define LOW_CHANNEL 56
+
+typedef PWM_LED_Fixed<14, 1000, true> Lamp;
+
+typedef PWM_LED_Fixed<10, 5000, false> Indicator;
+
+static_assert(Lamp::Policy::maxDuty == 16383, "14 bits");
+static_assert(Lamp::Policy::duty(12000) == 12000, "active high");
+static_assert(Indicator::Policy::duty(0) == 1023, "active low");
+static_assert(Indicator::Policy::duty(1000) == 23, "active low");
+
+/// @brief A recorder that also keeps the settings each channel was
+/// attached with.
+class SettingsRecorder: public RecordingOutput{
+
+    public:
+
+    bool attach(uint8_t pin,
+            uint8_t channel,
+            uint8_t resolution,
+            uint32_t frequency) override {
+        _resolution[channel] = resolution;
+        _frequency[channel] = frequency;
+        return RecordingOutput::attach(pin, channel);
+    };
+
+    uint8_t resolution(uint8_t channel){
+        return _resolution[channel];
+    };
+
+    uint32_t frequency(uint8_t channel){
+        return _frequency[channel];
+    };
+
+    private:
+
+    uint8_t _resolution[256] = {};
+
+    uint32_t _frequency[256] = {};
+
+};
+
+static SettingsRecorder recorder;
+
+/// Above what 8 bits can hold.
+static int lampBrightness = 12000;
+
+static int indicatorBrightness = 1000;
+
+static Lamp lamp(recorder, 55, HIGH_CHANNEL, lampBrightness);
+
+static Indicator indicator(recorder, 56, LOW_CHANNEL, indicatorBrightness);
+
+static const uint16_t BLINK_STEPS[] = {20, 20};
+
+static constexpr PWM_LED_Pattern BLINK(BLINK_STEPS);
+
+/// @brief The last duty cycle written to [channel].
+static uint32_t lastDuty(uint8_t channel){
+    return recorder.writes(channel, 0).back().duty;
+};
+
+static void test_fixed_duty(){
+    TEST_ASSERT_TRUE(lamp.begin());
+    TEST_ASSERT_TRUE(indicator.begin());
+    TEST_ASSERT_EQUAL(14, recorder.resolution(HIGH_CHANNEL));
+    TEST_ASSERT_EQUAL_UINT32(1000, recorder.frequency(HIGH_CHANNEL));
+    TEST_ASSERT_EQUAL(10, recorder.resolution(LOW_CHANNEL));
+    TEST_ASSERT_EQUAL_UINT32(5000, recorder.frequency(LOW_CHANNEL));
+    TEST_ASSERT_EQUAL(16383, lamp.maxLevel());
+    // off drives an active-low pin fully high
+    delay(10);
+    TEST_ASSERT_EQUAL_UINT32(0, lastDuty(HIGH_CHANNEL));
+    TEST_ASSERT_EQUAL_UINT32(1023, lastDuty(LOW_CHANNEL));
+    lamp.on();
+    indicator.on();
+    delay(10);
+    TEST_ASSERT_EQUAL_UINT32(12000, lastDuty(HIGH_CHANNEL));
+    TEST_ASSERT_EQUAL_UINT32(23, lastDuty(LOW_CHANNEL));
+    // a brightness past the resolution is clamped to it
+    lampBrightness = 20000;
+    lamp.refresh();
+    delay(10);
+    TEST_ASSERT_EQUAL_UINT32(16383, lastDuty(HIGH_CHANNEL));
+    lampBrightness = 12000;
+    // the steps of a pattern play at the same duty cycles
+    int64_t startUs = esp_timer_get_time();
+    indicator.flash(BLINK);
+    delay(4 * BLINK_STEPS[0] + 10);
+    indicator.off();
+    std::vector<PWM_LED_TraceEvent> writes =
+            recorder.writes(LOW_CHANNEL, startUs);
+    TEST_ASSERT_GREATER_OR_EQUAL(4, writes.size());
+    for (const PWM_LED_TraceEvent & write : writes){
+        TEST_ASSERT_TRUE(write.duty == 23 || write.duty == 1023);
+    }
+    lamp.off();
+};
+
+void runFixedTests(){
+    RUN_TEST(test_fixed_duty);
+};
@@ -0,0 +1,56 @@
+/*!
+* @file test_main.cpp
+*
+* @section intro_sec_Introduction
+*
+* Runner of the host test suite of the PWM_LED library.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+#include <unistd.h>
+
+void setUp(){};
+
+void tearDown(){};
+
+std::vector<PWM_LED_TraceEvent> edges(uint8_t channel, int64_t fromUs){
+    std::vector<PWM_LED_TraceEvent> edges;
+    uint32_t duty = UINT32_MAX;
+    for (const PWM_LED_TraceEvent & event : PWM_LED_Trace::events(channel)){
+        if (event.duty != duty && event.timeUs >= fromUs){
+            edges.push_back(event);
+        }
+        duty = event.duty;
+    }
+    return edges;
+};
+
+int main(){
+    UNITY_BEGIN();
+    runCommandTests();
+    runPatternTests();
+    runFadeTests();
+    runCompactTests();
+    runSyncTests();
+    runQueueTests();
+    runBrightnessTests();
+    runFixedTests();
+    runBamTests();
+    runWaveformTests();
+    runColorTests();
+    int failures = UNITY_END();
+    // the LED tasks never return, so leave without joining their threads
+    fflush(stdout);
+    _exit(failures);
+};
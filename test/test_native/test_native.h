@@ -0,0 +1,105 @@
+/*!
+* @file test_native.h
+*
+* @section intro_sec_Introduction
+*
+* Shared declarations of the host test suite of the PWM_LED library.
+*
+* The suite runs on the host backend of the library (`pio test -e native`):
+* LED tasks are threads and every PWM write is recorded by PWM_LED_Trace,
+* so the tests assert on the timestamped duty cycles of each channel. The
+* LED tasks cannot be stopped, so every test drives LEDs on PWM channels
+* of its own. The host simulates the 16 LEDC channels of the ESP32; LEDs
+* past them write to a RecordingOutput instead.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#ifndef __TEST_NATIVE_H__
+#define __TEST_NATIVE_H__
+
+#include <unity.h>
+#include "PWM_LED.h"
+#include <mutex>
+
+/// @brief Runs the tests of `on()`, `off()` and `flash()`.
+void runCommandTests();
+
+/// @brief Runs the tests of the compile-time pattern builders.
+void runPatternTests();
+
+/// @brief Runs the tests of fades and soft-edged patterns.
+void runFadeTests();
+
+/// @brief Runs the tests of sync groups.
+void runSyncTests();
+
+/// @brief Runs the tests of compact patterns and step generators.
+void runCompactTests();
+
+/// @brief Runs the tests of the pattern queue.
+void runQueueTests();
+
+/// @brief Runs the tests of brightness groups.
+void runBrightnessTests();
+
+/// @brief Runs the tests of PWM_LED_Fixed.
+void runFixedTests();
+
+/// @brief Runs the tests of the bit-angle modulation backend.
+void runBamTests();
+
+/// @brief Runs the tests of waveforms.
+void runWaveformTests();
+
+/// @brief Runs the tests of the color maths and RGB LEDs.
+void runColorTests();
+
+/// @brief A backend that records the time and duty cycle of every write.
+class RecordingOutput: public PWM_LED_Output{
+
+    public:
+
+    bool attach(uint8_t, uint8_t) override {
+        return true;
+    };
+
+    void write(uint8_t channel, uint32_t duty) override {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _writes.push_back({esp_timer_get_time(), channel, duty});
+    };
+
+    /// @brief The writes to [channel] at or after [fromUs].
+    std::vector<PWM_LED_TraceEvent> writes(uint8_t channel, int64_t fromUs){
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<PWM_LED_TraceEvent> writes;
+        for (const PWM_LED_TraceEvent & write : _writes){
+            if (write.channel == channel && write.timeUs >= fromUs){
+                writes.push_back(write);
+            }
+        }
+        return writes;
+    };
+
+    private:
+
+    std::mutex _mutex;
+
+    std::vector<PWM_LED_TraceEvent> _writes;
+
+};
+
+/// @brief The writes to [channel] at or after [fromUs] that changed its
+/// duty cycle.
+std::vector<PWM_LED_TraceEvent> edges(uint8_t channel, int64_t fromUs = 0);
+
+#endif // __TEST_NATIVE_H__
@@ -0,0 +1,105 @@
+/*!
+* @file test_patterns.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of the compile-time pattern builders `PWM_LED_morse()` and
+* `PWM_LED_blinkCode()`, and of the timing with which they play.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+
+#define MORSE_CHANNEL 11
+#define BLINK_CODE_CHANNEL 12
+
+/// The largest lateness of an edge: half a Morse unit, so that a late
+/// edge cannot be taken for the next one.
+#define EDGE_TOLERANCE_US 10000
+
+static int brightness = 255;
+
+static PWM_LED morseLed(21, MORSE_CHANNEL, brightness, HIGH);
+
+static PWM_LED blinkCodeLed(22, BLINK_CODE_CHANNEL, brightness, HIGH);
+
+/// S, O: dots and dashes of 20 ms, a letter gap and the closing word gap.
+static constexpr auto SO_STEPS = PWM_LED_morse("... ---", 20);
+
+static constexpr PWM_LED_Pattern SO(SO_STEPS);
+
+/// 2-1 with 20 ms blinks, 30 ms pauses, a 100 ms gap and a 200 ms break.
+static constexpr auto CODE_STEPS = PWM_LED_blinkCode<2, 1>(20, 30, 100, 200);
+
+static constexpr PWM_LED_Pattern CODE(CODE_STEPS);
+
+/// The longest unit whose word gap still fits a step.
+static constexpr auto LONG_STEPS = PWM_LED_morse(". .", UINT16_MAX / 7);
+
+/// @brief Plays [pattern] on [led] for two cycles and checks that every
+/// edge is on time: the edges are scheduled from the start of the
+/// pattern, so no edge may be later than the tolerance.
+static void checkTiming(PWM_LED & led,
+        uint8_t channel,
+        const PWM_LED_Pattern & pattern){
+    TEST_ASSERT_TRUE(led.begin());
+    delay(10);
+    int64_t from = esp_timer_get_time();
+    led.flash(pattern);
+    delay(2 * pattern.cycleUs() / 1000 + 10);
+    led.off();
+    std::vector<PWM_LED_TraceEvent> played = edges(channel, from);
+    TEST_ASSERT_GREATER_OR_EQUAL(2 * pattern.length(), played.size());
+    int64_t expectedUs = played[0].timeUs;
+    for (uint16_t i = 0; i < 2 * pattern.length(); i++){
+        TEST_ASSERT_EQUAL_UINT32(i % 2 == 0? brightness : 0, played[i].duty);
+        TEST_ASSERT_INT_WITHIN(EDGE_TOLERANCE_US, expectedUs,
+                played[i].timeUs);
+        // a cycle starts with an `on` step, so the `off` step that closes
+        // it is followed by a rising edge
+        expectedUs += (int64_t)pattern.steps()[i % pattern.length()] *
+                pattern.unitUs();
+    }
+};
+
+static void test_morse_steps(){
+    const uint16_t expected[] = {20, 20, 20, 20, 20, 60,
+                                 60, 20, 60, 20, 60, 140};
+    TEST_ASSERT_EQUAL(12, SO_STEPS.length);
+    TEST_ASSERT_EQUAL(PWM_LED_UNIT_MS, SO_STEPS.unitUs);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(expected, SO_STEPS.steps, 12);
+    TEST_ASSERT_EQUAL(4, LONG_STEPS.length);
+    TEST_ASSERT_EQUAL_UINT16(3 * (UINT16_MAX / 7), LONG_STEPS.steps[1]);
+    TEST_ASSERT_EQUAL_UINT16(7 * (UINT16_MAX / 7), LONG_STEPS.steps[3]);
+};
+
+static void test_blink_code_steps(){
+    const uint16_t expected[] = {20, 30, 20, 100, 20, 200};
+    TEST_ASSERT_EQUAL(6, CODE_STEPS.length);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(expected, CODE_STEPS.steps, 6);
+};
+
+static void test_morse_timing(){
+    checkTiming(morseLed, MORSE_CHANNEL, SO);
+};
+
+static void test_blink_code_timing(){
+    checkTiming(blinkCodeLed, BLINK_CODE_CHANNEL, CODE);
+};
+
+void runPatternTests(){
+    RUN_TEST(test_morse_steps);
+    RUN_TEST(test_blink_code_steps);
+    RUN_TEST(test_morse_timing);
+    RUN_TEST(test_blink_code_timing);
+};
@@ -0,0 +1,182 @@
+/*!
+* @file test_queue.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of the prioritised pattern queue: preemption and resumption,
+* equal priorities, repeats, cancellation, a full queue and stale ids.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+
+#define PREEMPT_CHANNEL 40
+#define CANCEL_CHANNEL 41
+#define FULL_CHANNEL 42
+#define STALE_CHANNEL 43
+
+/// The steps of the two queued patterns; the length of a step tells
+/// which one plays.
+#define SLOW_MS 30
+#define FAST_MS 10
+
+static int brightness = 200;
+
+static RecordingOutput recorder;
+
+static PWM_LED preemptLed(recorder, 40, PREEMPT_CHANNEL, brightness, HIGH);
+
+static PWM_LED cancelLed(recorder, 41, CANCEL_CHANNEL, brightness, HIGH);
+
+static PWM_LED fullLed(recorder, 42, FULL_CHANNEL, brightness, HIGH);
+
+static PWM_LED staleLed(recorder, 43, STALE_CHANNEL, brightness, HIGH);
+
+static const uint16_t SLOW_STEPS[] = {SLOW_MS, SLOW_MS};
+
+static const uint16_t FAST_STEPS[] = {FAST_MS, FAST_MS};
+
+static constexpr PWM_LED_Pattern SLOW(SLOW_STEPS);
+
+static constexpr PWM_LED_Pattern FAST(FAST_STEPS);
+
+/// @brief The lengths in milliseconds of the steps that [channel] played
+/// between [fromUs] and [toUs], rounded to the nearest millisecond.
+static std::vector<int64_t> steps(uint8_t channel,
+        int64_t fromUs,
+        int64_t toUs){
+    std::vector<int64_t> steps;
+    std::vector<PWM_LED_TraceEvent> writes = recorder.writes(channel, fromUs);
+    int64_t edgeUs = 0;
+    uint32_t duty = UINT32_MAX;
+    for (const PWM_LED_TraceEvent & write : writes){
+        if (write.timeUs > toUs){
+            break;
+        }
+        if (write.duty == duty){
+            continue;
+        }
+        if (duty != UINT32_MAX){
+            steps.push_back((write.timeUs - edgeUs + 500) / 1000);
+        }
+        edgeUs = write.timeUs;
+        duty = write.duty;
+    }
+    return steps;
+};
+
+/// @brief Checks that every step of [played] is [stepMs] long.
+static void checkSteps(const std::vector<int64_t> & played, int64_t stepMs){
+    TEST_ASSERT_GREATER_THAN(0, played.size());
+    for (int64_t step : played){
+        TEST_ASSERT_INT_WITHIN(FAST_MS / 2, stepMs, step);
+    }
+};
+
+static void test_queue_preempts_and_resumes(){
+    TEST_ASSERT_TRUE(preemptLed.begin());
+    preemptLed.off();
+    TEST_ASSERT_NOT_EQUAL(0, preemptLed.enqueue(SLOW, 1));
+    delay(2 * SLOW_MS + 5);
+    // two fast cycles preempt the slow pattern and then end
+    int64_t preemptUs = esp_timer_get_time();
+    TEST_ASSERT_NOT_EQUAL(0, preemptLed.enqueue(FAST, 2, 2));
+    TEST_ASSERT_EQUAL(2, preemptLed.queued());
+    delay(4 * FAST_MS + 5);
+    int64_t resumeUs = esp_timer_get_time();
+    delay(4 * SLOW_MS);
+    TEST_ASSERT_EQUAL(1, preemptLed.queued());
+    std::vector<int64_t> preempted = steps(PREEMPT_CHANNEL, preemptUs,
+            resumeUs);
+    // the first step is cut short by the preemption
+    preempted.erase(preempted.begin());
+    checkSteps(preempted, FAST_MS);
+    TEST_ASSERT_EQUAL(3, preempted.size());
+    // the slow pattern resumes from the start of its cycle
+    std::vector<int64_t> resumed = steps(PREEMPT_CHANNEL, resumeUs,
+            esp_timer_get_time());
+    checkSteps(resumed, SLOW_MS);
+    preemptLed.clearQueue();
+    delay(10);
+    TEST_ASSERT_EQUAL(0, preemptLed.queued());
+    TEST_ASSERT_EQUAL_UINT32(0,
+            recorder.writes(PREEMPT_CHANNEL, 0).back().duty);
+};
+
+static void test_queue_cancels_top(){
+    TEST_ASSERT_TRUE(cancelLed.begin());
+    cancelLed.off();
+    uint16_t slow = cancelLed.enqueue(SLOW, 1);
+    // the newer entry wins among equal priorities
+    uint16_t fast = cancelLed.enqueue(FAST, 1);
+    TEST_ASSERT_NOT_EQUAL(0, slow);
+    TEST_ASSERT_NOT_EQUAL(0, fast);
+    int64_t startUs = esp_timer_get_time();
+    delay(4 * FAST_MS + 5);
+    int64_t cancelUs = esp_timer_get_time();
+    checkSteps(steps(CANCEL_CHANNEL, startUs + 1000, cancelUs), FAST_MS);
+    // cancelling the playing entry hands the LED back to the one below
+    TEST_ASSERT_TRUE(cancelLed.cancel(fast));
+    TEST_ASSERT_FALSE(cancelLed.cancel(fast));
+    delay(4 * SLOW_MS);
+    TEST_ASSERT_EQUAL(1, cancelLed.queued());
+    std::vector<int64_t> played = steps(CANCEL_CHANNEL, cancelUs,
+            esp_timer_get_time());
+    // the step playing at the cancel may end on either timeline
+    played.erase(played.begin());
+    checkSteps(played, SLOW_MS);
+    TEST_ASSERT_TRUE(cancelLed.cancel(slow));
+    delay(10);
+    TEST_ASSERT_EQUAL(0, cancelLed.queued());
+    TEST_ASSERT_EQUAL_UINT32(0,
+            recorder.writes(CANCEL_CHANNEL, 0).back().duty);
+};
+
+static void test_queue_full(){
+    TEST_ASSERT_TRUE(fullLed.begin());
+    for (uint8_t i = 0; i < PWM_LED_QUEUE_SIZE; i++){
+        TEST_ASSERT_NOT_EQUAL(0, fullLed.enqueue(SLOW, i));
+    }
+    TEST_ASSERT_EQUAL(0, fullLed.enqueue(FAST, 0xFF));
+    TEST_ASSERT_EQUAL(PWM_LED_QUEUE_SIZE, fullLed.queued());
+    // an entry that ends frees its slot
+    fullLed.clearQueue();
+    delay(10);
+    TEST_ASSERT_EQUAL(0, fullLed.queued());
+    TEST_ASSERT_NOT_EQUAL(0, fullLed.enqueue(FAST, 0xFF));
+    fullLed.clearQueue();
+};
+
+static void test_queue_stale_id(){
+    TEST_ASSERT_TRUE(staleLed.begin());
+    uint16_t stale = staleLed.enqueue(SLOW, 1);
+    TEST_ASSERT_TRUE(staleLed.cancel(stale));
+    delay(10);
+    TEST_ASSERT_EQUAL(0, staleLed.queued());
+    // the freed slot is reused, under a new id
+    uint16_t id = staleLed.enqueue(SLOW, 1);
+    TEST_ASSERT_NOT_EQUAL(0, id);
+    TEST_ASSERT_NOT_EQUAL(stale, id);
+    TEST_ASSERT_EQUAL(stale & 0xFF, id & 0xFF);
+    TEST_ASSERT_FALSE(staleLed.cancel(stale));
+    delay(10);
+    TEST_ASSERT_EQUAL(1, staleLed.queued());
+    TEST_ASSERT_TRUE(staleLed.cancel(id));
+};
+
+void runQueueTests(){
+    RUN_TEST(test_queue_preempts_and_resumes);
+    RUN_TEST(test_queue_cancels_top);
+    RUN_TEST(test_queue_full);
+    RUN_TEST(test_queue_stale_id);
+};
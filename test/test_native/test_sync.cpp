@@ -0,0 +1,189 @@
+/*!
+* @file test_sync.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of PWM_LED_SyncGroup: members that start out of step, or keep
+* falling behind, must play in phase with the group timeline.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are met.
+ *
+*/
+
+#include "test_native.h"
+#include "PWM_LED_SyncGroup.h"
+
+/// The members write past the simulated LEDC channels, to a recorder.
+#define SYNC_CHANNEL 24
+
+#define SYNC_LEDS 4
+
+/// The members of the compact group follow the first group.
+#define COMPACT_CHANNEL (SYNC_CHANNEL + SYNC_LEDS)
+
+#define COMPACT_LEDS 2
+
+/// The member that plays late.
+#define LATE_LED 3
+
+/// The slack of the late member: longer than a step, so that every
+/// wakeup of its engine finds the step it was due for already over.
+#define LATE_SLACK_US 25000
+
+/// The largest lateness of an edge of a member that plays on time.
+#define SKEW_TOLERANCE_US 5000
+
+static int brightness = 200;
+
+static RecordingOutput recorder;
+
+static PWM_LED_Engine syncEngine;
+
+static PWM_LED_Engine lateEngine;
+
+static PWM_LED_Engine compactEngine;
+
+static PWM_LED syncLeds[SYNC_LEDS] = {
+    {recorder, 32, SYNC_CHANNEL + 0, brightness, HIGH},
+    {recorder, 33, SYNC_CHANNEL + 1, brightness, HIGH},
+    {recorder, 34, SYNC_CHANNEL + 2, brightness, HIGH},
+    {recorder, 35, SYNC_CHANNEL + 3, brightness, HIGH}};
+
+/// A member on its own task, and one on an engine that is always late.
+static PWM_LED compactLeds[COMPACT_LEDS] = {
+    {recorder, 47, COMPACT_CHANNEL + 0, brightness, HIGH},
+    {recorder, 48, COMPACT_CHANNEL + 1, brightness, HIGH}};
+
+/// Two 10 ms blinks, a 30 ms blink made of 20 ms on, a step of no length
+/// and 10 ms on, and 30 ms off: a cycle of 100 ms, in units of 2 ms.
+static const uint8_t BLINKS[] = {PWM_LED_REPEAT, 2, 2,  5, 5,  10, 0, 5, 15};
+
+static constexpr PWM_LED_CompactPattern COMPACT_BLINKS(BLINKS, 2000);
+
+#define COMPACT_CYCLE_US 100000
+
+/// The visible edges of a cycle of COMPACT_BLINKS, and the end of the
+/// cycle, in microseconds; rising edges first.
+static const int64_t COMPACT_EDGES_US[] = {
+        0, 10000, 20000, 30000, 40000, 70000, COMPACT_CYCLE_US};
+
+/// On and off for 20 ms.
+static const uint16_t CHASE_STEPS[] = {20, 20};
+
+static constexpr PWM_LED_Pattern CHASE(CHASE_STEPS);
+
+/// @brief The duty cycle that member [i] should write at [timeUs].
+static uint32_t expected(uint8_t i, int64_t epochUs, int64_t timeUs){
+    int64_t cycleUs = CHASE.cycleUs();
+    int64_t position = (timeUs - epochUs + cycleUs * i / SYNC_LEDS) %
+            cycleUs;
+    return position < (int64_t)CHASE_STEPS[0] * CHASE.unitUs()?
+            brightness : 0;
+};
+
+/// @brief How far [timeUs] is after the last step boundary of member [i].
+static int64_t sinceEdge(uint8_t i, int64_t epochUs, int64_t timeUs){
+    int64_t stepUs = (int64_t)CHASE_STEPS[0] * CHASE.unitUs();
+    return (timeUs - epochUs + CHASE.cycleUs() * i / SYNC_LEDS) % stepUs;
+};
+
+static void test_sync_skew(){
+    // two members on their own tasks, one on a shared engine and one that
+    // is always late, each started out of step with the others
+    PWM_LED_SyncGroup group;
+    TEST_ASSERT_TRUE(syncLeds[0].begin());
+    TEST_ASSERT_TRUE(syncLeds[1].begin());
+    TEST_ASSERT_TRUE(syncLeds[2].begin(syncEngine));
+    TEST_ASSERT_TRUE(syncLeds[LATE_LED].begin(lateEngine));
+    syncLeds[LATE_LED].setSlack(LATE_SLACK_US);
+    for (uint8_t i = 0; i < SYNC_LEDS; i++){
+        TEST_ASSERT_TRUE(group.add(syncLeds[i], i * 0x10000 / SYNC_LEDS));
+        syncLeds[i].flash(CHASE);
+        delay(7);
+    }
+    int64_t epochUs = group.flash(CHASE);
+    delay(500);
+    for (uint8_t i = 0; i < SYNC_LEDS; i++){
+        std::vector<PWM_LED_TraceEvent> writes =
+                recorder.writes(SYNC_CHANNEL + i, epochUs);
+        TEST_ASSERT_GREATER_OR_EQUAL(i == LATE_LED? 8 : 20, writes.size());
+        for (size_t k = 0; k < writes.size(); k++){
+            const PWM_LED_TraceEvent & write = writes[k];
+            int64_t sinceUs = sinceEdge(i, epochUs, write.timeUs);
+            if (i != LATE_LED){
+                // every edge is on the group timeline, shifted by the
+                // phase of the member; the first write starts the member
+                // part-way into its step at the epoch
+                if (write.timeUs >= epochUs + SKEW_TOLERANCE_US){
+                    TEST_ASSERT_LESS_OR_EQUAL(SKEW_TOLERANCE_US, sinceUs);
+                }
+            } else {
+                // the late member writes once per wakeup, and what it
+                // writes is the step that plays at that time
+                TEST_ASSERT_TRUE(k == 0 || write.timeUs - 
+                        writes[k - 1].timeUs > SKEW_TOLERANCE_US);
+            }
+            if (sinceUs < SKEW_TOLERANCE_US){
+                // the write may belong to the step that just ended
+                continue;
+            }
+            TEST_ASSERT_EQUAL_UINT32(expected(i, epochUs, write.timeUs),
+                    write.duty);
+        }
+    }
+    for (PWM_LED & led : syncLeds){
+        led.off();
+    }
+};
+
+static void test_sync_compact(){
+    // the zero step falls in the middle of the long blink, where a late
+    // member steps through it to the step that plays
+    PWM_LED_SyncGroup group;
+    TEST_ASSERT_TRUE(compactLeds[0].begin());
+    TEST_ASSERT_TRUE(compactLeds[1].begin(compactEngine));
+    compactLeds[1].setSlack(LATE_SLACK_US);
+    for (uint8_t i = 0; i < COMPACT_LEDS; i++){
+        TEST_ASSERT_TRUE(group.add(compactLeds[i], i * 0x10000 / 
+                COMPACT_LEDS));
+    }
+    TEST_ASSERT_EQUAL_UINT32(50, COMPACT_BLINKS.cycleUnits());
+    int64_t epochUs = group.flash(COMPACT_BLINKS);
+    delay(500);
+    for (uint8_t i = 0; i < COMPACT_LEDS; i++){
+        std::vector<PWM_LED_TraceEvent> writes =
+                recorder.writes(COMPACT_CHANNEL + i, epochUs);
+        TEST_ASSERT_GREATER_OR_EQUAL(i == 0? 20 : 8, writes.size());
+        for (const PWM_LED_TraceEvent & write : writes){
+            // the position in the cycle, shifted by the phase
+            int64_t position = (write.timeUs - epochUs +
+                    COMPACT_CYCLE_US * i / COMPACT_LEDS) % COMPACT_CYCLE_US;
+            uint8_t edge = 0;
+            while (COMPACT_EDGES_US[edge + 1] <= position){
+                edge++;
+            }
+            if (position - COMPACT_EDGES_US[edge] < SKEW_TOLERANCE_US){
+                // the write may belong to the step that just ended
+                continue;
+            }
+            TEST_ASSERT_EQUAL_UINT32(edge % 2 == 0? brightness : 0,
+                    write.duty);
+        }
+    }
+    for (PWM_LED & led : compactLeds){
+        led.off();
+    }
+};
+
+void runSyncTests(){
+    RUN_TEST(test_sync_skew);
+    RUN_TEST(test_sync_compact);
+};
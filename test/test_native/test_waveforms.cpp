@@ -0,0 +1,125 @@
+/*!
+* @file test_waveforms.cpp
+*
+* @section intro_sec_Introduction
+*
+* Tests of waveforms: the interpolation of the shared tables, and the
+* levels an LED writes over two periods with a phase and an amplitude.
+*
+* @section author Author
+*
+* Gerhard Malan for GM Consult Pty Ltd
+*
+ * @section license License
+ *
+ * This library is open-source under the BSD 3-Clause license and
+ * redistribution and use in source and binary forms, with or without
+ * modification, are permitted, provided that the license conditions are
+ * met.
+ *
+*/
+
+#include "test_native.h"
+
+#define TRIANGLE_CHANNEL 57
+#define BREATHING_CHANNEL 58
+
+#define WAVE_PERIOD_MS 200
+#define WAVE_INTERVAL_US 5000
+
+/// The largest error of a written level: the host may pick a command up
+/// a little after its start time, and a level changes by up to two per
+/// millisecond.
+#define LEVEL_TOLERANCE 4
+
+static int brightness = 200;
+
+static RecordingOutput recorder;
+
+static PWM_LED triangleLed(recorder, 57, TRIANGLE_CHANNEL, brightness, HIGH);
+
+static PWM_LED breathingLed(recorder, 58, BREATHING_CHANNEL, brightness,
+        HIGH);
+
+/// @brief Checks the levels written to [channel] from [fromUs] until
+/// [toUs] against [waveform] played from [phase] at [amplitude]. The phase
+/// puts the first level above 0, so the first write marks the start of
+/// the wave.
+static void checkLevels(uint8_t channel,
+        int64_t fromUs,
+        int64_t toUs,
+        const PWM_LED_Waveform & waveform,
+        uint16_t phase,
+        uint16_t amplitude){
+    std::vector<PWM_LED_TraceEvent> writes;
+    for (const PWM_LED_TraceEvent & write : recorder.writes(channel, fromUs)){
+        if (write.timeUs < toUs){
+            writes.push_back(write);
+        }
+    }
+    // a level is written when it changes, at most once per update
+    TEST_ASSERT_GREATER_OR_EQUAL(WAVE_PERIOD_MS * 1000 / WAVE_INTERVAL_US,
+            writes.size());
+    TEST_ASSERT_LESS_OR_EQUAL((toUs - fromUs) / WAVE_INTERVAL_US + 1,
+            writes.size());
+    int64_t startUs = writes[0].timeUs;
+    int64_t periodUs = WAVE_PERIOD_MS * 1000;
+    for (size_t i = 0; i < writes.size(); i++){
+        uint16_t position = (uint16_t)(((writes[i].timeUs - startUs) %
+                periodUs) * 65536 / periodUs) + phase;
+        uint32_t envelope = (uint32_t)waveform.sample(position) *
+                amplitude / 0xFFFF;
+        int level = (int)(((int64_t)brightness * envelope + 0x7FFF) / 0xFFFF);
+        TEST_ASSERT_INT_WITHIN(LEVEL_TOLERANCE, level, writes[i].duty);
+    }
+};
+
+static void test_waveform_samples(){
+    const PWM_LED_Waveform & sine = PWM_LED_Waveform::sine();
+    const PWM_LED_Waveform & triangle = PWM_LED_Waveform::triangle();
+    const PWM_LED_Waveform & breathing = PWM_LED_Waveform::breathing();
+    TEST_ASSERT_EQUAL_UINT16(0, sine.sample(0));
+    TEST_ASSERT_EQUAL_UINT16(65535, sine.sample(0x8000));
+    TEST_ASSERT_EQUAL_UINT16(32767, sine.sample(0x4000));
+    // between two samples of the table
+    TEST_ASSERT_EQUAL_UINT16((158 + 630) / 2, sine.sample(0x0600));
+    TEST_ASSERT_EQUAL_UINT16(0, triangle.sample(0));
+    TEST_ASSERT_EQUAL_UINT16(65535, triangle.sample(0x8000));
+    TEST_ASSERT_EQUAL_UINT16(32767, triangle.sample(0x4000));
+    TEST_ASSERT_EQUAL_UINT16(32767, triangle.sample(0xC000));
+    TEST_ASSERT_EQUAL_UINT16(0, breathing.sample(0));
+    TEST_ASSERT_EQUAL_UINT16(65535, breathing.sample(0x8000));
+    // the breathing envelope lingers low: a quarter in, it is below the
+    // sine
+    TEST_ASSERT_LESS_THAN(sine.sample(0x4000), breathing.sample(0x4000));
+};
+
+static void test_waveform_levels(){
+    TEST_ASSERT_TRUE(triangleLed.begin());
+    TEST_ASSERT_TRUE(breathingLed.begin());
+    delay(10);
+    int64_t fromUs = esp_timer_get_time();
+    triangleLed.wave(PWM_LED_Waveform::triangle(), WAVE_PERIOD_MS, 0x4000,
+            0xFFFF, WAVE_INTERVAL_US);
+    breathingLed.wave(PWM_LED_Waveform::breathing(), WAVE_PERIOD_MS, 0x8000,
+            0x8000, WAVE_INTERVAL_US);
+    delay(2 * WAVE_PERIOD_MS);
+    int64_t offUs = esp_timer_get_time();
+    triangleLed.off();
+    breathingLed.off();
+    delay(10);
+    checkLevels(TRIANGLE_CHANNEL, fromUs, offUs, PWM_LED_Waveform::triangle(),
+            0x4000, 0xFFFF);
+    checkLevels(BREATHING_CHANNEL, fromUs, offUs,
+            PWM_LED_Waveform::breathing(), 0x8000, 0x8000);
+    // `off()` ends the wave: its write is the last
+    TEST_ASSERT_EQUAL_UINT32(0,
+            recorder.writes(TRIANGLE_CHANNEL, offUs).back().duty);
+    TEST_ASSERT_EQUAL_UINT32(0,
+            recorder.writes(BREATHING_CHANNEL, offUs).back().duty);
+};
+
+void runWaveformTests(){
+    RUN_TEST(test_waveform_samples);
+    RUN_TEST(test_waveform_levels);
+};